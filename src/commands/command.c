@@ -20,59 +20,191 @@
 
 #include "commands/command.h"
 
+#include <limits.h>
+#include <math.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 
 #include "commands/object.h"
 #include "memory/zmalloc.h"
 #include "server/client.h"
+#include "server/db.h"
+#include "server/evict.h"
 #include "server/server.h"
 #include "utils/log.h"
 #include "utils/string_util.h"
 
+// name, proc, arity, type, flags, first key, last key, key step.
+// A negative last key counts from the end of the arguments, so -1 means
+// every argument from the first key on is a key.
 static CutisCommand cmdTable[] = {
-    {"get", GetCommand, 2, CUTIS_CMD_INLINE},
-    {"set", SetCommand, 3, CUTIS_CMD_BULK},
-    {"setnx", SetnxCommand, 3, CUTIS_CMD_BULK},
-    {"exists", ExistsCommand, 2, CUTIS_CMD_INLINE},
-    {"del", DelCommand, 2, CUTIS_CMD_INLINE},
-    {"incr", IncrCommand, 2, CUTIS_CMD_INLINE},
-    {"decr", DecrCommand, 2, CUTIS_CMD_INLINE},
-    {"rpush", RPushCommand, 3, CUTIS_CMD_BULK},
-    {"lpush", LPushCommand, 3, CUTIS_CMD_BULK},
-    {"rpop", RPopCommand, 2, CUTIS_CMD_INLINE},
-    {"lpop", LPopCommand, 2, CUTIS_CMD_INLINE},
-    {"llen", LLenCommand, 2, CUTIS_CMD_INLINE},
-    {"lindex", LIndexCommand, 3, CUTIS_CMD_INLINE},
-    {"lrange", LRangeCommand, 4, CUTIS_CMD_INLINE},
-    {"ltrim", LTrimCommand, 4, CUTIS_CMD_INLINE},
-    {"lset", LSetCommand, 4, CUTIS_CMD_BULK},
-    {"sadd", SAddCommand, 3, CUTIS_CMD_BULK},
-    {"srem", SRemCommand, 3, CUTIS_CMD_BULK},
-    {"sismember", SIsMemberCommand, 3, CUTIS_CMD_BULK},
-    {"scard", SCardCommand, 2, CUTIS_CMD_INLINE},
-    {"sinter", SInterCommand, -2, CUTIS_CMD_INLINE},
-    {"smembers", SInterCommand, 2, CUTIS_CMD_INLINE},
-    {"select", SelectCommand, 2, CUTIS_CMD_INLINE},
-    {"move", MoveCommand, 3, CUTIS_CMD_INLINE},
-    {"rename", RenameCommand, 3, CUTIS_CMD_INLINE},
-    {"renamenx", RenamenxCommand, 3, CUTIS_CMD_INLINE},
-    {"randomkey", RandomKeyCommand, 1, CUTIS_CMD_INLINE},
-    {"keys", KeysCommand, 2, CUTIS_CMD_INLINE},
-    {"dbsize", DbsizeCommand, 1, CUTIS_CMD_INLINE},
-    {"save", SaveCommand, 1, CUTIS_CMD_INLINE},
-    {"bgsave", BgsaveCommand, 1, CUTIS_CMD_INLINE},
-    {"shutdown", ShutDownCommand, 1, CUTIS_CMD_INLINE},
-    {"ping", PingCommand, 1, CUTIS_CMD_INLINE},
-    {"echo", EchoCommand, 2, CUTIS_CMD_INLINE},
-    {"lastsave", LastSaveCommand, 1, CUTIS_CMD_INLINE},
-    {"type", TypeCommand, 2, CUTIS_CMD_INLINE},
-    {NULL, NULL, 0, 0},
+    {"get", GetCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"set", SetCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM, 1, 1, 1},
+    {"setnx", SetnxCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"setex", SetexCommand, 4, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM, 1, 1, 1},
+    {"mget", MGetCommand, -2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, -1, 1},
+    {"mset", MSetCommand, -3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM, 1, -1, 2},
+    {"msetnx", MSetnxCommand, -3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM, 1, -1, 2},
+    {"exists", ExistsCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"del", DelCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE, 1, 1, 1},
+    {"incr", IncrCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"decr", DecrCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"incrby", IncrByCommand, 3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"decrby", DecrByCommand, 3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"rpush", RPushCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"lpush", LPushCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"rpop", RPopCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 1, 1},
+    {"lpop", LPopCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 1, 1},
+    {"llen", LLenCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"lindex", LIndexCommand, 3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, 1, 1},
+    {"lrange", LRangeCommand, 4, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, 1, 1},
+    {"ltrim", LTrimCommand, 4, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE, 1, 1, 1},
+    {"lset", LSetCommand, 4, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM, 1, 1, 1},
+    {"sadd", SAddCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"srem", SRemCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 1, 1},
+    {"sismember", SIsMemberCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"scard", SCardCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"sinter", SInterCommand, -2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, -1, 1},
+    {"sintercard", SInterCardCommand, -3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_MOVABLE_KEYS, 2, 2, 1},
+    {"sinterstore", SInterStoreCommand, -3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM, 1, -1, 1},
+    {"sunion", SUnionCommand, -2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, -1, 1},
+    {"sunionstore", SUnionStoreCommand, -3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM, 1, -1, 1},
+    {"sdiff", SDiffCommand, -2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, -1, 1},
+    {"sdiffstore", SDiffStoreCommand, -3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM, 1, -1, 1},
+    {"smembers", SInterCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, 1, 1},
+    {"zadd", ZAddCommand, 4, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"zincrby", ZIncrByCommand, 4, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"zrem", ZRemCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 1, 1},
+    {"zcard", ZCardCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"zscore", ZScoreCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"zrank", ZRankCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"zrevrank", ZRevRankCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"zrange", ZRangeCommand, -4, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, 1, 1},
+    {"zrevrange", ZRevRangeCommand, -4, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, 1, 1},
+    {"zrangebyscore", ZRangeByScoreCommand, -4, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, 1, 1},
+    {"hset", HSetCommand, -4, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"hget", HGetCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"hmget", HMGetCommand, -3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"hgetall", HGetAllCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 1, 1, 1},
+    {"hdel", HDelCommand, 3, CUTIS_CMD_BULK,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 1, 1},
+    {"hlen", HLenCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"hincrby", HIncrByCommand, 4, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_DENYOOM | CUTIS_CMD_FAST, 1, 1, 1},
+    {"select", SelectCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_FAST, 0, 0, 0},
+    {"move", MoveCommand, 3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 1, 1},
+    {"rename", RenameCommand, 3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE, 1, 2, 1},
+    {"renamenx", RenamenxCommand, 3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 2, 1},
+    {"randomkey", RandomKeyCommand, 1, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 0, 0, 0},
+    {"keys", KeysCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 0, 0, 0},
+    {"scan", ScanCommand, -2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY, 0, 0, 0},
+    {"expire", ExpireCommand, 3, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 1, 1},
+    {"ttl", TtlCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"persist", PersistCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_WRITE | CUTIS_CMD_FAST, 1, 1, 1},
+    {"dbsize", DbsizeCommand, 1, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 0, 0, 0},
+    {"save", SaveCommand, 1, CUTIS_CMD_INLINE,
+     0, 0, 0, 0},
+    {"bgsave", BgsaveCommand, 1, CUTIS_CMD_INLINE,
+     0, 0, 0, 0},
+    {"shutdown", ShutDownCommand, 1, CUTIS_CMD_INLINE,
+     0, 0, 0, 0},
+    {"ping", PingCommand, 1, CUTIS_CMD_INLINE,
+     CUTIS_CMD_FAST, 0, 0, 0},
+    {"echo", EchoCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_FAST, 0, 0, 0},
+    {"lastsave", LastSaveCommand, 1, CUTIS_CMD_INLINE,
+     CUTIS_CMD_FAST, 0, 0, 0},
+    {"type", TypeCommand, 2, CUTIS_CMD_INLINE,
+     CUTIS_CMD_READONLY | CUTIS_CMD_FAST, 1, 1, 1},
+    {"info", InfoCommand, 1, CUTIS_CMD_INLINE,
+     0, 0, 0, 0},
+    {NULL, NULL, 0, 0, 0, 0, 0, 0},
 };
 
+static unsigned int CommandTableHashFunction(const void *key) {
+  return DictGenCaseHashFunction(key, sdslen((sds)key));
+}
+
+static int CommandTableKeyCompare(void *priv_data, const void *key1,
+                                  const void *key2) {
+  return sdslen((sds)key1) == sdslen((sds)key2) &&
+         strncasecmp(key1, key2, sdslen((sds)key1)) == 0;
+}
+
+// Command names are looked up case-insensitively, without touching argv.
+static DictType CommandTableDictType = {
+    CommandTableHashFunction,  // hash function
+    NULL,                      // key dup
+    NULL,                      // val dup
+    CommandTableKeyCompare,    // key compare
+    sdsDictKeyDestructor,      // key destructor
+    NULL,                      // val destructor
+};
+
+
 int ProcessCommand(CutisClient *c) {
-  sdstolower(c->argv[0]);
-  if (!strcmp(c->argv[0], "quit")) {
+  if (!strcasecmp(c->argv[0], "quit")) {
     FreeClient(c);
     return 0;
   }
@@ -87,7 +219,10 @@ int ProcessCommand(CutisClient *c) {
     AddReplySds(c, sdsnew("-ERR wrong number of arguments\r\n"));
     ResetClient(c);
     return 1;
-  } else if (cmd->type == CUTIS_CMD_BULK && c->bulk_len == -1) {
+  } else if (cmd->type == CUTIS_CMD_BULK && c->bulk_len == -1 &&
+             c->req_type == CUTIS_REQ_INLINE) {
+    // Inline bulk commands send the value after the command line, the
+    // last argument is its length. Multi bulk requests carry the value.
     int bulk_len = atoi(c->argv[c->argc-1]);
     sdsfree(c->argv[c->argc-1]);
 
@@ -102,15 +237,19 @@ int ProcessCommand(CutisClient *c) {
     c->argv[c->argc-1] = NULL;
     c->argc--;
     c->bulk_len = bulk_len + 2; // Add two bytes for CRLF
-    /* It is possible that the bulk read is already in the
-     * buffer. Check this condition and handle it accordingly. */
-    if (sdslen(c->query_buf) >= c->bulk_len) {
-      c->argv[c->argc] = sdsnewlen(c->query_buf, c->bulk_len-2);
-      c->argc++;
-      c->query_buf = sdsrange(c->query_buf, c->bulk_len, -1);
-    } else {
-      return 1;
-    }
+    // The bulk data is read by ParseBulkQuery(), it may be already in
+    // the query buffer.
+    return 1;
+  }
+
+  // Evict keys if needed, and refuse the commands that may use more memory
+  // when nothing can be evicted.
+  if (c->server->maxmemory && FreeMemoryIfNeeded(c->server) == CUTIS_ERR &&
+      (cmd->flags & CUTIS_CMD_DENYOOM)) {
+    AddReplySds(c, sdsnew("-ERR command not allowed when used memory > "
+                          "'maxmemory'\r\n"));
+    ResetClient(c);
+    return 1;
   }
 
   // Exec cmd command.
@@ -119,40 +258,64 @@ int ProcessCommand(CutisClient *c) {
   return 1;
 }
 
-CutisCommand *LookupCommand(char *name) {
-  int i = 0;
-  while (cmdTable[i].name != NULL) {
-    if (!strcmp(cmdTable[i].name, name)) {
-      return &cmdTable[i];
+// Load the command table in a dict, called once at startup.
+Dict *CreateCommandTable() {
+  Dict *commands = DictCreate(&CommandTableDictType, NULL);
+  int i;
+
+  if (commands == NULL) {
+    return NULL;
+  }
+  for (i = 0; cmdTable[i].name != NULL; i++) {
+    if (DictAdd(commands, sdsnew(cmdTable[i].name), &cmdTable[i]) != DICT_OK) {
+      DictRelease(commands);
+      return NULL;
     }
-    i++;
   }
-  return NULL;
+  return commands;
+}
+
+CutisCommand *LookupCommand(sds name) {
+  DictEntry *de = DictFind(GetSingletonServer()->commands, name);
+  return de ? DictGetEntryVal(de) : NULL;
 }
 
 // Command implementations.
-static void SetGenericCommand(CutisClient *c, int nx) {
+// Set the key to the value argv[val_idx]. With seconds > 0 the key expires
+// after that many seconds, otherwise a previous timeout is discarded.
+static void SetGenericCommand(CutisClient *c, int nx, int val_idx,
+                              long long seconds) {
+  sds key = c->argv[1];
   int ret;
-  CutisObject *o = CreateCutisObject(CUTIS_STRING, c->argv[2]);
-  c->argv[2] = NULL;
-  ret = DictAdd(c->dict, c->argv[1], o);
+  CutisObject *o = CreateCutisObject(CUTIS_STRING, c->argv[val_idx]);
+  c->argv[val_idx] = NULL;
+  o = TryObjectEncoding(o);
+  if (nx) {
+    ExpireIfNeeded(c->db, key);
+  }
+  ret = DictAdd(c->db->dict, key, o);
   if (ret == DICT_ERR) {
     if (!nx) {
-      DictReplace(c->dict, c->argv[1], o);
+      DictReplace(c->db->dict, key, o);
+      RemoveExpire(c->db, key);
     } else {
       DecrRefCount(o);
+      seconds = 0;
     }
   } else {
     // Now the key is in the hash entry, don't free it.
     c->argv[1] = NULL;
   }
+  if (seconds > 0) {
+    SetExpire(c->db, key, time(NULL) + seconds);
+  }
 
   c->server->dirty++;
   AddReply(c, shared.ok);
 }
 
 void GetCommand(CutisClient *c) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
   if (de == NULL) {
     AddReply(c, shared.nil);
   } else {
@@ -162,23 +325,119 @@ void GetCommand(CutisClient *c) {
       AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
                   -((int)strlen(err)), err));
     } else {
-      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n", (int)sdslen(o->ptr)));
-      AddReply(c, o);
-      AddReply(c, shared.crlf);
+      AddReplyBulk(c, o);
     }
   }
 }
 
 void SetCommand(CutisClient *c) {
-  return SetGenericCommand(c, 0);
+  SetGenericCommand(c, 0, 2, 0);
 }
 
 void SetnxCommand(CutisClient *c) {
-  return SetGenericCommand(c, 1);
+  SetGenericCommand(c, 1, 2, 0);
+}
+
+void SetexCommand(CutisClient *c) {
+  long long seconds;
+
+  if (!StringToLongLong(c->argv[2], sdslen(c->argv[2]), &seconds) ||
+      seconds <= 0) {
+    AddReplySds(c, sdsnew("-ERR invalid expire time\r\n"));
+    return;
+  }
+  SetGenericCommand(c, 0, 3, seconds);
+}
+
+// Hash the keys argv[first], argv[first+step], ... and prefetch their
+// buckets, then the first entry of every bucket, so the cache misses of a
+// batch overlap instead of being paid one key at a time. Returns the
+// hashes in key order, to be freed with zfree().
+static unsigned int *PrefetchKeys(CutisClient *c, int first, int step) {
+  Dict *d = c->db->dict;
+  int numkeys = (c->argc - first + step - 1) / step;
+  unsigned int *hashes = zmalloc(sizeof(unsigned int) * numkeys);
+  int j;
+
+  if (!hashes) {
+    CutisOom("PrefetchKeys");
+  }
+  for (j = 0; j < numkeys; j++) {
+    hashes[j] = DictHashKey(d, c->argv[first + j * step]);
+    DictPrefetchBucket(d, hashes[j]);
+  }
+  for (j = 0; j < numkeys; j++) {
+    DictPrefetchEntry(d, hashes[j]);
+  }
+  return hashes;
+}
+
+void MGetCommand(CutisClient *c) {
+  unsigned int *hashes = PrefetchKeys(c, 1, 1);
+  int j;
+
+  AddReplyLongLong(c, c->argc - 1);
+  for (j = 1; j < c->argc; j++) {
+    DictEntry *de = LookupKeyWithHash(c->db, c->argv[j], hashes[j-1]);
+    CutisObject *o = de ? DictGetEntryVal(de) : NULL;
+
+    if (!o || o->type != CUTIS_STRING) {
+      AddReply(c, shared.nil);
+    } else {
+      AddReplyBulk(c, o);
+    }
+  }
+  zfree(hashes);
+}
+
+// With nx nothing is set if any of the keys exists, so MSETNX sets all the
+// keys or none.
+static void MSetGenericCommand(CutisClient *c, int nx) {
+  unsigned int *hashes;
+  int j;
+
+  if (c->argc % 2 == 0) {
+    AddReplySds(c, sdsnew("-ERR wrong number of arguments for MSET\r\n"));
+    return;
+  }
+  hashes = PrefetchKeys(c, 1, 2);
+  if (nx) {
+    for (j = 1; j < c->argc; j += 2) {
+      if (LookupKeyWithHash(c->db, c->argv[j], hashes[j/2])) {
+        zfree(hashes);
+        AddReply(c, shared.zero);
+        return;
+      }
+    }
+  }
+  for (j = 1; j < c->argc; j += 2) {
+    CutisObject *o = CreateCutisObject(CUTIS_STRING, c->argv[j+1]);
+
+    c->argv[j+1] = NULL;
+    o = TryObjectEncoding(o);
+    if (DictAdd(c->db->dict, c->argv[j], o) == DICT_ERR) {
+      DictReplace(c->db->dict, c->argv[j], o);
+      RemoveExpire(c->db, c->argv[j]);
+    } else {
+      // Now the key is in the hash entry, don't free it.
+      c->argv[j] = NULL;
+    }
+  }
+  zfree(hashes);
+  c->server->dirty += (c->argc - 1) / 2;
+  AddReply(c, nx ? shared.one : shared.ok);
+}
+
+void MSetCommand(CutisClient *c) {
+  MSetGenericCommand(c, 0);
+}
+
+void MSetnxCommand(CutisClient *c) {
+  MSetGenericCommand(c, 1);
 }
 
 void ExistsCommand(CutisClient *c) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
   if (de == NULL) {
     AddReply(c, shared.zero);
   } else {
@@ -187,44 +446,49 @@ void ExistsCommand(CutisClient *c) {
 }
 
 void DelCommand(CutisClient *c) {
-  if (DictDelete(c->dict, c->argv[1]) == DICT_OK) {
+  if (DeleteKey(c->db, c->argv[1])) {
     c->server->dirty++;
   }
   AddReply(c, shared.ok);
 }
 
-static void IncrDecrCommand(CutisClient *c, int incr) {
-  int retval;
-  sds newval;
-  CutisObject *o;
-  long long value;
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
-  if (de == NULL) {
-    value = 0;
-  } else {
+// Counters are kept integer encoded and updated in place, so an increment
+// allocates nothing once the key holds an integer.
+static void IncrDecrCommand(CutisClient *c, long long incr) {
+  CutisObject *o = NULL;
+  long long value = 0;
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+
+  if (de != NULL) {
     o = DictGetEntryVal(de);
-    if (o->type != CUTIS_STRING) {
-      value = 0;
-    } else {
-      char *end;
-      value = strtoll(o->ptr, &end, 10);
+    if (o->type == CUTIS_STRING) {
+      value = GetLongLongFromStringObject(o);
     }
   }
 
+  if ((incr < 0 && value < 0 && incr < LLONG_MIN - value) ||
+      (incr > 0 && value > 0 && incr > LLONG_MAX - value)) {
+    AddReplySds(c, sdsnew("-ERR increment or decrement would overflow\r\n"));
+    return;
+  }
   value += incr;
-  newval = sdscatprintf(sdsempty(), "%lld", value);
-  o = CreateCutisObject(CUTIS_STRING, newval);
-  retval = DictAdd(c->dict, c->argv[1], o);
-  if (retval == DICT_ERR) {
-    DictReplace(c->dict, c->argv[1], o);
+
+  if (o != NULL && o->type == CUTIS_STRING &&
+      o->encoding == CUTIS_ENCODING_INT && o->refcount == 1 &&
+      value >= LONG_MIN && value <= LONG_MAX) {
+    o->ptr = (void*)(long)value;
   } else {
-    // Now the key is in the hash entry, don't free it
-    c->argv[1] = NULL;
+    o = CreateStringObjectFromLongLong(value);
+    if (DictAdd(c->db->dict, c->argv[1], o) == DICT_ERR) {
+      DictReplace(c->db->dict, c->argv[1], o);
+    } else {
+      // Now the key is in the hash entry, don't free it
+      c->argv[1] = NULL;
+    }
   }
 
   c->server->dirty++;
-  AddReply(c, o);
-  AddReply(c, shared.crlf);
+  AddReplyLongLong(c, value);
 }
 
 void IncrCommand(CutisClient *c) {
@@ -235,59 +499,70 @@ void DecrCommand(CutisClient *c) {
   IncrDecrCommand(c, -1);
 }
 
+static void IncrDecrByCommand(CutisClient *c, int sign) {
+  long long incr;
+
+  if (!StringToLongLong(c->argv[2], sdslen(c->argv[2]), &incr) ||
+      (sign < 0 && incr == LLONG_MIN)) {
+    AddReplySds(c, sdsnew("-ERR value is not an integer or out of range\r\n"));
+    return;
+  }
+  IncrDecrCommand(c, sign * incr);
+}
+
+void IncrByCommand(CutisClient *c) {
+  IncrDecrByCommand(c, 1);
+}
+
+void DecrByCommand(CutisClient *c) {
+  IncrDecrByCommand(c, -1);
+}
+
 void RandomKeyCommand(CutisClient *c) {
-  DictEntry *de = DictGetRandomKey(c->dict);
+  DictEntry *de;
+
+  // Expired keys found on the way are deleted.
+  while ((de = DictGetRandomKey(c->db->dict)) != NULL &&
+         ExpireIfNeeded(c->db, DictGetEntryKey(de))) {
+  }
   if (de == NULL) {
     AddReply(c, shared.crlf);
   } else {
-    AddReplySds(c, sdsdup(DictGetEntryKey(de)));
+    sds key = DictGetEntryKey(de);
+    AddReplyString(c, key, sdslen(key));
     AddReply(c, shared.crlf);
   }
 }
 
+// Reply with a list element as a bulk.
+static void AddReplyListEntry(CutisClient *c, ListTypeEntry *entry) {
+  AddReplyLongLong(c, entry->slen);
+  AddReplyString(c, (char *)entry->sval, entry->slen);
+  AddReply(c, shared.crlf);
+}
+
 static void PushGenericCommand(CutisClient *c, int where) {
    CutisObject *el = NULL, *o = NULL;
    DictEntry *de = NULL;
-   List *l = NULL;
-
-   el = CreateCutisObject(CUTIS_STRING, c->argv[2]);
-   c->argv[2] = NULL;
 
-   de = DictFind(c->dict, c->argv[1]);
+   de = LookupKey(c->db, c->argv[1]);
    if (!de) {
      o = CreateListObject();
-     l = o->ptr;
-     if (where == CUTIS_HEAD) {
-       if (!listAddNodeHead(l, el)) {
-         CutisOom("listAddNodeHead");
-       }
-     } else {
-       if (!listAddNodeTail(l, el)) {
-         CutisOom("listAddNodeTail");
-       }
-     }
-     DictAdd(c->dict, c->argv[1], o);
+     DictAdd(c->db->dict, c->argv[1], o);
      // Now the key is in the hash entry, don't free it.
      c->argv[1] = NULL;
    } else {
      o = DictGetEntryVal(de);
      if (o->type != CUTIS_LIST) {
-       DecrRefCount(el);
        char *err = "-ERR push against existing key not holding a list \r\n";
        AddReplySds(c, sdsnew(err));
        return;
      }
-     l = o->ptr;
-     if (where == CUTIS_HEAD) {
-       if (!listAddNodeHead(l, el)) {
-         CutisOom("listAddNodeHead");
-       }
-     } else {
-       if (!listAddNodeTail(l, el)) {
-         CutisOom("listAddNodeTail");
-       }
-     }
    }
+   el = CreateCutisObject(CUTIS_STRING, c->argv[2]);
+   c->argv[2] = NULL;
+   ListTypePush(o, el, where);
+   DecrRefCount(el);
    c->server->dirty++;
    AddReply(c, shared.ok);
 }
@@ -301,7 +576,7 @@ void LPushCommand(CutisClient *c) {
 }
 
 static void PopGenericCommand(CutisClient *c, int where) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
   if (!de) {
     AddReply(c, shared.nil);
   } else {
@@ -311,23 +586,13 @@ static void PopGenericCommand(CutisClient *c, int where) {
       AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
                                   -(int)strlen(err), err));
     } else {
-      List *l = o->ptr;
-      ListNode *ln;
+      CutisObject *el = ListTypePop(o, where);
 
-      if (where == CUTIS_HEAD) {
-        ln = listFirst(l);
-      } else {
-        ln = listLast(l);
-      }
-
-      if (ln == NULL) {
+      if (el == NULL) {
         AddReply(c, shared.nil);
       } else {
-        CutisObject *el = listNodeValue(ln);
-        AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n", sdslen(el->ptr)));
-        AddReply(c, el);
-        AddReply(c, shared.crlf);
-        listDelNode(l, ln);
+        AddReplyBulk(c, el);
+        DecrRefCount(el);
         c->server->dirty++;
       }
     }
@@ -343,8 +608,7 @@ void LPopCommand(CutisClient *c) {
 }
 
 void LLenCommand(CutisClient *c) {
-  List *l;
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
   if (!de) {
     AddReply(c, shared.zero);
     return;
@@ -353,14 +617,13 @@ void LLenCommand(CutisClient *c) {
     if (o->type != CUTIS_LIST) {
       AddReplySds(c, sdsnew("-1\r\n"));
     } else {
-      l = o->ptr;
-      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n", listLength(l)));
+      AddReplyLongLong(c, ListTypeLength(o));
     }
   }
 }
 
 void LIndexCommand(CutisClient *c) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
   int index = atoi(c->argv[2]);
 
   if (!de) {
@@ -372,22 +635,21 @@ void LIndexCommand(CutisClient *c) {
       AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
                                   -(int)strlen(err), err));
     } else {
-      List *l = o->ptr;
-      ListNode *ln = listIndex(l, index);
-      if (!ln) {
+      ListTypeIterator li;
+      ListTypeEntry entry;
+
+      ListTypeInitIterator(&li, o, index, CUTIS_TAIL);
+      if (!ListTypeNext(&li, &entry)) {
         AddReply(c, shared.nil);
       } else {
-        CutisObject *el = listNodeValue(ln);
-        AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n", sdslen(el->ptr)));
-        AddReply(c, el);
-        AddReply(c, shared.crlf);
+        AddReplyListEntry(c, &entry);
       }
     }
   }
 }
 
 void LRangeCommand(CutisClient *c) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
   int start = atoi(c->argv[2]);
   int end = atoi(c->argv[3]);
 
@@ -400,9 +662,9 @@ void LRangeCommand(CutisClient *c) {
       AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
                                   -(int)strlen(err), err));
     } else {
-      List *l = o->ptr;
-      ListNode *ln = NULL;
-      int llen = listLength(l);
+      ListTypeIterator li;
+      ListTypeEntry entry;
+      int llen = ListTypeLength(o);
       int range_len;
       int j;
 
@@ -433,21 +695,18 @@ void LRangeCommand(CutisClient *c) {
       range_len = (end - start) + 1;
 
       // Return the result in form of a multi-bulk reply
-      ln = listIndex(l, start);
-      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n", range_len));
+      ListTypeInitIterator(&li, o, start, CUTIS_TAIL);
+      AddReplyLongLong(c, range_len);
       for (j = 0; j < range_len; j++) {
-        CutisObject *el = listNodeValue(ln);
-        AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n", sdslen(el->ptr)));
-        AddReply(c, el);
-        AddReply(c, shared.crlf);
-        ln = ln->next;
+        ListTypeNext(&li, &entry);
+        AddReplyListEntry(c, &entry);
       }
     }
   }
 }
 
 void LTrimCommand(CutisClient *c) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
   int start = atoi(c->argv[2]);
   int end = atoi(c->argv[3]);
 
@@ -459,10 +718,7 @@ void LTrimCommand(CutisClient *c) {
       char *err = "-ERR LTRIM against key not holding a list value\r\n";
       AddReplySds(c, sdsnew(err));
     } else {
-      List *l = o->ptr;
-      ListNode *ln = NULL;
-      int llen = listLength(l);
-      int j;
+      int llen = ListTypeLength(o);
       int ltrim, rtrim;
 
       // convert negative indexes
@@ -493,14 +749,7 @@ void LTrimCommand(CutisClient *c) {
       }
 
       // Remove list elements to perform the trim.
-      for (j = 0; j < ltrim; j++) {
-        ln = listFirst(l);
-        listDelNode(l, ln);
-      }
-      for (j = 0; j < rtrim; j++) {
-        ln = listLast(l);
-        listDelNode(l, ln);
-      }
+      ListTypeTrim(o, ltrim, rtrim);
       AddReply(c, shared.ok);
       c->server->dirty++;
     }
@@ -509,7 +758,7 @@ void LTrimCommand(CutisClient *c) {
 
 void LSetCommand(CutisClient *c) {
   int index = atoi(c->argv[2]);
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
 
   if (!de) {
     AddReplySds(c, sdsnew("-ERR no such key\r\n"));
@@ -519,30 +768,27 @@ void LSetCommand(CutisClient *c) {
       const char *err = "-ERR LSET against key not holding a list value\r\n";
       AddReplySds(c, sdsnew(err));
     } else {
-      List *l = o->ptr;
-      ListNode *ln = listIndex(l, index);
+      CutisObject *el = CreateCutisObject(CUTIS_STRING, c->argv[3]);
 
-      if (!ln) {
+      c->argv[3] = NULL;
+      if (!ListTypeReplace(o, index, el)) {
         AddReplySds(c, sdsnew("-ERR index out of range\r\n"));
       } else {
-        CutisObject *el = listNodeValue(ln);
-        DecrRefCount(el);
-        listNodeValue(ln) = CreateCutisObject(CUTIS_STRING, c->argv[3]);
-        c->argv[3] = NULL;
         AddReply(c, shared.ok);
         c->server->dirty++;
       }
+      DecrRefCount(el);
     }
   }
 }
 
 void SAddCommand(CutisClient *c) {
-  CutisObject *el, *set;
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  CutisObject *set;
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
 
   if (!de) {
-    set = CreateSetObject();
-    DictAdd(c->dict, c->argv[1], set);
+    set = SetTypeCreate(c->argv[2]);
+    DictAdd(c->db->dict, c->argv[1], set);
     c->argv[1] = NULL;
   } else {
     set = DictGetEntryVal(de);
@@ -552,63 +798,53 @@ void SAddCommand(CutisClient *c) {
       return;
     }
   }
-  el = CreateCutisObject(CUTIS_STRING, c->argv[2]);
-  if (DictAdd(set->ptr, el, NULL) == DICT_OK) {
+  if (SetTypeAdd(set, c->argv[2])) {
     c->server->dirty++;
-  } else {
-    DecrRefCount(el);
   }
-  c->argv[2] = NULL;
   AddReply(c, shared.ok);
 }
 
 void SRemCommand(CutisClient *c) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
   if (!de) {
     AddReplySds(c, sdsnew("-ERR no such key\r\n"));
   } else {
-    CutisObject *set, *el;
+    CutisObject *set;
     set = DictGetEntryVal(de);
     if (set->type != CUTIS_SET) {
       char *err = "-ERR SREM against key not holding a set value\r\n";
       AddReplySds(c, sdsnew(err));
       return;
     }
-    el = CreateCutisObject(CUTIS_STRING, c->argv[2]);
-    if (DictDelete(set->ptr, el) == DICT_OK) {
+    if (SetTypeRemove(set, c->argv[2])) {
       c->server->dirty++;
     }
-    el->ptr = NULL;
-    DecrRefCount(el);
     AddReply(c, shared.ok);
   }
 }
 
 void SIsMemberCommand(CutisClient *c) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
 
   if (!de) {
     AddReplySds(c, sdsnew("-1\r\n"));
   } else {
-    CutisObject *set, *el;
+    CutisObject *set;
     set = DictGetEntryVal(de);
     if (set->type != CUTIS_SET) {
       AddReplySds(c, sdsnew("-1\r\n"));
       return;
     }
-    el = CreateCutisObject(CUTIS_STRING, c->argv[2]);
-    if (DictFind(set->ptr, el)) {
+    if (SetTypeIsMember(set, c->argv[2])) {
       AddReply(c, shared.one);
     } else {
       AddReply(c, shared.zero);
     }
-    el->ptr = NULL;
-    DecrRefCount(el);
   }
 }
 
 void SCardCommand(CutisClient *c) {
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
 
   if (!de) {
     AddReply(c, shared.zero);
@@ -618,207 +854,1021 @@ void SCardCommand(CutisClient *c) {
     if (set->type != CUTIS_SET) {
       AddReplySds(c, sdsnew("-1\r\n"));
     } else {
-      Dict *d = set->ptr;
-      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n",
-                                  DictGetHashTableUsed(d)));
+      AddReplyLongLong(c, SetTypeSize(set));
     }
   }
 }
 
+#define CUTIS_SET_UNION  0
+#define CUTIS_SET_DIFF   1
+
+static void AddReplySetEntry(CutisClient *c, SetTypeEntry *entry) {
+  AddReplyLongLong(c, entry->slen);
+  AddReplyString(c, entry->sval, entry->slen);
+  AddReply(c, shared.crlf);
+}
+
+// Sets are sorted by increasing cardinality, missing sets first.
 static int qsortCompareSetsByCardinality(const void *s1, const void *s2) {
-  Dict **d1 = (void*)s1, **d2 = (void*)s2;
-  return (int)DictGetHashTableUsed(*d1) - (int)DictGetHashTableUsed(*d2);
+  CutisObject **o1 = (void*)s1, **o2 = (void*)s2;
+  unsigned long c1 = *o1 ? SetTypeSize(*o1) : 0;
+  unsigned long c2 = *o2 ? SetTypeSize(*o2) : 0;
+  return (c1 > c2) - (c1 < c2);
 }
 
-void SInterCommand(CutisClient *c) {
-  Dict **dv = zmalloc(sizeof(Dict*) * (c->argc - 1));
-  DictIterator *di;
-  DictEntry *de;
-  CutisObject *lenobj;
-  int j, cardinality = 0;
+static int qsortCompareSetsByRevCardinality(const void *s1, const void *s2) {
+  return qsortCompareSetsByCardinality(s2, s1);
+}
+
+// Look up the sets stored at keys, missing keys are NULL. If a key holds
+// another type an error is replied and NULL returned: a status reply for
+// commands storing their result, a multi-bulk error for the others.
+static CutisObject **LookupSets(CutisClient *c, sds *keys, int setnum,
+                                int store, const char *name) {
+  CutisObject **dv = zmalloc(sizeof(CutisObject*) * setnum);
+  int j;
 
   if (!dv) {
-    CutisOom("sinterCommand");
+    CutisOom("LookupSets");
   }
-
-  for (j = 0; j < c->argc - 1; j++) {
-    CutisObject *set;
-    DictEntry *de;
-    de = DictFind(c->dict, c->argv[j+1]);
-    if (!de) {
-      char *err = "No such key";
+  for (j = 0; j < setnum; j++) {
+    DictEntry *de = LookupKey(c->db, keys[j]);
+
+    dv[j] = de ? DictGetEntryVal(de) : NULL;
+    if (dv[j] && dv[j]->type != CUTIS_SET) {
+      if (store) {
+        AddReplySds(c, sdscatprintf(sdsempty(), "-ERR %s against key not "
+                                    "holding a set value\r\n", name));
+      } else {
+        sds err = sdscatprintf(sdsempty(), "%s against key not holding a "
+                               "set value", name);
+        AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                    -(int)sdslen(err), err));
+        sdsfree(err);
+      }
       zfree(dv);
-      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
-                                  -(int)strlen(err), err));
-      return;
+      return NULL;
     }
-    set = DictGetEntryVal(de);
-    if (set->type != CUTIS_SET) {
-      char *err = "SINTER against key not holding a set value";
-      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%d\r\n",
-                                  -(int)strlen(err), err));
+  }
+  return dv;
+}
+
+// Store the set result at the key argv[1], replacing its value and
+// timeout, and reply the cardinality. An empty result deletes the key.
+static void StoreSetResult(CutisClient *c, CutisObject *result) {
+  unsigned long size = SetTypeSize(result);
+
+  DeleteKey(c->db, c->argv[1]);
+  if (size > 0) {
+    DictAdd(c->db->dict, c->argv[1], result);
+    // Now the key is in the hash entry, don't free it.
+    c->argv[1] = NULL;
+  } else {
+    DecrRefCount(result);
+  }
+  c->server->dirty++;
+  AddReplyLongLong(c, size);
+}
+
+static void SInterGenericCommand(CutisClient *c, sds *keys, int setnum,
+                                 int store) {
+  CutisObject **dv;
+  CutisObject *result = NULL, *lenobj = NULL;
+  SetTypeIterator si;
+  SetTypeEntry entry;
+  sds member;
+  int j, cardinality = 0;
+
+  dv = LookupSets(c, keys, setnum, store, store ? "SINTERSTORE" : "SINTER");
+  if (!dv) {
+    return;
+  }
+  for (j = 0; j < setnum; j++) {
+    if (!dv[j]) {
       zfree(dv);
+      if (store) {
+        // The intersection with a missing set is empty.
+        StoreSetResult(c, CreateIntsetObject());
+      } else {
+        char *err = "No such key";
+        AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                    -(int)strlen(err), err));
+      }
+      return;
     }
-    dv[j] = set->ptr;
   }
 
   // Sort sets from the smallest to largest, this will improve our
   // algorithm's performance.
-  qsort(dv, c->argc-1, sizeof(Dict*), qsortCompareSetsByCardinality);
+  qsort(dv, setnum, sizeof(CutisObject*), qsortCompareSetsByCardinality);
 
   // The first thing we should output is the total number of elements.
   // Since this is a multi-bulk write, but at this stage we don't know
   // the intersection set size, so we use a trick, append an empty
   // object to the output list and save the pointer to later modify
-  // it with the right length.
-  lenobj = CreateCutisObject(CUTIS_STRING, NULL);
-  AddReply(c, lenobj);
-  DecrRefCount(lenobj);
+  // it with the right length. Storing commands build the result set.
+  if (store) {
+    result = CreateIntsetObject();
+  } else {
+    lenobj = AddReplyDeferredLen(c);
+  }
 
   // Iterate all the elements of the first (smallest) set, and test
   // the element against all the other sets, if at least one set does
-  // not include the element it is discarded.
-  di = DictGetIterator(dv[0]);
-  if (!di) {
-    CutisOom("DictGetIterator");
-  }
-
-  while ((de = DictNext(di)) != NULL) {
-    CutisObject *el;
-    for (j = 1; j < c->argc - 1; j++) {
-      if (DictFind(dv[j], DictGetEntryKey(de)) == NULL) {
+  // not include the element it is discarded. Members are copied in an
+  // sds to be looked up in sets of any encoding.
+  member = sdsempty();
+  SetTypeInitIterator(&si, dv[0]);
+  while (SetTypeNext(&si, &entry)) {
+    member = sdscpylen(member, entry.sval, entry.slen);
+    for (j = 1; j < setnum; j++) {
+      if (!SetTypeIsMember(dv[j], member)) {
         break;
       }
     }
-    if (j != c->argc - 1) {
+    if (j != setnum) {
       // At least one set don't contain the member.
       continue;
     }
-    el = DictGetEntryKey(de);
-    AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n", sdslen(el->ptr)));
-    AddReply(c, el);
-    AddReply(c, shared.crlf);
+    if (store) {
+      SetTypeAdd(result, member);
+    } else {
+      AddReplySetEntry(c, &entry);
+    }
     cardinality++;
   }
-  lenobj->ptr = sdscatprintf(sdsempty(), "%d\r\n", cardinality);
-  DictReleaseIterator(di);
+  SetTypeReleaseIterator(&si);
+  sdsfree(member);
   zfree(dv);
-}
-
-void TypeCommand(CutisClient *c) {
-  char *type;
-  DictEntry *de = DictFind(c->dict, c->argv[1]);
-  if (!de) {
-    type = "none";
+  if (store) {
+    StoreSetResult(c, result);
   } else {
-    CutisObject *o = DictGetEntryVal(de);
-    switch (o->type) {
-    case CUTIS_STRING:
-      type = "string";
-      break;
-    case CUTIS_LIST:
-      type = "list";
-      break;
-    case CUTIS_SET:
-      type = "set";
-      break;
-    default:
-      type = "unknown";
-      break;
-    }
+    SetDeferredReplyLen(c, lenobj, cardinality);
   }
-  AddReplySds(c, sdsnew(type));
-  AddReply(c, shared.crlf);
 }
 
-void SelectCommand(CutisClient *c) {
-  int id = atoi(c->argv[1]);
-  if (SelectDB(c, id) == CUTIS_ERR) {
-    AddReplySds(c, sdsnew("-ERR invalid DB index\r\n"));
-  } else {
-    AddReply(c, shared.ok);
-  }
+void SInterCommand(CutisClient *c) {
+  SInterGenericCommand(c, c->argv + 1, c->argc - 1, 0);
 }
 
-void MoveCommand(CutisClient *c) {
-  Dict *src, *dst;
-  DictEntry *de;
-  sds key;
-  CutisObject *o;
+void SInterStoreCommand(CutisClient *c) {
+  SInterGenericCommand(c, c->argv + 2, c->argc - 2, 1);
+}
 
-  // Obtain source and target DB pointers.
-  src = c->dict;
-  if (SelectDB(c, atoi(c->argv[2])) == CUTIS_ERR) {
-    AddReplySds(c, sdsnew("-ERR target DB out of range\r\n"));
+// SINTERCARD numkeys key1 ... keyN [LIMIT limit]
+// Count the members of the intersection without replying them, stopping
+// once limit members were found.
+void SInterCardCommand(CutisClient *c) {
+  CutisObject **dv;
+  SetTypeIterator si;
+  SetTypeEntry entry;
+  long long numkeys, limit = 0;
+  unsigned long cardinality = 0;
+  sds member;
+  int j;
+
+  if (!StringToLongLong(c->argv[1], sdslen(c->argv[1]), &numkeys) ||
+      numkeys <= 0 || numkeys > c->argc - 2) {
+    AddReplySds(c, sdsnew("-ERR invalid number of keys\r\n"));
     return;
   }
-  dst = c->dict;
-  c->dict = src;
-
-  // If the user is moving using as target the same
-  // DB as the source DB it is probably an error.
-  if (src == dst) {
-    AddReplySds(c, sdsnew("-ERR source DB is the same as target DB\r\n"));
-    return;
+  for (j = 2 + numkeys; j < c->argc; j += 2) {
+    if (strcasecmp(c->argv[j], "limit") != 0 || j + 1 >= c->argc) {
+      AddReplySds(c, sdsnew("-ERR syntax error\r\n"));
+      return;
+    }
+    if (!StringToLongLong(c->argv[j+1], sdslen(c->argv[j+1]), &limit) ||
+        limit < 0) {
+      AddReplySds(c, sdsnew("-ERR LIMIT can't be negative\r\n"));
+      return;
+    }
   }
 
-  // Check if the element exists and get a reference.
-  de = DictFind(c->dict, c->argv[1]);
-  if (!de) {
-    AddReplySds(c, sdsnew("-ERR no such key\r\n"));
+  dv = LookupSets(c, c->argv + 2, numkeys, 1, "SINTERCARD");
+  if (!dv) {
     return;
   }
-
-  // Try to add the element to the target DB.
-  key = DictGetEntryKey(de);
-  o = DictGetEntryVal(de);
-  if (DictAdd(dst, key, o) == DICT_ERR) {
-    AddReplySds(c, sdsnew("-ERR target DB already contains the moved key\r\n"));
-    return;
+  for (j = 0; j < numkeys; j++) {
+    if (!dv[j]) {
+      // The intersection with a missing set is empty.
+      zfree(dv);
+      AddReply(c, shared.zero);
+      return;
+    }
   }
-
-  // OK. key moved, free the entry in the source DB.
-  DictDeleteNoFree(src, c->argv[1]);
-  c->server->dirty++;
-  AddReply(c, shared.ok);
+  qsort(dv, numkeys, sizeof(CutisObject*), qsortCompareSetsByCardinality);
+
+  member = sdsempty();
+  SetTypeInitIterator(&si, dv[0]);
+  while ((limit == 0 || cardinality < (unsigned long)limit) &&
+         SetTypeNext(&si, &entry)) {
+    member = sdscpylen(member, entry.sval, entry.slen);
+    for (j = 1; j < numkeys; j++) {
+      if (!SetTypeIsMember(dv[j], member)) {
+        break;
+      }
+    }
+    if (j == numkeys) {
+      cardinality++;
+    }
+  }
+  SetTypeReleaseIterator(&si);
+  sdsfree(member);
+  zfree(dv);
+  AddReplyLongLong(c, cardinality);
 }
 
-static void RenameGenericCommand(CutisClient *c, int nx) {
-  DictEntry *de;
-  CutisObject *o;
-
-  // To use the same key as src and dst is probably an error.
-  if (sdscmp(c->argv[1], c->argv[2]) == 0) {
-    AddReplySds(c, sdsnew("-ERR src and dest key are the same\r\n"));
-    return;
+static void SUnionDiffGenericCommand(CutisClient *c, sds *keys, int setnum,
+                                     int store, int op) {
+  CutisObject **dv;
+  CutisObject *result;
+  SetTypeIterator si;
+  SetTypeEntry entry;
+  sds member;
+  int j, k, diff_algo = 1;
+  const char *name;
+
+  if (op == CUTIS_SET_UNION) {
+    name = store ? "SUNIONSTORE" : "SUNION";
+  } else {
+    name = store ? "SDIFFSTORE" : "SDIFF";
   }
-
-  de = DictFind(c->dict, c->argv[1]);
-  if (!de) {
-    AddReplySds(c, sdsnew("-ERR no such key\r\n"));
+  dv = LookupSets(c, keys, setnum, store, name);
+  if (!dv) {
     return;
   }
 
-  o = DictGetEntryVal(de);
-  IncrRefCount(o);
-  if (DictAdd(c->dict, c->argv[2], o) == DICT_ERR) {
-    if (nx) {
-      DecrRefCount(o);
-      AddReplySds(c, sdsnew("-ERR destination key exists\r\n"));
-      return;
+  // The difference is computed either probing every member of the first
+  // set in the other sets, that is O(N*M) with N the size of the first
+  // set and M the number of sets, or adding the first set to the result
+  // and removing the members of the other sets, that is O(N) with N the
+  // total number of members. Probing stops at the first set holding the
+  // member, so it usually costs half the worst case; those sets are
+  // probed from the largest, that most likely holds the member.
+  if (op == CUTIS_SET_DIFF && dv[0]) {
+    unsigned long long algo_one_work = 0, algo_two_work = 0;
+
+    for (j = 0; j < setnum; j++) {
+      if (dv[j]) {
+        algo_one_work += SetTypeSize(dv[0]);
+        algo_two_work += SetTypeSize(dv[j]);
+      }
+    }
+    algo_one_work /= 2;
+    diff_algo = (algo_one_work <= algo_two_work) ? 1 : 2;
+    if (diff_algo == 1 && setnum > 1) {
+      qsort(dv + 1, setnum - 1, sizeof(CutisObject*),
+            qsortCompareSetsByRevCardinality);
     }
-    DictReplace(c->dict, c->argv[2], o);
-  } else {
-    c->argv[2] = NULL;
   }
-  DictDelete(c->dict, c->argv[1]);
-  c->server->dirty++;
-  AddReply(c, shared.ok);
-}
 
-void RenameCommand(CutisClient *c) {
-  RenameGenericCommand(c, 0);
-}
+  // Members are copied in an sds to be added to, removed from or looked
+  // up in sets of any encoding.
+  result = CreateIntsetObject();
+  member = sdsempty();
+  if (op == CUTIS_SET_UNION) {
+    for (j = 0; j < setnum; j++) {
+      if (!dv[j]) {
+        continue;
+      }
+      SetTypeInitIterator(&si, dv[j]);
+      while (SetTypeNext(&si, &entry)) {
+        member = sdscpylen(member, entry.sval, entry.slen);
+        SetTypeAdd(result, member);
+      }
+      SetTypeReleaseIterator(&si);
+    }
+  } else if (dv[0] && diff_algo == 1) {
+    SetTypeInitIterator(&si, dv[0]);
+    while (SetTypeNext(&si, &entry)) {
+      member = sdscpylen(member, entry.sval, entry.slen);
+      for (k = 1; k < setnum; k++) {
+        if (!dv[k]) {
+          continue;
+        }
+        if (dv[k] == dv[0] || SetTypeIsMember(dv[k], member)) {
+          break;
+        }
+      }
+      if (k == setnum) {
+        SetTypeAdd(result, member);
+      }
+    }
+    SetTypeReleaseIterator(&si);
+  } else if (dv[0]) {
+    for (j = 0; j < setnum; j++) {
+      if (!dv[j]) {
+        continue;
+      }
+      SetTypeInitIterator(&si, dv[j]);
+      while (SetTypeNext(&si, &entry)) {
+        member = sdscpylen(member, entry.sval, entry.slen);
+        if (j == 0) {
+          SetTypeAdd(result, member);
+        } else {
+          SetTypeRemove(result, member);
+        }
+      }
+      SetTypeReleaseIterator(&si);
+      // Nothing more to remove from an empty result.
+      if (SetTypeSize(result) == 0) {
+        break;
+      }
+    }
+  }
+  sdsfree(member);
+  zfree(dv);
+
+  if (store) {
+    StoreSetResult(c, result);
+    return;
+  }
+  AddReplyLongLong(c, SetTypeSize(result));
+  SetTypeInitIterator(&si, result);
+  while (SetTypeNext(&si, &entry)) {
+    AddReplySetEntry(c, &entry);
+  }
+  SetTypeReleaseIterator(&si);
+  DecrRefCount(result);
+}
+
+void SUnionCommand(CutisClient *c) {
+  SUnionDiffGenericCommand(c, c->argv + 1, c->argc - 1, 0, CUTIS_SET_UNION);
+}
+
+void SUnionStoreCommand(CutisClient *c) {
+  SUnionDiffGenericCommand(c, c->argv + 2, c->argc - 2, 1, CUTIS_SET_UNION);
+}
+
+void SDiffCommand(CutisClient *c) {
+  SUnionDiffGenericCommand(c, c->argv + 1, c->argc - 1, 0, CUTIS_SET_DIFF);
+}
+
+void SDiffStoreCommand(CutisClient *c) {
+  SUnionDiffGenericCommand(c, c->argv + 2, c->argc - 2, 1, CUTIS_SET_DIFF);
+}
+
+// Reply a score as a bulk, with enough digits to read it back exactly.
+static void AddReplyDouble(CutisClient *c, double d) {
+  char buf[128];
+  int len = snprintf(buf, sizeof(buf), "%.17g", d);
+
+  AddReplyLongLong(c, len);
+  AddReplyString(c, buf, len);
+  AddReply(c, shared.crlf);
+}
+
+static void AddReplyZsetNode(CutisClient *c, SkiplistNode *node,
+                             int withscores) {
+  AddReplyLongLong(c, sdslen(node->ele));
+  AddReplyString(c, node->ele, sdslen(node->ele));
+  AddReply(c, shared.crlf);
+  if (withscores) {
+    AddReplyDouble(c, node->score);
+  }
+}
+
+static void ZAddGenericCommand(CutisClient *c, int incr) {
+  CutisObject *zobj;
+  DictEntry *de;
+  double score, curscore;
+  int added;
+
+  if (!StringToDouble(c->argv[2], sdslen(c->argv[2]), &score)) {
+    if (incr) {
+      char *err = "ZINCRBY increment is not a valid float";
+      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                  -(int)strlen(err), err));
+    } else {
+      AddReplySds(c, sdsnew("-ERR score is not a valid float\r\n"));
+    }
+    return;
+  }
+  de = LookupKey(c->db, c->argv[1]);
+  if (!de) {
+    zobj = CreateZsetObject();
+    DictAdd(c->db->dict, c->argv[1], zobj);
+    c->argv[1] = NULL;
+  } else {
+    zobj = DictGetEntryVal(de);
+    if (zobj->type != CUTIS_ZSET) {
+      if (incr) {
+        char *err = "ZINCRBY against key not holding a sorted set value";
+        AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                    -(int)strlen(err), err));
+      } else {
+        char *err = "-ERR ZADD against key not holding a sorted set value\r\n";
+        AddReplySds(c, sdsnew(err));
+      }
+      return;
+    }
+  }
+  if (incr && ZsetTypeScore(zobj, c->argv[3], &curscore)) {
+    score += curscore;
+    if (isnan(score)) {
+      char *err = "ZINCRBY resulting score is not a number";
+      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                  -(int)strlen(err), err));
+      return;
+    }
+  }
+  added = ZsetTypeAdd(zobj, score, c->argv[3]);
+  c->server->dirty++;
+  if (incr) {
+    AddReplyDouble(c, score);
+  } else {
+    AddReply(c, added ? shared.one : shared.zero);
+  }
+}
+
+void ZAddCommand(CutisClient *c) {
+  ZAddGenericCommand(c, 0);
+}
+
+void ZIncrByCommand(CutisClient *c) {
+  ZAddGenericCommand(c, 1);
+}
+
+void ZRemCommand(CutisClient *c) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+
+  if (!de) {
+    AddReply(c, shared.zero);
+  } else {
+    CutisObject *zobj = DictGetEntryVal(de);
+    if (zobj->type != CUTIS_ZSET) {
+      char *err = "-ERR ZREM against key not holding a sorted set value\r\n";
+      AddReplySds(c, sdsnew(err));
+      return;
+    }
+    if (ZsetTypeRemove(zobj, c->argv[2])) {
+      if (ZsetTypeLength(zobj) == 0) {
+        DeleteKey(c->db, c->argv[1]);
+      }
+      c->server->dirty++;
+      AddReply(c, shared.one);
+    } else {
+      AddReply(c, shared.zero);
+    }
+  }
+}
+
+void ZCardCommand(CutisClient *c) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+
+  if (!de) {
+    AddReply(c, shared.zero);
+  } else {
+    CutisObject *zobj = DictGetEntryVal(de);
+    if (zobj->type != CUTIS_ZSET) {
+      AddReplySds(c, sdsnew("-1\r\n"));
+    } else {
+      AddReplyLongLong(c, ZsetTypeLength(zobj));
+    }
+  }
+}
+
+void ZScoreCommand(CutisClient *c) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+  double score;
+
+  if (!de) {
+    AddReply(c, shared.nil);
+  } else {
+    CutisObject *zobj = DictGetEntryVal(de);
+    if (zobj->type != CUTIS_ZSET) {
+      char *err = "ZSCORE against key not holding a sorted set value";
+      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                  -(int)strlen(err), err));
+    } else if (!ZsetTypeScore(zobj, c->argv[2], &score)) {
+      AddReply(c, shared.nil);
+    } else {
+      AddReplyDouble(c, score);
+    }
+  }
+}
+
+static void ZRankGenericCommand(CutisClient *c, int reverse) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+  double score;
+
+  if (!de) {
+    AddReply(c, shared.nil);
+  } else {
+    CutisObject *zobj = DictGetEntryVal(de);
+    Zset *zs;
+    unsigned long rank;
+
+    if (zobj->type != CUTIS_ZSET) {
+      AddReplySds(c, sdsnew("-1\r\n"));
+      return;
+    }
+    if (!ZsetTypeScore(zobj, c->argv[2], &score)) {
+      AddReply(c, shared.nil);
+      return;
+    }
+    zs = zobj->ptr;
+    rank = zslGetRank(zs->zsl, score, c->argv[2]);
+    if (reverse) {
+      AddReplyLongLong(c, zs->zsl->length - rank);
+    } else {
+      AddReplyLongLong(c, rank - 1);
+    }
+  }
+}
+
+void ZRankCommand(CutisClient *c) {
+  ZRankGenericCommand(c, 0);
+}
+
+void ZRevRankCommand(CutisClient *c) {
+  ZRankGenericCommand(c, 1);
+}
+
+static void ZRangeGenericCommand(CutisClient *c, int reverse) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+  int start = atoi(c->argv[2]);
+  int end = atoi(c->argv[3]);
+  int withscores = 0;
+
+  if (c->argc == 5 && !strcasecmp(c->argv[4], "withscores")) {
+    withscores = 1;
+  } else if (c->argc > 4) {
+    char *err = "syntax error";
+    AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                -(int)strlen(err), err));
+    return;
+  }
+
+  if (!de) {
+    AddReply(c, shared.nil);
+  } else {
+    CutisObject *zobj = DictGetEntryVal(de);
+    if (zobj->type != CUTIS_ZSET) {
+      char *err = "ZRANGE against key not holding a sorted set value";
+      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                  -(int)strlen(err), err));
+    } else {
+      Skiplist *zsl = ((Zset *)zobj->ptr)->zsl;
+      SkiplistNode *node;
+      int llen = zsl->length;
+      int range_len;
+      int j;
+
+      // convert negative indexes
+      if (start < 0) {
+        start = llen + start;
+      }
+      if (end < 0) {
+        end = llen + end;
+      }
+      if (start < 0) {
+        start = 0;
+      }
+      if (end < 0) {
+        end = 0;
+      }
+
+      // indexes sanity checks
+      if (start > end || start >= llen) {
+        // Out of range start or start > end result in empty list
+        AddReply(c, shared.zero);
+        return;
+      }
+
+      if (end >= llen) {
+        end = llen - 1;
+      }
+      range_len = (end - start) + 1;
+
+      // Find the first node by rank in O(log(N)), then walk the range.
+      if (reverse) {
+        node = zslGetElementByRank(zsl, llen - start);
+      } else {
+        node = zslGetElementByRank(zsl, start + 1);
+      }
+      AddReplyLongLong(c, withscores ? range_len * 2 : range_len);
+      for (j = 0; j < range_len; j++) {
+        AddReplyZsetNode(c, node, withscores);
+        node = reverse ? node->backward : node->level[0].forward;
+      }
+    }
+  }
+}
+
+void ZRangeCommand(CutisClient *c) {
+  ZRangeGenericCommand(c, 0);
+}
+
+void ZRevRangeCommand(CutisClient *c) {
+  ZRangeGenericCommand(c, 1);
+}
+
+// Parse a score range bound, a "(" prefix excludes the bound.
+static int ParseRangeBound(sds s, double *value, int *exclusive) {
+  *exclusive = 0;
+  if (s[0] == '(') {
+    *exclusive = 1;
+    return StringToDouble(s + 1, sdslen(s) - 1, value);
+  }
+  return StringToDouble(s, sdslen(s), value);
+}
+
+void ZRangeByScoreCommand(CutisClient *c) {
+  DictEntry *de;
+  SkiplistRange range;
+  SkiplistNode *node;
+  CutisObject *zobj, *lenobj;
+  long long offset = 0, limit = -1;
+  int withscores = 0;
+  int j, count = 0;
+  char *err = NULL;
+
+  if (!ParseRangeBound(c->argv[2], &range.min, &range.minex) ||
+      !ParseRangeBound(c->argv[3], &range.max, &range.maxex)) {
+    err = "min or max is not a valid float";
+  }
+  for (j = 4; !err && j < c->argc; j++) {
+    if (!strcasecmp(c->argv[j], "withscores")) {
+      withscores = 1;
+    } else if (!strcasecmp(c->argv[j], "limit") && j + 2 < c->argc) {
+      if (!StringToLongLong(c->argv[j+1], sdslen(c->argv[j+1]), &offset) ||
+          !StringToLongLong(c->argv[j+2], sdslen(c->argv[j+2]), &limit)) {
+        err = "LIMIT offset and count must be integers";
+      }
+      j += 2;
+    } else {
+      err = "syntax error";
+    }
+  }
+  if (err) {
+    AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                -(int)strlen(err), err));
+    return;
+  }
+
+  de = LookupKey(c->db, c->argv[1]);
+  if (!de) {
+    AddReply(c, shared.nil);
+    return;
+  }
+  zobj = DictGetEntryVal(de);
+  if (zobj->type != CUTIS_ZSET) {
+    err = "ZRANGEBYSCORE against key not holding a sorted set value";
+    AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                -(int)strlen(err), err));
+    return;
+  }
+
+  // Find the first node in range in O(log(N)), skip offset nodes and
+  // reply until the score leaves the range or limit is reached.
+  node = offset < 0 ? NULL :
+         zslFirstInRange(((Zset *)zobj->ptr)->zsl, &range);
+  while (node && offset--) {
+    node = node->level[0].forward;
+  }
+  lenobj = AddReplyDeferredLen(c);
+  while (node && limit--) {
+    if (range.maxex ? node->score >= range.max : node->score > range.max) {
+      break;
+    }
+    AddReplyZsetNode(c, node, withscores);
+    node = node->level[0].forward;
+    count++;
+  }
+  SetDeferredReplyLen(c, lenobj, withscores ? count * 2 : count);
+}
+
+void HSetCommand(CutisClient *c) {
+  CutisObject *o;
+  DictEntry *de;
+  int j, added = 0;
+
+  if (c->argc % 2 != 0) {
+    AddReplySds(c, sdsnew("-ERR wrong number of arguments for HSET\r\n"));
+    return;
+  }
+  de = LookupKey(c->db, c->argv[1]);
+  if (!de) {
+    o = CreateHashObject();
+    DictAdd(c->db->dict, c->argv[1], o);
+    c->argv[1] = NULL;
+  } else {
+    o = DictGetEntryVal(de);
+    if (o->type != CUTIS_HASH) {
+      char *err = "-ERR HSET against key not holding a hash value\r\n";
+      AddReplySds(c, sdsnew(err));
+      return;
+    }
+  }
+  for (j = 2; j < c->argc; j += 2) {
+    added += HashTypeSet(o, c->argv[j], c->argv[j+1]);
+  }
+  c->server->dirty++;
+  AddReplyLongLong(c, added);
+}
+
+void HGetCommand(CutisClient *c) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+  HashTypeEntry entry;
+
+  if (!de) {
+    AddReply(c, shared.nil);
+  } else {
+    CutisObject *o = DictGetEntryVal(de);
+    if (o->type != CUTIS_HASH) {
+      char *err = "HGET against key not holding a hash value";
+      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                  -(int)strlen(err), err));
+    } else if (!HashTypeGet(o, c->argv[2], &entry)) {
+      AddReply(c, shared.nil);
+    } else {
+      AddReplyLongLong(c, entry.vlen);
+      AddReplyString(c, entry.value, entry.vlen);
+      AddReply(c, shared.crlf);
+    }
+  }
+}
+
+// Reply the values of the fields in a single multi-bulk, nil for missing
+// fields, so a record is read in one round trip.
+void HMGetCommand(CutisClient *c) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+  CutisObject *o = NULL;
+  HashTypeEntry entry;
+  int j;
+
+  if (de) {
+    o = DictGetEntryVal(de);
+    if (o->type != CUTIS_HASH) {
+      char *err = "HMGET against key not holding a hash value";
+      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                  -(int)strlen(err), err));
+      return;
+    }
+  }
+  AddReplyLongLong(c, c->argc - 2);
+  for (j = 2; j < c->argc; j++) {
+    if (!o || !HashTypeGet(o, c->argv[j], &entry)) {
+      AddReply(c, shared.nil);
+    } else {
+      AddReplyLongLong(c, entry.vlen);
+      AddReplyString(c, entry.value, entry.vlen);
+      AddReply(c, shared.crlf);
+    }
+  }
+}
+
+void HGetAllCommand(CutisClient *c) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+
+  if (!de) {
+    AddReply(c, shared.zero);
+  } else {
+    CutisObject *o = DictGetEntryVal(de);
+    if (o->type != CUTIS_HASH) {
+      char *err = "HGETALL against key not holding a hash value";
+      AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                                  -(int)strlen(err), err));
+    } else {
+      HashTypeIterator hi;
+      HashTypeEntry entry;
+
+      AddReplyLongLong(c, HashTypeLength(o) * 2);
+      HashTypeInitIterator(&hi, o);
+      while (HashTypeNext(&hi, &entry)) {
+        AddReplyLongLong(c, entry.flen);
+        AddReplyString(c, entry.field, entry.flen);
+        AddReply(c, shared.crlf);
+        AddReplyLongLong(c, entry.vlen);
+        AddReplyString(c, entry.value, entry.vlen);
+        AddReply(c, shared.crlf);
+      }
+      HashTypeReleaseIterator(&hi);
+    }
+  }
+}
+
+void HDelCommand(CutisClient *c) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+
+  if (!de) {
+    AddReply(c, shared.zero);
+  } else {
+    CutisObject *o = DictGetEntryVal(de);
+    if (o->type != CUTIS_HASH) {
+      char *err = "-ERR HDEL against key not holding a hash value\r\n";
+      AddReplySds(c, sdsnew(err));
+      return;
+    }
+    if (HashTypeDelete(o, c->argv[2])) {
+      if (HashTypeLength(o) == 0) {
+        DeleteKey(c->db, c->argv[1]);
+      }
+      c->server->dirty++;
+      AddReply(c, shared.one);
+    } else {
+      AddReply(c, shared.zero);
+    }
+  }
+}
+
+void HLenCommand(CutisClient *c) {
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+
+  if (!de) {
+    AddReply(c, shared.zero);
+  } else {
+    CutisObject *o = DictGetEntryVal(de);
+    if (o->type != CUTIS_HASH) {
+      AddReplySds(c, sdsnew("-1\r\n"));
+    } else {
+      AddReplyLongLong(c, HashTypeLength(o));
+    }
+  }
+}
+
+void HIncrByCommand(CutisClient *c) {
+  CutisObject *o;
+  DictEntry *de;
+  HashTypeEntry entry;
+  long long incr, value = 0;
+  char buf[32];
+  sds sval;
+  int len;
+
+  if (!StringToLongLong(c->argv[3], sdslen(c->argv[3]), &incr)) {
+    AddReplySds(c, sdsnew("-ERR value is not an integer\r\n"));
+    return;
+  }
+  de = LookupKey(c->db, c->argv[1]);
+  if (!de) {
+    o = CreateHashObject();
+    DictAdd(c->db->dict, c->argv[1], o);
+    c->argv[1] = NULL;
+  } else {
+    o = DictGetEntryVal(de);
+    if (o->type != CUTIS_HASH) {
+      char *err = "-ERR HINCRBY against key not holding a hash value\r\n";
+      AddReplySds(c, sdsnew(err));
+      return;
+    }
+  }
+  if (HashTypeGet(o, c->argv[2], &entry) &&
+      !StringToLongLong(entry.value, entry.vlen, &value)) {
+    AddReplySds(c, sdsnew("-ERR hash value is not an integer\r\n"));
+    return;
+  }
+  if ((incr < 0 && value < 0 && incr < LLONG_MIN - value) ||
+      (incr > 0 && value > 0 && incr > LLONG_MAX - value)) {
+    AddReplySds(c, sdsnew("-ERR increment or decrement would overflow\r\n"));
+    return;
+  }
+  value += incr;
+  len = snprintf(buf, sizeof(buf), "%lld", value);
+  sval = sdsnewlen(buf, len);
+  HashTypeSet(o, c->argv[2], sval);
+  sdsfree(sval);
+  c->server->dirty++;
+  AddReplyLongLong(c, value);
+}
+
+void TypeCommand(CutisClient *c) {
+  char *type;
+  DictEntry *de = LookupKey(c->db, c->argv[1]);
+  if (!de) {
+    type = "none";
+  } else {
+    CutisObject *o = DictGetEntryVal(de);
+    switch (o->type) {
+    case CUTIS_STRING:
+      type = "string";
+      break;
+    case CUTIS_LIST:
+      type = "list";
+      break;
+    case CUTIS_SET:
+      type = "set";
+      break;
+    case CUTIS_ZSET:
+      type = "zset";
+      break;
+    case CUTIS_HASH:
+      type = "hash";
+      break;
+    default:
+      type = "unknown";
+      break;
+    }
+  }
+  AddReplySds(c, sdsnew(type));
+  AddReply(c, shared.crlf);
+}
+
+void SelectCommand(CutisClient *c) {
+  int id = atoi(c->argv[1]);
+  if (SelectDB(c, id) == CUTIS_ERR) {
+    AddReplySds(c, sdsnew("-ERR invalid DB index\r\n"));
+  } else {
+    AddReply(c, shared.ok);
+  }
+}
+
+void MoveCommand(CutisClient *c) {
+  CutisDb *src, *dst;
+  DictEntry *de;
+  sds key;
+  CutisObject *o;
+  time_t when;
+
+  // Obtain source and target DB pointers.
+  src = c->db;
+  if (SelectDB(c, atoi(c->argv[2])) == CUTIS_ERR) {
+    AddReplySds(c, sdsnew("-ERR target DB out of range\r\n"));
+    return;
+  }
+  dst = c->db;
+  c->db = src;
+
+  // If the user is moving using as target the same
+  // DB as the source DB it is probably an error.
+  if (src == dst) {
+    AddReplySds(c, sdsnew("-ERR source DB is the same as target DB\r\n"));
+    return;
+  }
+
+  // Check if the element exists and get a reference.
+  de = LookupKey(src, c->argv[1]);
+  if (!de) {
+    AddReplySds(c, sdsnew("-ERR no such key\r\n"));
+    return;
+  }
+
+  // Try to add the element to the target DB.
+  key = DictGetEntryKey(de);
+  o = DictGetEntryVal(de);
+  ExpireIfNeeded(dst, key);
+  if (DictAdd(dst->dict, key, o) == DICT_ERR) {
+    AddReplySds(c, sdsnew("-ERR target DB already contains the moved key\r\n"));
+    return;
+  }
+
+  // OK. key moved with its timeout, free the entry in the source DB.
+  when = GetExpire(src, key);
+  RemoveExpire(src, key);
+  DictDeleteNoFree(src->dict, c->argv[1]);
+  if (when != -1) {
+    SetExpire(dst, key, when);
+  }
+  c->server->dirty++;
+  AddReply(c, shared.ok);
+}
+
+static void RenameGenericCommand(CutisClient *c, int nx) {
+  sds newkey = c->argv[2];
+  DictEntry *de;
+  CutisObject *o;
+  time_t when;
+
+  // To use the same key as src and dst is probably an error.
+  if (sdscmp(c->argv[1], c->argv[2]) == 0) {
+    AddReplySds(c, sdsnew("-ERR src and dest key are the same\r\n"));
+    return;
+  }
+
+  de = LookupKey(c->db, c->argv[1]);
+  if (!de) {
+    AddReplySds(c, sdsnew("-ERR no such key\r\n"));
+    return;
+  }
+
+  o = DictGetEntryVal(de);
+  IncrRefCount(o);
+  ExpireIfNeeded(c->db, newkey);
+  if (DictAdd(c->db->dict, newkey, o) == DICT_ERR) {
+    if (nx) {
+      DecrRefCount(o);
+      AddReplySds(c, sdsnew("-ERR destination key exists\r\n"));
+      return;
+    }
+    DictReplace(c->db->dict, newkey, o);
+    RemoveExpire(c->db, newkey);
+  } else {
+    c->argv[2] = NULL;
+  }
+  // The timeout goes with the value.
+  when = GetExpire(c->db, c->argv[1]);
+  DeleteKey(c->db, c->argv[1]);
+  if (when != -1) {
+    SetExpire(c->db, newkey, when);
+  }
+  c->server->dirty++;
+  AddReply(c, shared.ok);
+}
+
+void RenameCommand(CutisClient *c) {
+  RenameGenericCommand(c, 0);
+}
 
 void RenamenxCommand(CutisClient *c) {
   RenameGenericCommand(c, 1);
@@ -830,12 +1880,19 @@ void KeysCommand(CutisClient *c) {
   sds keys, reply;
   sds pattern = c->argv[1];
   int plen = sdslen(pattern);
+  time_t now = time(NULL);
 
-  di = DictGetIterator(c->dict);
+  di = DictGetIterator(c->db->dict);
   keys = sdsempty();
 
   while ((de = DictNext(di)) != NULL) {
     sds key = DictGetEntryKey(de);
+    time_t when;
+
+    // Expired keys can't be deleted while iterating, skip them.
+    if ((when = GetExpire(c->db, key)) != -1 && now >= when) {
+      continue;
+    }
     if ((pattern[0] == '*' && pattern[1] == '\0') ||
         StringMatch(pattern, plen, key, sdslen(key), 0)) {
       keys = sdscatlen(keys, key, sdslen(key));
@@ -852,8 +1909,140 @@ void KeysCommand(CutisClient *c) {
 }
 
 void DbsizeCommand(CutisClient *c) {
-  AddReplySds(c, sdscatprintf(sdsempty(), "%lu\r\n",
-                              DictGetHashTableUsed(c->dict)));
+  AddReplyLongLong(c, DictGetHashTableUsed(c->db->dict));
+}
+
+static void ScanCallback(void *priv_data, const DictEntry *de) {
+  List *keys = priv_data;
+  if (!listAddNodeTail(keys, DictGetEntryKey((DictEntry *)de))) {
+    CutisOom("listAddNodeTail");
+  }
+}
+
+// Multi-bulk replies report errors with a negative count.
+static void AddScanError(CutisClient *c, char *err) {
+  AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n%s\r\n",
+                              -(int)strlen(err), err));
+}
+
+void ScanCommand(CutisClient *c) {
+  List *keys;
+  ListNode *ln;
+  CutisObject *lenobj;
+  long long cursor;
+  long long count = 10;
+  long max_iterations;
+  sds pattern = NULL;
+  sds reply;
+  int j, plen = 0, num = 0;
+
+  if (!StringToLongLong(c->argv[1], sdslen(c->argv[1]), &cursor) ||
+      cursor < 0) {
+    AddScanError(c, "invalid cursor");
+    return;
+  }
+  for (j = 2; j < c->argc; j += 2) {
+    if (j + 1 >= c->argc) {
+      AddScanError(c, "syntax error");
+      return;
+    }
+    if (!strcasecmp(c->argv[j], "match")) {
+      pattern = c->argv[j+1];
+      plen = sdslen(pattern);
+      if (pattern[0] == '*' && pattern[1] == '\0') {
+        pattern = NULL;
+      }
+    } else if (!strcasecmp(c->argv[j], "count")) {
+      if (!StringToLongLong(c->argv[j+1], sdslen(c->argv[j+1]), &count) ||
+          count < 1) {
+        AddScanError(c, "COUNT is not an integer or out of range");
+        return;
+      }
+    } else {
+      AddScanError(c, "syntax error");
+      return;
+    }
+  }
+
+  // COUNT is the number of keys to visit, not to return. Stop after
+  // some empty buckets too, so a sparse table can't block the server.
+  keys = listCreate();
+  if (!keys) {
+    CutisOom("listCreate");
+  }
+  max_iterations = count * 10;
+  do {
+    cursor = DictScan(c->db->dict, cursor, ScanCallback, keys);
+  } while (cursor && max_iterations-- && listLength(keys) < count);
+
+  // The reply is the next cursor followed by the keys found.
+  lenobj = AddReplyDeferredLen(c);
+  reply = sdscatprintf(sdsempty(), "%lld", cursor);
+  AddReplyLongLong(c, sdslen(reply));
+  AddReplySds(c, reply);
+  AddReply(c, shared.crlf);
+  num++;
+
+  // The keys are filtered only now, expired keys can't be deleted
+  // while scanning.
+  for (ln = listFirst(keys); ln != NULL; ln = listNextNode(ln)) {
+    sds key = listNodeValue(ln);
+    if (pattern && !StringMatch(pattern, plen, key, sdslen(key), 0)) {
+      continue;
+    }
+    if (ExpireIfNeeded(c->db, key)) {
+      continue;
+    }
+    AddReplyLongLong(c, sdslen(key));
+    AddReplyString(c, key, sdslen(key));
+    AddReply(c, shared.crlf);
+    num++;
+  }
+  SetDeferredReplyLen(c, lenobj, num);
+  listRelease(keys);
+}
+
+void ExpireCommand(CutisClient *c) {
+  long long seconds;
+
+  if (!StringToLongLong(c->argv[2], sdslen(c->argv[2]), &seconds)) {
+    AddReplySds(c, sdsnew("-ERR value is not an integer or out of range\r\n"));
+    return;
+  }
+  if (LookupKey(c->db, c->argv[1]) == NULL) {
+    AddReply(c, shared.zero);
+    return;
+  }
+  if (seconds <= 0) {
+    DeleteKey(c->db, c->argv[1]);
+  } else {
+    SetExpire(c->db, c->argv[1], time(NULL) + seconds);
+  }
+  c->server->dirty++;
+  AddReply(c, shared.one);
+}
+
+// Seconds left before the key expires, -1 if it has no timeout and -2 if
+// it doesn't exist.
+void TtlCommand(CutisClient *c) {
+  time_t when;
+
+  if (LookupKey(c->db, c->argv[1]) == NULL) {
+    AddReplyLongLong(c, -2);
+    return;
+  }
+  when = GetExpire(c->db, c->argv[1]);
+  AddReplyLongLong(c, when == -1 ? -1 : when - time(NULL));
+}
+
+void PersistCommand(CutisClient *c) {
+  if (LookupKey(c->db, c->argv[1]) != NULL &&
+      RemoveExpire(c->db, c->argv[1])) {
+    c->server->dirty++;
+    AddReply(c, shared.one);
+  } else {
+    AddReply(c, shared.zero);
+  }
 }
 
 void SaveCommand(CutisClient *c) {
@@ -892,14 +2081,45 @@ void PingCommand(CutisClient *c) {
 }
 
 void EchoCommand(CutisClient *c) {
-  AddReplySds(c, sdscatprintf(sdsempty(), "%d\r\n",
-                              (int)sdslen(c->argv[1])));
-  AddReplySds(c, c->argv[1]);
+  AddReplyLongLong(c, sdslen(c->argv[1]));
+  AddReplyString(c, c->argv[1], sdslen(c->argv[1]));
   AddReply(c, shared.crlf);
-  c->argv[1] = NULL;
 }
 
 void LastSaveCommand(CutisClient *c) {
-  AddReplySds(c, sdscatprintf(sdsempty(), "%lu\r\n",
-                              c->server->last_save));
+  AddReplyLongLong(c, c->server->last_save);
+}
+
+void InfoCommand(CutisClient *c) {
+  CutisServer *server = c->server;
+  size_t rss = zmalloc_get_rss();
+  sds info = sdscatprintf(sdsempty(),
+      "connected_clients:%lu\r\n"
+      "used_memory:%zu\r\n"
+      "used_memory_rss:%zu\r\n"
+      "mem_fragmentation_ratio:%.2f\r\n"
+      "mem_allocator:%s\r\n"
+      "changes_since_last_save:%lld\r\n"
+      "bgsave_in_progress:%d\r\n"
+      "last_save_time:%ld\r\n"
+      "maxmemory:%llu\r\n"
+      "maxmemory_policy:%s\r\n"
+      "evicted_keys:%lld\r\n"
+      "expired_keys:%lld\r\n",
+      (unsigned long)listLength(server->clients),
+      zmalloc_used_memory(),
+      rss,
+      zmalloc_get_fragmentation_ratio(rss),
+      ZMALLOC_LIB,
+      server->dirty,
+      server->bg_saving,
+      (long)server->last_save,
+      server->maxmemory,
+      GetMaxmemoryPolicyName(server->maxmemory_policy),
+      server->stat_evicted_keys,
+      server->stat_expired_keys);
+
+  AddReplyLongLong(c, sdslen(info));
+  AddReplySds(c, info);
+  AddReply(c, shared.crlf);
 }
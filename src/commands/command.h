@@ -24,11 +24,18 @@
 #define CUTIS_CMD_INLINE  0
 #define CUTIS_CMD_BULK    1
 
-#define CUTIS_HEAD        0
-#define CUTIS_TAIL        1
+// Command flags
+#define CUTIS_CMD_WRITE     (1 << 0)  // may modify the data set
+#define CUTIS_CMD_READONLY  (1 << 1)  // only reads keys
+#define CUTIS_CMD_DENYOOM   (1 << 2)  // may use more memory
+#define CUTIS_CMD_FAST      (1 << 3)  // O(1) or O(log(N)), never slow
+#define CUTIS_CMD_MOVABLE_KEYS  (1 << 4)  // an argument tells which are keys
 
 #define CUTIS_MAX_STRING_LENGTH 1024*1024*1024
 
+#include "data_struct/dict.h"
+#include "data_struct/sds.h"
+
 typedef struct CutisClient CutisClient;
 
 typedef void CutisCommandProc(CutisClient *c);
@@ -37,19 +44,32 @@ typedef struct CutisCommand {
   CutisCommandProc *proc;
   int arity;
   int type;
+  int flags;
+  int first_key;    // first argument that is a key, 0 if no keys
+  int last_key;     // last argument that is a key, negative from the end
+  int key_step;     // step between first and last key
+  // With CUTIS_CMD_MOVABLE_KEYS the key range above covers only the keys
+  // always present, the others are found by parsing the arguments.
 } CutisCommand;
 
 int ProcessCommand(CutisClient *c);
-CutisCommand *LookupCommand(char *name);
+Dict *CreateCommandTable();
+CutisCommand *LookupCommand(sds name);
 
 // Commands implementation.
 void GetCommand(CutisClient *c);
 void SetCommand(CutisClient *c);
 void SetnxCommand(CutisClient *c);
+void SetexCommand(CutisClient *c);
+void MGetCommand(CutisClient *c);
+void MSetCommand(CutisClient *c);
+void MSetnxCommand(CutisClient *c);
 void ExistsCommand(CutisClient *c);
 void DelCommand(CutisClient *c);
 void IncrCommand(CutisClient *c);
 void DecrCommand(CutisClient *c);
+void IncrByCommand(CutisClient *c);
+void DecrByCommand(CutisClient *c);
 void RandomKeyCommand(CutisClient *c);
 
 void RPushCommand(CutisClient *c);
@@ -67,6 +87,31 @@ void SRemCommand(CutisClient *c);
 void SIsMemberCommand(CutisClient *c);
 void SCardCommand(CutisClient *c);
 void SInterCommand(CutisClient *c);
+void SInterStoreCommand(CutisClient *c);
+void SInterCardCommand(CutisClient *c);
+void SUnionCommand(CutisClient *c);
+void SUnionStoreCommand(CutisClient *c);
+void SDiffCommand(CutisClient *c);
+void SDiffStoreCommand(CutisClient *c);
+
+void ZAddCommand(CutisClient *c);
+void ZIncrByCommand(CutisClient *c);
+void ZRemCommand(CutisClient *c);
+void ZCardCommand(CutisClient *c);
+void ZScoreCommand(CutisClient *c);
+void ZRankCommand(CutisClient *c);
+void ZRevRankCommand(CutisClient *c);
+void ZRangeCommand(CutisClient *c);
+void ZRevRangeCommand(CutisClient *c);
+void ZRangeByScoreCommand(CutisClient *c);
+
+void HSetCommand(CutisClient *c);
+void HGetCommand(CutisClient *c);
+void HMGetCommand(CutisClient *c);
+void HGetAllCommand(CutisClient *c);
+void HDelCommand(CutisClient *c);
+void HLenCommand(CutisClient *c);
+void HIncrByCommand(CutisClient *c);
 
 void TypeCommand(CutisClient *c);
 void SelectCommand(CutisClient *c);
@@ -74,6 +119,10 @@ void MoveCommand(CutisClient *c);
 void RenameCommand(CutisClient *c);
 void RenamenxCommand(CutisClient *c);
 void KeysCommand(CutisClient *c);
+void ScanCommand(CutisClient *c);
+void ExpireCommand(CutisClient *c);
+void TtlCommand(CutisClient *c);
+void PersistCommand(CutisClient *c);
 void DbsizeCommand(CutisClient *c);
 void SaveCommand(CutisClient *c);
 void BgsaveCommand(CutisClient *c);
@@ -81,5 +130,6 @@ void ShutDownCommand(CutisClient *c);
 void PingCommand(CutisClient *c);
 void EchoCommand(CutisClient *c);
 void LastSaveCommand(CutisClient *c);
+void InfoCommand(CutisClient *c);
 
 #endif  // COMMANDS_COMMAND_H_
@@ -21,12 +21,22 @@
 #include "commands/object.h"
 
 #include <assert.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "data_struct/intset.h"
+#include "data_struct/quicklist.h"
 #include "data_struct/sds.h"
+#include "data_struct/skiplist.h"
+#include "data_struct/ziplist.h"
+#include "memory/slab.h"
 #include "memory/zmalloc.h"
+#include "server/evict.h"
 #include "server/server.h"
 #include "utils/log.h"
+#include "utils/string_util.h"
 
 static int SetDictKeyCompare(void *priv_data, const void *key1,
                              const void *key2);
@@ -41,59 +51,932 @@ DictType SetDictType = {
     NULL,  // val destructor
 };
 
+// Keys are the sds members owned by the skiplist, values point to the
+// score in the skiplist node.
+DictType ZsetDictType = {
+    sdsDictHashFunction,  // hash function
+    NULL,  // key dup
+    NULL,  // val dup
+    sdsDictKeyCompare,  // key compare
+    NULL,  // key destructor
+    NULL,  // val destructor
+};
+
+// Fields and values of hashes stored as hash tables are sds.
+DictType HashDictType = {
+    sdsDictHashFunction,  // hash function
+    NULL,  // key dup
+    NULL,  // val dup
+    sdsDictKeyCompare,  // key compare
+    sdsDictKeyDestructor,  // key destructor
+    sdsDictKeyDestructor,  // val destructor
+};
+
 SharedObject shared;
 
 CutisObject *CreateCutisObject(int type, void *ptr) {
-  CutisObject *o = NULL;
-  CutisServer *s = GetSingletonServer();
-  if (listLength(s->free_objs)) {
-    ListNode *head = listFirst(s->free_objs);
-    o = listNodeValue(head);
-    listDelNode(s->free_objs, head);
-  } else {
-    o = zmalloc(sizeof(CutisObject));
-  }
+  CutisObject *o = slab_alloc(sizeof(CutisObject));
   if (o == NULL) {
     CutisOom("CreateCutisObject");
   }
 
   o->ptr = ptr;
   o->type = type;
+  o->encoding = CUTIS_ENCODING_RAW;
   o->refcount = 1;
+  InitObjectAccess(o);
   return o;
 }
 
-void ReleaseCutisObject(CutisObject *o) {
-  zfree(o);
+// Size of the allocation holding an object and its embedded string.
+#define EMBSTR_ALLOC_SIZE(len) \
+  (sizeof(CutisObject) + sizeof(sds_hdr8) + (len) + 1)
+
+// Create a string object with the sds stored right after the object, in
+// a single allocation. The string can't grow.
+CutisObject *CreateEmbeddedStringObject(const char *ptr, size_t len) {
+  CutisObject *o;
+  sds_hdr8 *sh;
+
+  assert(len <= CUTIS_EMBSTR_SIZE_LIMIT);
+  o = slab_alloc(EMBSTR_ALLOC_SIZE(len));
+  if (o == NULL) {
+    CutisOom("CreateEmbeddedStringObject");
+  }
+  sh = (void*)(o + 1);
+  sh->len = len;
+  sh->alloc = len;
+  sh->flags = SDS_TYPE_8;
+  memcpy(sh->buf, ptr, len);
+  sh->buf[len] = '\0';
+
+  o->ptr = sh->buf;
+  o->type = CUTIS_STRING;
+  o->encoding = CUTIS_ENCODING_EMBSTR;
+  o->refcount = 1;
+  InitObjectAccess(o);
+  return o;
 }
 
+// Create a string object with a copy of ptr, embedded if it is short.
+CutisObject *CreateStringObject(const char *ptr, size_t len) {
+  if (len <= CUTIS_EMBSTR_SIZE_LIMIT) {
+    return CreateEmbeddedStringObject(ptr, len);
+  }
+  return CreateCutisObject(CUTIS_STRING, sdsnewlen(ptr, len));
+}
+
+// Create a string object holding value, stored in the object itself if it
+// fits in a long.
+CutisObject *CreateStringObjectFromLongLong(long long value) {
+  CutisObject *o;
+
+  if (value < LONG_MIN || value > LONG_MAX) {
+    return CreateCutisObject(CUTIS_STRING,
+                             sdscatprintf(sdsempty(), "%lld", value));
+  }
+  o = CreateCutisObject(CUTIS_STRING, NULL);
+  o->encoding = CUTIS_ENCODING_INT;
+  o->ptr = (void*)(long)value;
+  return o;
+}
+
+// Store a string value in the most compact encoding: the canonical
+// representation of an integer fitting in a long as the integer itself,
+// a short string embedded with its object, otherwise the sds without free
+// space. May return a different object, o is released then. Shared objects
+// are left alone, their ptr may be referenced elsewhere.
+CutisObject *TryObjectEncoding(CutisObject *o) {
+  long long value;
+  sds s = o->ptr;
+  size_t len;
+
+  if (o->type != CUTIS_STRING || o->encoding != CUTIS_ENCODING_RAW ||
+      o->refcount > 1) {
+    return o;
+  }
+  len = sdslen(s);
+  if (len <= 20 && StringToLongLong(s, len, &value) &&
+      value >= LONG_MIN && value <= LONG_MAX) {
+    o->encoding = CUTIS_ENCODING_INT;
+    o->ptr = (void*)(long)value;
+    sdsfree(s);
+    return o;
+  }
+  if (len <= CUTIS_EMBSTR_SIZE_LIMIT) {
+    CutisObject *emb = CreateEmbeddedStringObject(s, len);
+    DecrRefCount(o);
+    return emb;
+  }
+  if (sdsavail(s) > len / 10) {
+    o->ptr = sdsRemoveFreeSpace(s);
+  }
+  return o;
+}
+
+// The integer value of a string object. Raw strings are parsed like
+// strtoll() does, so a non numeric string is 0.
+long long GetLongLongFromStringObject(CutisObject *o) {
+  if (o->encoding == CUTIS_ENCODING_INT) {
+    return (long)o->ptr;
+  }
+  return strtoll(o->ptr, NULL, 10);
+}
+
+// Format an integer encoded string in buf, returns its length.
+int StringObjectToBuffer(CutisObject *o, char *buf, size_t len) {
+  assert(o->encoding == CUTIS_ENCODING_INT);
+  return snprintf(buf, len, "%ld", (long)o->ptr);
+}
+
+// The bytes of a string object of any encoding, integers are formatted
+// in buf.
+static const char *GetStringObjectBytes(CutisObject *o, char *buf,
+                                        size_t size, size_t *len) {
+  if (o->encoding == CUTIS_ENCODING_INT) {
+    *len = StringObjectToBuffer(o, buf, size);
+    return buf;
+  }
+  *len = sdslen(o->ptr);
+  return o->ptr;
+}
+
+// Lists start as a ziplist, and are converted to a quicklist when they
+// get too many or too large elements for it.
 CutisObject *CreateListObject() {
-  List *l = listCreate();
-  if (!l) {
+  unsigned char *zl = ziplistNew();
+  CutisObject *o;
+
+  if (!zl) {
     CutisOom("CreateListObject");
   }
-  listSetFreeMethod(l, (void(*)(void*))(&DecrRefCount));
-  return CreateCutisObject(CUTIS_LIST, l);
+  o = CreateCutisObject(CUTIS_LIST, zl);
+  o->encoding = CUTIS_ENCODING_ZIPLIST;
+  return o;
+}
+
+// Convert a ziplist to a quicklist, the ziplist becomes its first node.
+void ListTypeConvert(CutisObject *o, int encoding) {
+  Quicklist *ql;
+
+  assert(o->encoding == CUTIS_ENCODING_ZIPLIST &&
+         encoding == CUTIS_ENCODING_QUICKLIST);
+  ql = quicklistCreate(GetSingletonServer()->list_max_ziplist_entries);
+  if (!ql || !quicklistAppendZiplist(ql, o->ptr)) {
+    CutisOom("ListTypeConvert");
+  }
+  o->ptr = ql;
+  o->encoding = CUTIS_ENCODING_QUICKLIST;
+}
+
+unsigned long ListTypeLength(CutisObject *o) {
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    return ziplistLen(o->ptr);
+  }
+  return quicklistCount((Quicklist *)o->ptr);
+}
+
+// Add a copy of value at the where end of the list.
+void ListTypePush(CutisObject *o, CutisObject *value, int where) {
+  char buf[32];
+  size_t len;
+  const char *s = GetStringObjectBytes(value, buf, sizeof(buf), &len);
+
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    CutisServer *server = GetSingletonServer();
+
+    if (len <= server->list_max_ziplist_value &&
+        ziplistLen(o->ptr) < server->list_max_ziplist_entries) {
+      o->ptr = ziplistPush(o->ptr, s, len,
+                           where == CUTIS_HEAD ? ZIPLIST_HEAD : ZIPLIST_TAIL);
+      if (!o->ptr) {
+        CutisOom("ziplistPush");
+      }
+      return;
+    }
+    ListTypeConvert(o, CUTIS_ENCODING_QUICKLIST);
+  }
+
+  if (!quicklistPush(o->ptr, s, len,
+                     where == CUTIS_HEAD ? QUICKLIST_HEAD : QUICKLIST_TAIL)) {
+    CutisOom("quicklistPush");
+  }
+}
+
+// Remove the element at the where end of the list and return it, NULL
+// if the list is empty. The caller owns the returned object.
+CutisObject *ListTypePop(CutisObject *o, int where) {
+  CutisObject *value = NULL;
+  int index = (where == CUTIS_HEAD) ? 0 : -1;
+
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *p = ziplistIndex(o->ptr, index);
+    unsigned char *s;
+    unsigned int len;
+
+    if (p) {
+      ziplistGet(p, &s, &len);
+      value = CreateStringObject((char *)s, len);
+      o->ptr = ziplistDelete(o->ptr, &p);
+      if (!o->ptr) {
+        CutisOom("ziplistDelete");
+      }
+    }
+  } else {
+    QuicklistEntry entry;
+
+    if (quicklistIndex(o->ptr, index, &entry)) {
+      value = CreateStringObject((char *)entry.sval, entry.slen);
+      if (!quicklistDelEntry(o->ptr, &entry)) {
+        CutisOom("quicklistDelEntry");
+      }
+    }
+  }
+  return value;
+}
+
+// Set the element at index to value, returns 0 if index is out of range.
+int ListTypeReplace(CutisObject *o, int index, CutisObject *value) {
+  QuicklistEntry entry;
+  char buf[32];
+  size_t len;
+  const char *s = GetStringObjectBytes(value, buf, sizeof(buf), &len);
+
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *p = ziplistIndex(o->ptr, index);
+
+    if (p == NULL) {
+      return 0;
+    }
+    if (len <= GetSingletonServer()->list_max_ziplist_value) {
+      o->ptr = ziplistReplace(o->ptr, p, s, len);
+      if (!o->ptr) {
+        CutisOom("ziplistReplace");
+      }
+      return 1;
+    }
+    ListTypeConvert(o, CUTIS_ENCODING_QUICKLIST);
+  }
+
+  if (!quicklistIndex(o->ptr, index, &entry)) {
+    return 0;
+  }
+  if (!quicklistReplaceEntry(o->ptr, &entry, s, len)) {
+    CutisOom("quicklistReplaceEntry");
+  }
+  return 1;
+}
+
+// Remove ltrim elements from the head and rtrim from the tail.
+void ListTypeTrim(CutisObject *o, int ltrim, int rtrim) {
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    if (ltrim > 0) {
+      o->ptr = ziplistDeleteRange(o->ptr, 0, ltrim);
+    }
+    if (o->ptr && rtrim > 0) {
+      o->ptr = ziplistDeleteRange(o->ptr, -rtrim, rtrim);
+    }
+    if (!o->ptr) {
+      CutisOom("ziplistDeleteRange");
+    }
+    return;
+  }
+
+  if ((ltrim > 0 && !quicklistDelRange(o->ptr, 0, ltrim)) ||
+      (rtrim > 0 && !quicklistDelRange(o->ptr, -rtrim, rtrim))) {
+    CutisOom("quicklistDelRange");
+  }
+}
+
+// Start iterating at index, towards the tail if direction is CUTIS_TAIL,
+// towards the head otherwise.
+void ListTypeInitIterator(ListTypeIterator *li, CutisObject *o, int index,
+                          int direction) {
+  li->subject = o;
+  li->direction = direction;
+  li->zi = NULL;
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    li->zi = ziplistIndex(o->ptr, index);
+  } else {
+    quicklistInitIterator(&li->qi, o->ptr, index,
+                          direction == CUTIS_TAIL ? QUICKLIST_TAIL
+                                                  : QUICKLIST_HEAD);
+  }
+}
+
+// Store the next element in entry, returns 0 when there are no more.
+int ListTypeNext(ListTypeIterator *li, ListTypeEntry *entry) {
+  if (li->subject->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *zl = li->subject->ptr;
+
+    if (li->zi == NULL) {
+      return 0;
+    }
+    ziplistGet(li->zi, &entry->sval, &entry->slen);
+    li->zi = (li->direction == CUTIS_TAIL) ? ziplistNext(zl, li->zi)
+                                           : ziplistPrev(zl, li->zi);
+    return 1;
+  } else {
+    QuicklistEntry qe;
+
+    if (!quicklistNext(&li->qi, &qe)) {
+      return 0;
+    }
+    entry->sval = qe.sval;
+    entry->slen = qe.slen;
+    return 1;
+  }
 }
 
 CutisObject *CreateSetObject() {
   Dict *d = DictCreate(&SetDictType, NULL);
+  CutisObject *o;
+
   if (!d) {
     CutisOom("CreateSetObject");
   }
-  return CreateCutisObject(CUTIS_SET, d);
+  o = CreateCutisObject(CUTIS_SET, d);
+  o->encoding = CUTIS_ENCODING_HT;
+  return o;
+}
+
+CutisObject *CreateIntsetObject() {
+  Intset *is = intsetNew();
+  CutisObject *o;
+
+  if (!is) {
+    CutisOom("CreateIntsetObject");
+  }
+  o = CreateCutisObject(CUTIS_SET, is);
+  o->encoding = CUTIS_ENCODING_INTSET;
+  return o;
+}
+
+CutisObject *CreateSmallSetObject() {
+  unsigned char *zl = ziplistNew();
+  CutisObject *o;
+
+  if (!zl) {
+    CutisOom("CreateSmallSetObject");
+  }
+  o = CreateCutisObject(CUTIS_SET, zl);
+  o->encoding = CUTIS_ENCODING_ZIPLIST;
+  return o;
+}
+
+// Members stored in an intset must be the canonical representation of an
+// integer, so they are replied exactly as they were added.
+static int SetMemberToInteger(sds value, long long *ll) {
+  size_t len = sdslen(value);
+  return StringToLongLong(value, len, ll) && (*ll != 0 || len == 1);
+}
+
+// Create an empty set in the most compact encoding that can hold value:
+// sets of integers are intsets, small sets of short strings are ziplists
+// of members and the others are hash tables. A set is converted to a
+// hash table when it outgrows its encoding, and never converted back.
+CutisObject *SetTypeCreate(sds value) {
+  CutisServer *server = GetSingletonServer();
+  long long ll;
+
+  if (SetMemberToInteger(value, &ll) && server->set_max_intset_entries > 0) {
+    return CreateIntsetObject();
+  }
+  if (sdslen(value) <= server->set_max_ziplist_value &&
+      server->set_max_ziplist_entries > 0) {
+    return CreateSmallSetObject();
+  }
+  return CreateSetObject();
+}
+
+void SetTypeConvert(CutisObject *set, int encoding) {
+  SetTypeIterator si;
+  SetTypeEntry entry;
+  void *ptr;
+
+  assert(set->encoding != CUTIS_ENCODING_HT && set->encoding != encoding);
+  if (encoding == CUTIS_ENCODING_HT) {
+    ptr = DictCreate(&SetDictType, NULL);
+    if (!ptr || DictExpand(ptr, SetTypeSize(set)) != DICT_OK) {
+      CutisOom("SetTypeConvert");
+    }
+  } else {
+    assert(set->encoding == CUTIS_ENCODING_INTSET &&
+           encoding == CUTIS_ENCODING_ZIPLIST);
+    ptr = ziplistNew();
+    if (!ptr) {
+      CutisOom("SetTypeConvert");
+    }
+  }
+
+  SetTypeInitIterator(&si, set);
+  while (SetTypeNext(&si, &entry)) {
+    if (encoding == CUTIS_ENCODING_HT) {
+      CutisObject *el = CreateStringObject(entry.sval, entry.slen);
+      if (DictAdd(ptr, el, NULL) != DICT_OK) {
+        CutisOom("DictAdd");
+      }
+    } else {
+      ptr = ziplistPush(ptr, entry.sval, entry.slen, ZIPLIST_TAIL);
+      if (!ptr) {
+        CutisOom("ziplistPush");
+      }
+    }
+  }
+  SetTypeReleaseIterator(&si);
+
+  if (set->encoding == CUTIS_ENCODING_INTSET) {
+    intsetFree(set->ptr);
+  } else {
+    ziplistFree(set->ptr);
+  }
+  set->ptr = ptr;
+  set->encoding = encoding;
+}
+
+// Add value to the set, returns 1 if it was not already a member.
+int SetTypeAdd(CutisObject *set, sds value) {
+  CutisServer *server = GetSingletonServer();
+  size_t len = sdslen(value);
+  CutisObject *el;
+  long long ll;
+
+  if (set->encoding == CUTIS_ENCODING_INTSET) {
+    if (SetMemberToInteger(value, &ll)) {
+      int added;
+
+      set->ptr = intsetAdd(set->ptr, ll, &added);
+      if (!set->ptr) {
+        CutisOom("intsetAdd");
+      }
+      if (added && intsetLen(set->ptr) > server->set_max_intset_entries) {
+        SetTypeConvert(set, CUTIS_ENCODING_HT);
+      }
+      return added;
+    }
+    if (intsetLen(set->ptr) < server->set_max_ziplist_entries &&
+        len <= server->set_max_ziplist_value) {
+      SetTypeConvert(set, CUTIS_ENCODING_ZIPLIST);
+    } else {
+      SetTypeConvert(set, CUTIS_ENCODING_HT);
+    }
+  }
+
+  if (set->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *zl = set->ptr;
+
+    if (ziplistFind(zl, ziplistIndex(zl, 0), value, len, 0)) {
+      return 0;
+    }
+    if (ziplistLen(zl) < server->set_max_ziplist_entries &&
+        len <= server->set_max_ziplist_value) {
+      set->ptr = ziplistPush(zl, value, len, ZIPLIST_TAIL);
+      if (!set->ptr) {
+        CutisOom("ziplistPush");
+      }
+      return 1;
+    }
+    SetTypeConvert(set, CUTIS_ENCODING_HT);
+  }
+
+  el = CreateStringObject(value, len);
+  if (DictAdd(set->ptr, el, NULL) == DICT_OK) {
+    return 1;
+  }
+  DecrRefCount(el);
+  return 0;
+}
+
+// Remove value from the set, returns 1 if it was a member.
+int SetTypeRemove(CutisObject *set, sds value) {
+  long long ll;
+
+  if (set->encoding == CUTIS_ENCODING_INTSET) {
+    int removed = 0;
+
+    if (SetMemberToInteger(value, &ll)) {
+      set->ptr = intsetRemove(set->ptr, ll, &removed);
+      if (!set->ptr) {
+        CutisOom("intsetRemove");
+      }
+    }
+    return removed;
+  } else if (set->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *zl = set->ptr;
+    unsigned char *p = ziplistFind(zl, ziplistIndex(zl, 0), value,
+                                   sdslen(value), 0);
+
+    if (p == NULL) {
+      return 0;
+    }
+    set->ptr = ziplistDelete(zl, &p);
+    if (!set->ptr) {
+      CutisOom("ziplistDelete");
+    }
+    return 1;
+  } else {
+    CutisObject key;
+
+    key.ptr = value;
+    return DictDelete(set->ptr, &key) == DICT_OK;
+  }
+}
+
+int SetTypeIsMember(CutisObject *set, sds value) {
+  long long ll;
+
+  if (set->encoding == CUTIS_ENCODING_INTSET) {
+    return SetMemberToInteger(value, &ll) && intsetFind(set->ptr, ll);
+  } else if (set->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *zl = set->ptr;
+    return ziplistFind(zl, ziplistIndex(zl, 0), value, sdslen(value), 0) !=
+           NULL;
+  } else {
+    CutisObject key;
+
+    key.ptr = value;
+    return DictFind(set->ptr, &key) != NULL;
+  }
+}
+
+unsigned long SetTypeSize(CutisObject *set) {
+  if (set->encoding == CUTIS_ENCODING_INTSET) {
+    return intsetLen(set->ptr);
+  } else if (set->encoding == CUTIS_ENCODING_ZIPLIST) {
+    return ziplistLen(set->ptr);
+  }
+  return DictGetHashTableUsed(set->ptr);
+}
+
+void SetTypeInitIterator(SetTypeIterator *si, CutisObject *set) {
+  si->subject = set;
+  si->ii = 0;
+  si->zi = NULL;
+  si->di = NULL;
+  if (set->encoding == CUTIS_ENCODING_ZIPLIST) {
+    si->zi = ziplistIndex(set->ptr, 0);
+  } else if (set->encoding == CUTIS_ENCODING_HT) {
+    si->di = DictGetIterator(set->ptr);
+    if (!si->di) {
+      CutisOom("DictGetIterator");
+    }
+  }
+}
+
+// Store the next member in entry, returns 0 when there are no more.
+int SetTypeNext(SetTypeIterator *si, SetTypeEntry *entry) {
+  CutisObject *set = si->subject;
+
+  if (set->encoding == CUTIS_ENCODING_INTSET) {
+    int64_t value;
+
+    if (!intsetGet(set->ptr, si->ii++, &value)) {
+      return 0;
+    }
+    entry->slen = snprintf(entry->buf, sizeof(entry->buf), "%lld",
+                           (long long)value);
+    entry->sval = entry->buf;
+  } else if (set->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *s;
+
+    if (si->zi == NULL) {
+      return 0;
+    }
+    ziplistGet(si->zi, &s, &entry->slen);
+    entry->sval = (char *)s;
+    si->zi = ziplistNext(set->ptr, si->zi);
+  } else {
+    DictEntry *de = DictNext(si->di);
+    CutisObject *el;
+
+    if (de == NULL) {
+      return 0;
+    }
+    el = DictGetEntryKey(de);
+    entry->sval = el->ptr;
+    entry->slen = sdslen(el->ptr);
+  }
+  return 1;
+}
+
+void SetTypeReleaseIterator(SetTypeIterator *si) {
+  if (si->di) {
+    DictReleaseIterator(si->di);
+  }
+}
+
+CutisObject *CreateZsetObject() {
+  Zset *zs = zmalloc(sizeof(*zs));
+  CutisObject *o;
+
+  if (!zs) {
+    CutisOom("CreateZsetObject");
+  }
+  zs->dict = DictCreate(&ZsetDictType, NULL);
+  zs->zsl = zslCreate();
+  if (!zs->dict || !zs->zsl) {
+    CutisOom("CreateZsetObject");
+  }
+  o = CreateCutisObject(CUTIS_ZSET, zs);
+  o->encoding = CUTIS_ENCODING_SKIPLIST;
+  return o;
+}
+
+// Add ele with score, or update its score. The member is copied. Returns
+// 1 if it was added, 0 if it was already in the sorted set.
+int ZsetTypeAdd(CutisObject *zobj, double score, sds ele) {
+  Zset *zs = zobj->ptr;
+  DictEntry *de = DictFind(zs->dict, ele);
+  SkiplistNode *node;
+  double curscore;
+  int added = 1;
+
+  if (de) {
+    curscore = *(double *)DictGetEntryVal(de);
+    if (curscore == score) {
+      return 0;
+    }
+    // The skiplist frees the member the dict points to, so the dict
+    // entry goes first.
+    DictDelete(zs->dict, ele);
+    zslDelete(zs->zsl, curscore, ele);
+    added = 0;
+  }
+  node = zslInsert(zs->zsl, score, sdsdup(ele));
+  if (!node || DictAdd(zs->dict, node->ele, &node->score) != DICT_OK) {
+    CutisOom("ZsetTypeAdd");
+  }
+  return added;
+}
+
+// Returns 0 if ele is not in the sorted set.
+int ZsetTypeRemove(CutisObject *zobj, sds ele) {
+  Zset *zs = zobj->ptr;
+  DictEntry *de = DictFind(zs->dict, ele);
+  double score;
+
+  if (!de) {
+    return 0;
+  }
+  score = *(double *)DictGetEntryVal(de);
+  DictDelete(zs->dict, ele);
+  zslDelete(zs->zsl, score, ele);
+  return 1;
+}
+
+// Returns 0 if ele is not in the sorted set.
+int ZsetTypeScore(CutisObject *zobj, sds ele, double *score) {
+  Zset *zs = zobj->ptr;
+  DictEntry *de = DictFind(zs->dict, ele);
+
+  if (!de) {
+    return 0;
+  }
+  *score = *(double *)DictGetEntryVal(de);
+  return 1;
+}
+
+unsigned long ZsetTypeLength(CutisObject *zobj) {
+  return ((Zset *)zobj->ptr)->zsl->length;
+}
+
+// Small hashes are ziplists of fields each followed by its value.
+CutisObject *CreateHashObject() {
+  unsigned char *zl = ziplistNew();
+  CutisObject *o;
+
+  if (!zl) {
+    CutisOom("CreateHashObject");
+  }
+  o = CreateCutisObject(CUTIS_HASH, zl);
+  o->encoding = CUTIS_ENCODING_ZIPLIST;
+  return o;
+}
+
+void HashTypeConvert(CutisObject *o, int encoding) {
+  HashTypeIterator hi;
+  HashTypeEntry entry;
+  Dict *d;
+
+  assert(o->encoding == CUTIS_ENCODING_ZIPLIST &&
+         encoding == CUTIS_ENCODING_HT);
+  d = DictCreate(&HashDictType, NULL);
+  if (!d || DictExpand(d, HashTypeLength(o)) != DICT_OK) {
+    CutisOom("HashTypeConvert");
+  }
+  HashTypeInitIterator(&hi, o);
+  while (HashTypeNext(&hi, &entry)) {
+    DictAdd(d, sdsnewlen(entry.field, entry.flen),
+            sdsnewlen(entry.value, entry.vlen));
+  }
+  HashTypeReleaseIterator(&hi);
+  ziplistFree(o->ptr);
+  o->ptr = d;
+  o->encoding = CUTIS_ENCODING_HT;
+}
+
+// The value next to field in a ziplist hash, NULL if field is missing.
+static unsigned char *HashZiplistFindValue(unsigned char *zl, sds field) {
+  unsigned char *fptr = ziplistFind(zl, ziplistIndex(zl, 0), field,
+                                    sdslen(field), 1);
+  return fptr ? ziplistNext(zl, fptr) : NULL;
+}
+
+// Set field to value, both are copied. Returns 1 if field is new.
+int HashTypeSet(CutisObject *o, sds field, sds value) {
+  CutisServer *server = GetSingletonServer();
+  DictEntry *de;
+
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    if (sdslen(field) > server->hash_max_ziplist_value ||
+        sdslen(value) > server->hash_max_ziplist_value) {
+      HashTypeConvert(o, CUTIS_ENCODING_HT);
+    } else {
+      unsigned char *zl = o->ptr;
+      unsigned char *vptr = HashZiplistFindValue(zl, field);
+
+      if (vptr) {
+        o->ptr = ziplistReplace(zl, vptr, value, sdslen(value));
+        if (!o->ptr) {
+          CutisOom("ziplistReplace");
+        }
+        return 0;
+      }
+      zl = ziplistPush(zl, field, sdslen(field), ZIPLIST_TAIL);
+      if (zl) {
+        zl = ziplistPush(zl, value, sdslen(value), ZIPLIST_TAIL);
+      }
+      if (!zl) {
+        CutisOom("ziplistPush");
+      }
+      o->ptr = zl;
+      if (ziplistLen(zl) / 2 > server->hash_max_ziplist_entries) {
+        HashTypeConvert(o, CUTIS_ENCODING_HT);
+      }
+      return 1;
+    }
+  }
+
+  de = DictFind(o->ptr, field);
+  if (de) {
+    DictFreeEntryVal(o->ptr, de);
+    DictSetHashVal(o->ptr, de, sdsdup(value));
+    return 0;
+  }
+  DictAdd(o->ptr, sdsdup(field), sdsdup(value));
+  return 1;
+}
+
+// Store the value of field in entry, returns 0 if field is missing.
+int HashTypeGet(CutisObject *o, sds field, HashTypeEntry *entry) {
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *vptr = HashZiplistFindValue(o->ptr, field);
+    unsigned char *s;
+
+    if (!vptr) {
+      return 0;
+    }
+    ziplistGet(vptr, &s, &entry->vlen);
+    entry->value = (char *)s;
+  } else {
+    DictEntry *de = DictFind(o->ptr, field);
+    sds value;
+
+    if (!de) {
+      return 0;
+    }
+    value = DictGetEntryVal(de);
+    entry->value = value;
+    entry->vlen = sdslen(value);
+  }
+  entry->field = field;
+  entry->flen = sdslen(field);
+  return 1;
+}
+
+// Returns 1 if field was deleted, 0 if it was missing.
+int HashTypeDelete(CutisObject *o, sds field) {
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *zl = o->ptr;
+    unsigned char *fptr = ziplistFind(zl, ziplistIndex(zl, 0), field,
+                                      sdslen(field), 1);
+
+    if (!fptr) {
+      return 0;
+    }
+    // Delete the field, then the value that took its place.
+    zl = ziplistDelete(zl, &fptr);
+    if (zl) {
+      zl = ziplistDelete(zl, &fptr);
+    }
+    if (!zl) {
+      CutisOom("ziplistDelete");
+    }
+    o->ptr = zl;
+    return 1;
+  }
+  return DictDelete(o->ptr, field) == DICT_OK;
+}
+
+unsigned long HashTypeLength(CutisObject *o) {
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    return ziplistLen(o->ptr) / 2;
+  }
+  return DictGetHashTableUsed(o->ptr);
+}
+
+void HashTypeInitIterator(HashTypeIterator *hi, CutisObject *o) {
+  hi->subject = o;
+  hi->fptr = NULL;
+  hi->di = NULL;
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    hi->fptr = ziplistIndex(o->ptr, 0);
+  } else {
+    hi->di = DictGetIterator(o->ptr);
+    if (!hi->di) {
+      CutisOom("DictGetIterator");
+    }
+  }
+}
+
+// Store the next field and value in entry, returns 0 when there are no
+// more.
+int HashTypeNext(HashTypeIterator *hi, HashTypeEntry *entry) {
+  CutisObject *o = hi->subject;
+
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    unsigned char *vptr, *s;
+
+    if (hi->fptr == NULL) {
+      return 0;
+    }
+    vptr = ziplistNext(o->ptr, hi->fptr);
+    ziplistGet(hi->fptr, &s, &entry->flen);
+    entry->field = (char *)s;
+    ziplistGet(vptr, &s, &entry->vlen);
+    entry->value = (char *)s;
+    hi->fptr = ziplistNext(o->ptr, vptr);
+  } else {
+    DictEntry *de = DictNext(hi->di);
+    sds field, value;
+
+    if (de == NULL) {
+      return 0;
+    }
+    field = DictGetEntryKey(de);
+    value = DictGetEntryVal(de);
+    entry->field = field;
+    entry->flen = sdslen(field);
+    entry->value = value;
+    entry->vlen = sdslen(value);
+  }
+  return 1;
+}
+
+void HashTypeReleaseIterator(HashTypeIterator *hi) {
+  if (hi->di) {
+    DictReleaseIterator(hi->di);
+  }
 }
 
 void FreeStringObject(CutisObject *o) {
-  sdsfree(o->ptr);
+  if (o->encoding == CUTIS_ENCODING_RAW) {
+    sdsfree(o->ptr);
+  }
 }
 
 void FreeListObject(CutisObject *o) {
-  listRelease(o->ptr);
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    ziplistFree(o->ptr);
+  } else {
+    quicklistRelease(o->ptr);
+  }
 }
 
 void FreeSetObject(CutisObject *o) {
-  DictRelease(o->ptr);
+  if (o->encoding == CUTIS_ENCODING_INTSET) {
+    intsetFree(o->ptr);
+  } else if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    ziplistFree(o->ptr);
+  } else {
+    DictRelease(o->ptr);
+  }
+}
+
+void FreeZsetObject(CutisObject *o) {
+  Zset *zs = o->ptr;
+
+  DictRelease(zs->dict);
+  zslFree(zs->zsl);
+  zfree(zs);
+}
+
+void FreeHashObject(CutisObject *o) {
+  if (o->encoding == CUTIS_ENCODING_ZIPLIST) {
+    ziplistFree(o->ptr);
+  } else {
+    DictRelease(o->ptr);
+  }
 }
 
 void IncrRefCount(CutisObject *o) {
@@ -102,7 +985,6 @@ void IncrRefCount(CutisObject *o) {
 
 void DecrRefCount(CutisObject *o) {
   if (--(o->refcount) == 0) {
-    CutisServer *s = GetSingletonServer();
     switch (o->type) {
     case CUTIS_STRING:
       FreeStringObject(o);
@@ -113,12 +995,20 @@ void DecrRefCount(CutisObject *o) {
     case CUTIS_SET:
       FreeSetObject(o);
       break;
+    case CUTIS_ZSET:
+      FreeZsetObject(o);
+      break;
+    case CUTIS_HASH:
+      FreeHashObject(o);
+      break;
     default:
       assert(0);
       break;
     }
-    if (!listAddNodeHead(s->free_objs, o)) {
-      zfree(o);
+    if (o->encoding == CUTIS_ENCODING_EMBSTR) {
+      slab_free(o, EMBSTR_ALLOC_SIZE(sdslen(o->ptr)));
+    } else {
+      slab_free(o, sizeof(*o));
     }
   }
 }
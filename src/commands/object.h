@@ -21,16 +21,47 @@
 #ifndef COMMANDS_OBJECT_H_
 #define COMMANDS_OBJECT_H_
 
+#include <stddef.h>
+
+#include "data_struct/dict.h"
+#include "data_struct/quicklist.h"
+#include "data_struct/sds.h"
+#include "data_struct/skiplist.h"
+
 // Object types.
 #define CUTIS_STRING      0
 #define CUTIS_LIST        1
 #define CUTIS_SET         2
+#define CUTIS_ZSET        3
+#define CUTIS_HASH        4
+
+// Object encodings.
+#define CUTIS_ENCODING_RAW  0  // ptr is a sds
+#define CUTIS_ENCODING_INT  1  // ptr holds a long, for integer strings
+#define CUTIS_ENCODING_EMBSTR  2  // ptr is a sds allocated with the object
+#define CUTIS_ENCODING_QUICKLIST  3  // ptr is a Quicklist, see quicklist.h
+#define CUTIS_ENCODING_HT  5  // ptr is a Dict
+#define CUTIS_ENCODING_INTSET  6  // ptr is an Intset, see intset.h
+#define CUTIS_ENCODING_ZIPLIST  4  // ptr is a ziplist, see ziplist.h
+#define CUTIS_ENCODING_SKIPLIST  7  // ptr is a Zset
+
+// List ends.
+#define CUTIS_HEAD        0
+#define CUTIS_TAIL        1
+
+// Strings up to this length are stored as CUTIS_ENCODING_EMBSTR, so the
+// object, the sds header and the data fit a 64 bytes allocation.
+#define CUTIS_EMBSTR_SIZE_LIMIT  44
+
+#define CUTIS_LRU_BITS  24
 
 // A cutis object, that holds a string
 typedef struct CutisObject {
-  int type;
-  void *ptr;
+  unsigned type:4;
+  unsigned encoding:4;
+  unsigned lru:CUTIS_LRU_BITS;  // access clock for eviction, see evict.h
   int refcount;
+  void *ptr;
 } CutisObject;
 
 // Shared objects.
@@ -47,13 +78,110 @@ typedef struct SharedObject {
 
 extern SharedObject shared;
 
+// An element of a list. The value points inside the list, it is only
+// valid until the list is modified.
+typedef struct ListTypeEntry {
+  unsigned char *sval;
+  unsigned int slen;
+} ListTypeEntry;
+
+// Iterates a list of any encoding. The list must not be modified while
+// iterating.
+typedef struct ListTypeIterator {
+  CutisObject *subject;
+  int direction;      // CUTIS_TAIL walks from head to tail
+  unsigned char *zi;  // next entry of a ziplist
+  QuicklistIter qi;   // or position in a quicklist
+} ListTypeIterator;
+
 CutisObject *CreateCutisObject(int type, void *ptr);
-void ReleaseCutisObject(CutisObject *o);
+CutisObject *CreateEmbeddedStringObject(const char *ptr, size_t len);
+CutisObject *CreateStringObject(const char *ptr, size_t len);
+CutisObject *CreateStringObjectFromLongLong(long long value);
+CutisObject *TryObjectEncoding(CutisObject *o);
+long long GetLongLongFromStringObject(CutisObject *o);
+int StringObjectToBuffer(CutisObject *o, char *buf, size_t len);
 CutisObject *CreateListObject();
 CutisObject *CreateSetObject();
+CutisObject *CreateIntsetObject();
+CutisObject *CreateSmallSetObject();
+CutisObject *CreateZsetObject();
+CutisObject *CreateHashObject();
+// A member of a set. The value points inside the set or to buf, it is
+// only valid until the set is modified.
+typedef struct SetTypeEntry {
+  char *sval;
+  unsigned int slen;
+  char buf[32];  // integers of an intset are formatted here
+} SetTypeEntry;
+
+// Iterates a set of any encoding. The set must not be modified while
+// iterating.
+typedef struct SetTypeIterator {
+  CutisObject *subject;
+  unsigned int ii;    // next position in an intset
+  unsigned char *zi;  // next entry of a ziplist
+  DictIterator *di;   // or iterator of a hash table
+} SetTypeIterator;
+
+// A sorted set. The skiplist orders the members by score, the dict maps
+// every member to its score, both share the member sds.
+typedef struct Zset {
+  Dict *dict;
+  Skiplist *zsl;
+} Zset;
+
+// A field and its value in a hash. They point inside the hash, they are
+// only valid until the hash is modified.
+typedef struct HashTypeEntry {
+  char *field;
+  unsigned int flen;
+  char *value;
+  unsigned int vlen;
+} HashTypeEntry;
+
+// Iterates a hash of any encoding. The hash must not be modified while
+// iterating.
+typedef struct HashTypeIterator {
+  CutisObject *subject;
+  unsigned char *fptr;  // next field of a ziplist
+  DictIterator *di;     // or iterator of a hash table
+} HashTypeIterator;
+unsigned long ListTypeLength(CutisObject *o);
+void ListTypePush(CutisObject *o, CutisObject *value, int where);
+CutisObject *ListTypePop(CutisObject *o, int where);
+int ListTypeReplace(CutisObject *o, int index, CutisObject *value);
+void ListTypeTrim(CutisObject *o, int ltrim, int rtrim);
+void ListTypeInitIterator(ListTypeIterator *li, CutisObject *o, int index,
+                          int direction);
+int ListTypeNext(ListTypeIterator *li, ListTypeEntry *entry);
+void ListTypeConvert(CutisObject *o, int encoding);
+CutisObject *SetTypeCreate(sds value);
+int SetTypeAdd(CutisObject *set, sds value);
+int SetTypeRemove(CutisObject *set, sds value);
+int SetTypeIsMember(CutisObject *set, sds value);
+unsigned long SetTypeSize(CutisObject *set);
+void SetTypeConvert(CutisObject *set, int encoding);
+void SetTypeInitIterator(SetTypeIterator *si, CutisObject *set);
+int SetTypeNext(SetTypeIterator *si, SetTypeEntry *entry);
+void SetTypeReleaseIterator(SetTypeIterator *si);
+int ZsetTypeAdd(CutisObject *zobj, double score, sds ele);
+int ZsetTypeRemove(CutisObject *zobj, sds ele);
+int ZsetTypeScore(CutisObject *zobj, sds ele, double *score);
+unsigned long ZsetTypeLength(CutisObject *zobj);
+int HashTypeSet(CutisObject *o, sds field, sds value);
+int HashTypeGet(CutisObject *o, sds field, HashTypeEntry *entry);
+int HashTypeDelete(CutisObject *o, sds field);
+unsigned long HashTypeLength(CutisObject *o);
+void HashTypeConvert(CutisObject *o, int encoding);
+void HashTypeInitIterator(HashTypeIterator *hi, CutisObject *o);
+int HashTypeNext(HashTypeIterator *hi, HashTypeEntry *entry);
+void HashTypeReleaseIterator(HashTypeIterator *hi);
 void FreeStringObject(CutisObject *o);
 void FreeListObject(CutisObject *o);
 void FreeSetObject(CutisObject *o);
+void FreeZsetObject(CutisObject *o);
+void FreeHashObject(CutisObject *o);
 void IncrRefCount(CutisObject *o);
 void DecrRefCount(CutisObject *o);
 
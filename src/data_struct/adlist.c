@@ -20,6 +20,7 @@
 
 #include "data_struct/adlist.h"
 
+#include "memory/slab.h"
 #include "memory/zmalloc.h"
 
 List *listCreate() {
@@ -47,7 +48,7 @@ void listRelease(List *list) {
     if (list->free) {
       list->free(current->value);
     }
-    zfree(current);
+    slab_free(current, sizeof(*current));
     current = next;
   }
   zfree(list);
@@ -56,7 +57,7 @@ void listRelease(List *list) {
 List *listAddNodeHead(List *list, void *value) {
   ListNode *node;
 
-  if ((node = zmalloc(sizeof(*node))) == NULL) {
+  if ((node = slab_alloc(sizeof(*node))) == NULL) {
     return NULL;
   }
   node->value = value;
@@ -78,7 +79,7 @@ List *listAddNodeHead(List *list, void *value) {
 List *listAddNodeTail(List *list, void *value) {
   ListNode *node;
 
-  if ((node = zmalloc(sizeof(*node))) == NULL) {
+  if ((node = slab_alloc(sizeof(*node))) == NULL) {
     return NULL;
   }
 
@@ -114,7 +115,7 @@ void listDelNode(List *list, ListNode *node) {
   if (list->free) {
     list->free(node->value);
   }
-  zfree(node);
+  slab_free(node, sizeof(*node));
   list->len--;
 }
 
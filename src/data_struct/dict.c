@@ -21,13 +21,22 @@
 #include "data_struct/dict.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
+#include "memory/slab.h"
 #include "memory/zmalloc.h"
 
+#if defined(__GNUC__)
+#define DictPrefetch(addr) __builtin_prefetch(addr)
+#else
+#define DictPrefetch(addr) ((void)(addr))
+#endif
+
 void DictFreeEntryVal(Dict *ht, DictEntry *entry) {
   if (ht->type->valDestructor) {
     ht->type->valDestructor(ht->priv_data, entry->val);
@@ -77,11 +86,15 @@ void *DictGetEntryVal(DictEntry *he) {
 }
 
 unsigned int DictGetHashTableSize(Dict *ht) {
-  return ht->size;
+  return ht->ht[0].size + ht->ht[1].size;
 }
 
 unsigned int DictGetHashTableUsed(Dict *ht) {
-  return ht->used;
+  return ht->ht[0].used + ht->ht[1].used;
+}
+
+int DictIsRehashing(Dict *ht) {
+  return ht->rehash_idx != -1;
 }
 
 // Utility functions
@@ -113,7 +126,8 @@ static int _DictExpandIfNeeded(Dict *ht);
 static unsigned int _DictNextPower(unsigned int size);
 static int _DictKeyIndex(Dict *ht, const void *key);
 static int _DictInit(Dict *ht, DictType *type, void *priv_data);
-static void _DictReset(Dict *ht);
+static void _DictReset(DictHashTable *ht);
+static void _DictRehashStep(Dict *ht);
 
 // hash functions
 // Thomas Wang's 32 bit Mix Function
@@ -142,6 +156,15 @@ unsigned int DictGenHashFunction(const unsigned char *buf, int len) {
   return hash;
 }
 
+// Case-insensitive version of DictGenHashFunction().
+unsigned int DictGenCaseHashFunction(const unsigned char *buf, int len) {
+  unsigned int hash = 5381;
+  while (len--) {
+    hash = ((hash << 5) + hash) + tolower(*buf++);  // hash * 33 + c
+  }
+  return hash;
+}
+
 // API
 
 // Create a new hash table
@@ -151,65 +174,132 @@ Dict *DictCreate(DictType *type, void *priv_data) {
   return ht;
 }
 
-// Expand or create the hash table
+// Expand or create the hash table. If the table already holds elements
+// a second table is allocated and the elements are moved to it
+// incrementally, see DictRehash().
 int DictExpand(Dict *ht, unsigned int size) {
-  Dict n;
+  DictHashTable n;
   unsigned int real_size = _DictNextPower(size);
-  unsigned int i;
 
   // The size is invalid if it is smaller than the number of
-  // elements already inside the hast table.
-  if (ht->used > size) {
+  // elements already inside the hast table, or if we are
+  // already rehashing.
+  if (DictIsRehashing(ht) || ht->ht[0].used > size) {
     return DICT_ERR;
   }
 
-  _DictInit(&n, ht->type, ht->priv_data);
   n.size = real_size;
   n.size_mask = real_size - 1;
   n.table = _DictAlloc(real_size * sizeof(DictEntry*));
+  n.used = 0;
 
   // Initialize all the pointer to NULL
   memset(n.table, 0, real_size * sizeof(DictEntry*));
 
-  // Copy all the elements from the old to the new table.
-  // If the old hash table is empty, ht->size is zero,
-  // so DictExpand just creates a hash table.
-  n.used = ht->used;
-  for (i = 0; i < ht->size && ht->used > 0; i++) {
+  // Is this the first initialization? If so it's not really a rehashing
+  // we just set the first hash table so that it can accept keys.
+  if (ht->ht[0].table == NULL) {
+    ht->ht[0] = n;
+    return DICT_OK;
+  }
+
+  // Prepare a second hash table for incremental rehashing
+  ht->ht[1] = n;
+  ht->rehash_idx = 0;
+  return DICT_OK;
+}
+
+// Performs N steps of incremental rehashing. Returns 1 if there are still
+// keys to move from the old to the new hash table, otherwise 0 is returned.
+// Note that a rehashing step consists in moving a bucket (that may have more
+// than one key as we use chaining) from the old to the new hash table.
+// Since part of the table may be composed of empty buckets, at most n*10
+// empty buckets are visited per call, to bound the time spent.
+int DictRehash(Dict *ht, int n) {
+  int empty_visits = n * 10;
+
+  if (!DictIsRehashing(ht)) {
+    return 0;
+  }
+
+  while (n-- && ht->ht[0].used != 0) {
     DictEntry *he;
     DictEntry *next_he;
 
-    if (ht->table[i] == NULL) {
-      continue;
+    // Note that rehash_idx can't overflow as we are sure there are more
+    // elements because ht[0].used != 0
+    assert(ht->ht[0].size > (unsigned)ht->rehash_idx);
+    while (ht->ht[0].table[ht->rehash_idx] == NULL) {
+      ht->rehash_idx++;
+      if (--empty_visits == 0) {
+        return 1;
+      }
     }
-
-    // For each hast table entry on this slot...
-    he = ht->table[i];
+    he = ht->ht[0].table[ht->rehash_idx];
+    // Move all the keys in this bucket from the old to the new hash table
     while (he) {
       unsigned int h;
-      next_he = he->next;
 
-      // Get the new element index
-      h = DictHashKey(ht, he->key) & n.size_mask;
-      he->next = n.table[h];
-      n.table[h] = he;
-      ht->used--;
-      // Pass to the next element
+      next_he = he->next;
+      // Get the index in the new hash table
+      h = DictHashKey(ht, he->key) & ht->ht[1].size_mask;
+      he->next = ht->ht[1].table[h];
+      ht->ht[1].table[h] = he;
+      ht->ht[0].used--;
+      ht->ht[1].used++;
       he = next_he;
     }
+    ht->ht[0].table[ht->rehash_idx] = NULL;
+    ht->rehash_idx++;
   }
-  assert(ht->used == 0);
-  _DictFree(ht->table);
 
-  // Remap the new hash table in the old
-  *ht = n;
-  return DICT_OK;
+  // Check if we already rehashed the whole table...
+  if (ht->ht[0].used == 0) {
+    _DictFree(ht->ht[0].table);
+    ht->ht[0] = ht->ht[1];
+    _DictReset(&ht->ht[1]);
+    ht->rehash_idx = -1;
+    return 0;
+  }
+
+  // More to rehash...
+  return 1;
+}
+
+static long long _DictTimeInMilliseconds() {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (((long long)tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
+}
+
+// Rehash for an amount of time between ms milliseconds and ms+1
+// milliseconds. Returns the number of buckets steps performed.
+int DictRehashMilliseconds(Dict *ht, int ms) {
+  long long start = _DictTimeInMilliseconds();
+  int rehashes = 0;
+
+  if (ht->iterators != 0) {
+    return 0;
+  }
+  while (DictRehash(ht, 100)) {
+    rehashes += 100;
+    if (_DictTimeInMilliseconds() - start > ms) {
+      break;
+    }
+  }
+  return rehashes;
 }
 
 // Add an element to the target hast table
 int DictAdd(Dict *ht, void *key, void *val) {
   int index;
   DictEntry *entry;
+  DictHashTable *t;
+
+  if (DictIsRehashing(ht)) {
+    _DictRehashStep(ht);
+  }
 
   // Get the index of the new element, or -1 if
   // the element already exists.
@@ -217,15 +307,20 @@ int DictAdd(Dict *ht, void *key, void *val) {
     return DICT_ERR;
   }
 
-  // Allocates the memory and stores the key
-  entry = _DictAlloc(sizeof(*entry));
-  entry->next = ht->table[index];
-  ht->table[index] = entry;
+  // Allocates the memory and stores the key. If we are rehashing,
+  // new elements always go to the new table.
+  t = DictIsRehashing(ht) ? &ht->ht[1] : &ht->ht[0];
+  entry = slab_alloc(sizeof(*entry));
+  if (entry == NULL) {
+    _DictPanic("Out of memory");
+  }
+  entry->next = t->table[index];
+  t->table[index] = entry;
+  t->used++;
 
   // Set the hash entry fields
   DictSetHashKey(ht, entry, key);
   DictSetHashVal(ht, entry, val);
-  ht->used++;
   return DICT_OK;
 }
 
@@ -250,35 +345,45 @@ int DictReplace(Dict *ht, void *key, void *val) {
 // Search and remove an element
 static int DictGenericDelete(Dict *ht, const void *key, int no_free) {
   unsigned int h;
-  DictEntry *he;
-  DictEntry *prev_he;
+  unsigned int hash;
+  int table;
 
-  if (ht->used == 0) {
+  if (DictGetHashTableUsed(ht) == 0) {
     return DICT_ERR;
   }
+  if (DictIsRehashing(ht)) {
+    _DictRehashStep(ht);
+  }
 
-  h = DictHashKey(ht, key) & ht->size_mask;
-  he = ht->table[h];
+  hash = DictHashKey(ht, key);
+  for (table = 0; table <= 1; table++) {
+    DictEntry *he;
+    DictEntry *prev_he = NULL;
 
-  prev_he = NULL;
-  while (he) {
-    if (DictCompareHashKeys(ht, key, he->key)) {
-      // Unlink the element from the list
-      if (prev_he) {
-        prev_he->next = he->next;
-      } else {
-        ht->table[h] = he->next;
-      }
-      if (!no_free) {
-        DictFreeEntryKey(ht, he);
-        DictFreeEntryVal(ht, he);
+    h = hash & ht->ht[table].size_mask;
+    he = ht->ht[table].table ? ht->ht[table].table[h] : NULL;
+    while (he) {
+      if (DictCompareHashKeys(ht, key, he->key)) {
+        // Unlink the element from the list
+        if (prev_he) {
+          prev_he->next = he->next;
+        } else {
+          ht->ht[table].table[h] = he->next;
+        }
+        if (!no_free) {
+          DictFreeEntryKey(ht, he);
+          DictFreeEntryVal(ht, he);
+        }
+        slab_free(he, sizeof(*he));
+        ht->ht[table].used--;
+        return DICT_OK;
       }
-      _DictFree(he);
-      ht->used--;
-      return DICT_OK;
+      prev_he = he;
+      he = he->next;
+    }
+    if (!DictIsRehashing(ht)) {
+      break;
     }
-    prev_he = he;
-    he = he->next;
   }
   return DICT_ERR;  // not found
 }
@@ -292,7 +397,7 @@ int DictDeleteNoFree(Dict *ht, const void *key) {
 }
 
 // Destroy an entire hash table
-static int _DictClear(Dict *ht) {
+static int _DictClear(Dict *d, DictHashTable *ht) {
   unsigned int i;
   // Free all the elements
   for (i = 0; i < ht->size && ht->used > 0; i++) {
@@ -304,9 +409,9 @@ static int _DictClear(Dict *ht) {
     }
     while (he) {
       next_he = he->next;
-      DictFreeEntryKey(ht, he);
-      DictFreeEntryVal(ht, he);
-      _DictFree(he);
+      DictFreeEntryKey(d, he);
+      DictFreeEntryVal(d, he);
+      slab_free(he, sizeof(*he));
       ht->used--;
       he = next_he;
     }
@@ -320,33 +425,82 @@ static int _DictClear(Dict *ht) {
 }
 
 void DictRelease(Dict *ht) {
-  _DictClear(ht);
+  _DictClear(ht, &ht->ht[0]);
+  _DictClear(ht, &ht->ht[1]);
   _DictFree(ht);
 }
 
 DictEntry *DictFind(Dict *ht, const void *key) {
+  return DictFindWithHash(ht, key, DictHashKey(ht, key));
+}
+
+// Like DictFind(), with hash being DictHashKey(ht, key).
+DictEntry *DictFindWithHash(Dict *ht, const void *key, unsigned int hash) {
   DictEntry *he;
   unsigned int h;
+  int table;
 
-  if (ht->used == 0) {
+  if (DictGetHashTableUsed(ht) == 0) {
     return NULL;
   }
+  if (DictIsRehashing(ht)) {
+    _DictRehashStep(ht);
+  }
 
-  h = DictHashKey(ht, key) & ht->size_mask;
-  he = ht->table[h];
-  while (he) {
-    if (DictCompareHashKeys(ht, key, he->key)) {
-      return he;
+  for (table = 0; table <= 1; table++) {
+    h = hash & ht->ht[table].size_mask;
+    he = ht->ht[table].table ? ht->ht[table].table[h] : NULL;
+    while (he) {
+      if (DictCompareHashKeys(ht, key, he->key)) {
+        return he;
+      }
+      he = he->next;
+    }
+    if (!DictIsRehashing(ht)) {
+      return NULL;
     }
-    he = he->next;
   }
   return NULL;
 }
 
+// Prefetch the bucket of hash in both tables. Issue it for a whole batch
+// of keys before DictPrefetchEntry(), then look the keys up.
+void DictPrefetchBucket(Dict *ht, unsigned int hash) {
+  int table;
+
+  for (table = 0; table <= 1; table++) {
+    if (ht->ht[table].table) {
+      DictPrefetch(&ht->ht[table].table[hash & ht->ht[table].size_mask]);
+    }
+  }
+}
+
+// Prefetch the first entry of the bucket of hash, once DictPrefetchBucket()
+// brought the bucket itself in the cache.
+void DictPrefetchEntry(Dict *ht, unsigned int hash) {
+  DictEntry *he;
+  int table;
+
+  for (table = 0; table <= 1; table++) {
+    if (ht->ht[table].table) {
+      he = ht->ht[table].table[hash & ht->ht[table].size_mask];
+      if (he) {
+        DictPrefetch(he);
+      }
+    }
+  }
+}
+
 // Resize the table to the minimal size that contains all the elements,
 // but with the invariant of a USE/BUCKETS ration near to <= 1.
+// The elements are moved to the new table incrementally.
 int DictResize(Dict *ht) {
-  unsigned int minimal = ht->used;
+  unsigned int minimal;
+
+  if (DictIsRehashing(ht)) {
+    return DICT_ERR;
+  }
+  minimal = ht->ht[0].used;
   if (minimal < DICT_HT_INITIAL_SIZE) {
     minimal = DICT_HT_INITIAL_SIZE;
   }
@@ -357,20 +511,29 @@ DictIterator *DictGetIterator(Dict *ht) {
   DictIterator *iter = _DictAlloc(sizeof(*iter));
 
   iter->ht = ht;
+  iter->table = 0;
   iter->index = -1;
   iter->entry = NULL;
   iter->next_entry = NULL;
+  ht->iterators++;
   return iter;
 }
 
 DictEntry *DictNext(DictIterator *iter) {
   while (1) {
     if (iter->entry == NULL) {
+      DictHashTable *ht = &iter->ht->ht[iter->table];
       iter->index++;
-      if (iter->index >= (signed)iter->ht->size) {
-        break;
+      if (iter->index >= (signed)ht->size) {
+        if (DictIsRehashing(iter->ht) && iter->table == 0) {
+          iter->table++;
+          iter->index = 0;
+          ht = &iter->ht->ht[1];
+        } else {
+          break;
+        }
       }
-      iter->entry = iter->ht->table[iter->index];
+      iter->entry = ht->table ? ht->table[iter->index] : NULL;
     } else {
       iter->entry = iter->next_entry;
     }
@@ -386,6 +549,7 @@ DictEntry *DictNext(DictIterator *iter) {
 }
 
 void DictReleaseIterator(DictIterator *iter) {
+  iter->ht->iterators--;
   _DictFree(iter);
 }
 
@@ -393,37 +557,134 @@ void DictReleaseIterator(DictIterator *iter) {
 // implement randomized algorithms
 DictEntry *DictGetRandomKey(Dict *ht) {
   DictEntry *he;
+  DictEntry *orig_he;
   unsigned int h;
   int list_len = 0;
   int list_ele;
 
-  if (ht->used == 0) {
+  if (DictGetHashTableUsed(ht) == 0) {
     return NULL;
   }
+  if (DictIsRehashing(ht)) {
+    _DictRehashStep(ht);
+  }
 
-  do {
-    h = random() & ht->size_mask;
-    he = ht->table[h];
-  } while (he == NULL);
+  if (DictIsRehashing(ht)) {
+    // Buckets of the old table below rehash_idx are empty, skip them.
+    do {
+      h = ht->rehash_idx + (random() % (ht->ht[0].size + ht->ht[1].size -
+                                        ht->rehash_idx));
+      he = (h >= ht->ht[0].size) ? ht->ht[1].table[h - ht->ht[0].size]
+                                 : ht->ht[0].table[h];
+    } while (he == NULL);
+  } else {
+    do {
+      h = random() & ht->ht[0].size_mask;
+      he = ht->ht[0].table[h];
+    } while (he == NULL);
+  }
 
   // Now we found a non-empty slot, but it is a linked list,
   // and we need to get a random element from the list.
   // The only sane way to do so is to count the element and
   // select a random index
+  orig_he = he;
   while (he) {
     he = he->next;
     list_len++;
   }
   list_ele = random() % list_len;
-  he = ht->table[h];
+  he = orig_he;
   while (list_ele--) {
     he = he->next;
   }
   return he;
 }
 
+// Reverse the bits of v, used to increment the scan cursor from the
+// most significant bit of the table mask.
+static unsigned long _DictReverseBits(unsigned long v) {
+  unsigned long s = 8 * sizeof(v);
+  unsigned long mask = ~0UL;
+  while ((s >>= 1) > 0) {
+    mask ^= (mask << s);
+    v = ((v >> s) & mask) | ((v << s) & ~mask);
+  }
+  return v;
+}
+
+// Call fn for every entry of the bucket of cursor v, and return the
+// cursor to pass to the next call, 0 when the scan is over.
+//
+// The cursor is incremented starting from its high bits, so the buckets
+// a bucket splits into when the table grows, or merges with when it
+// shrinks, are visited after it. Every element present for the whole
+// scan is returned at least once even if the table is resized between
+// calls, some may be returned twice. While rehashing, the bucket of the
+// small table is visited with all its expansions in the large one.
+//
+// fn must not add or delete entries.
+unsigned long DictScan(Dict *ht, unsigned long v, DictScanFunction *fn,
+                       void *priv_data) {
+  DictHashTable *t0, *t1;
+  DictEntry *de;
+  unsigned long m0, m1;
+
+  if (DictGetHashTableUsed(ht) == 0) {
+    return 0;
+  }
+
+  if (!DictIsRehashing(ht)) {
+    t0 = &ht->ht[0];
+    m0 = t0->size_mask;
+
+    for (de = t0->table[v & m0]; de != NULL; de = de->next) {
+      fn(priv_data, de);
+    }
+
+    // Set the bits above the mask, so incrementing the reversed cursor
+    // only touches the masked bits.
+    v |= ~m0;
+    v = _DictReverseBits(v);
+    v++;
+    v = _DictReverseBits(v);
+  } else {
+    t0 = &ht->ht[0];
+    t1 = &ht->ht[1];
+
+    // Make sure t0 is the smaller table.
+    if (t0->size > t1->size) {
+      t0 = &ht->ht[1];
+      t1 = &ht->ht[0];
+    }
+    m0 = t0->size_mask;
+    m1 = t1->size_mask;
+
+    for (de = t0->table[v & m0]; de != NULL; de = de->next) {
+      fn(priv_data, de);
+    }
+
+    // Visit the buckets of the larger table that are expansions of
+    // the bucket of the smaller one.
+    do {
+      for (de = t1->table[v & m1]; de != NULL; de = de->next) {
+        fn(priv_data, de);
+      }
+      // Increment the reversed cursor over the bits of the larger mask.
+      // When the bits not covered by the smaller mask wrap to zero the
+      // carry has already moved to the next bucket of the smaller table.
+      v |= ~m1;
+      v = _DictReverseBits(v);
+      v++;
+      v = _DictReverseBits(v);
+    } while (v & (m0 ^ m1));
+  }
+
+  return v;
+}
+
 #define DICT_STATS_VEC_LEN 50
-void DictPrintStats(Dict *ht) {
+static void _DictPrintStatsHt(DictHashTable *ht) {
   unsigned int i;
   unsigned int slots = 0;
   unsigned int max_chain_len = 0;
@@ -483,21 +744,49 @@ void DictPrintStats(Dict *ht) {
   }
 }
 
+void DictPrintStats(Dict *ht) {
+  _DictPrintStatsHt(&ht->ht[0]);
+  if (DictIsRehashing(ht)) {
+    fprintf(stdout, "-- Rehashing into ht[1]:\n");
+    _DictPrintStatsHt(&ht->ht[1]);
+  }
+}
+
 void DictEmpty(Dict *ht) {
-  _DictClear(ht);
+  _DictClear(ht, &ht->ht[0]);
+  _DictClear(ht, &ht->ht[1]);
+  ht->rehash_idx = -1;
 }
 
 // Private functions
 
+// This function performs just a step of rehashing, and only if there are
+// no iterators bound to our hash table. When we have iterators in the
+// middle of a rehashing we can't mess with the two hash tables otherwise
+// some element can be missed or duplicated.
+//
+// This function is called by common lookup or update operations in the
+// dictionary so that the hash table automatically migrates from H1 to H2
+// while it is actively used.
+static void _DictRehashStep(Dict *ht) {
+  if (ht->iterators == 0) {
+    DictRehash(ht, 1);
+  }
+}
+
 // Expand the hash table if needed
 static int _DictExpandIfNeeded(Dict *ht) {
+  // Incremental rehashing already in progress. Return.
+  if (DictIsRehashing(ht)) {
+    return DICT_OK;
+  }
   // If the hash table is empty expand it to the initial size,
   // if the table is "full", double its size.
-  if (ht->size == 0) {
+  if (ht->ht[0].size == 0) {
     return DictExpand(ht, DICT_HT_INITIAL_SIZE);
   }
-  if (ht->used == ht->size) {
-    return DictExpand(ht, ht->size * 2);
+  if (ht->ht[0].used >= ht->ht[0].size) {
+    return DictExpand(ht, ht->ht[0].used * 2);
   }
   return DICT_OK;
 }
@@ -520,8 +809,13 @@ static unsigned int _DictNextPower(unsigned int size) {
 // Returns the index of a free slot that can be populated with
 // a hash entry for the given 'key'. If the key already exists,
 // -1 is returned.
+//
+// Note that if we are in the process of rehashing the hash table, the
+// index is always returned in the context of the second (new) hash table.
 static int _DictKeyIndex(Dict *ht, const void *key) {
-  unsigned int h;
+  unsigned int h = 0;
+  unsigned int hash;
+  int table;
   DictEntry *he;
 
   // Expand the hash table if needed
@@ -529,28 +823,37 @@ static int _DictKeyIndex(Dict *ht, const void *key) {
     return -1;
   }
   // Compute the key hash value
-  h = DictHashKey(ht, key) & ht->size_mask;
-  // Search if this slot does not already contain the given key
-  he = ht->table[h];
-  while (he) {
-    if (DictCompareHashKeys(ht, key, he->key)) {
-      return -1;
+  hash = DictHashKey(ht, key);
+  for (table = 0; table <= 1; table++) {
+    h = hash & ht->ht[table].size_mask;
+    // Search if this slot does not already contain the given key
+    he = ht->ht[table].table[h];
+    while (he) {
+      if (DictCompareHashKeys(ht, key, he->key)) {
+        return -1;
+      }
+      he = he->next;
+    }
+    if (!DictIsRehashing(ht)) {
+      break;
     }
-    he = he->next;
   }
   return h;
 }
 
 // Initialize the hash table
 static int _DictInit(Dict *ht, DictType *type, void *priv_data) {
-  _DictReset(ht);
+  _DictReset(&ht->ht[0]);
+  _DictReset(&ht->ht[1]);
   ht->type = type;
   ht->priv_data = priv_data;
+  ht->rehash_idx = -1;
+  ht->iterators = 0;
   return DICT_OK;
 }
 
 // Reset a hash table
-static void _DictReset(Dict *ht) {
+static void _DictReset(DictHashTable *ht) {
   ht->table = NULL;
   ht->size = 0;
   ht->used = 0;
@@ -44,22 +44,36 @@ typedef struct DictType {
   void (*valDestructor)(void *priv_data, void *obj);
 } DictType;
 
-typedef struct Dict {
+// This is our hash table structure. Every dictionary has two of this as
+// we implement incremental rehashing, for the old to the new table.
+typedef struct DictHashTable {
   DictEntry **table;
-  DictType *type;
   unsigned int size;
   unsigned int size_mask;
   unsigned int used;
+} DictHashTable;
+
+typedef struct Dict {
+  DictType *type;
   void *priv_data;
+  DictHashTable ht[2];
+  int rehash_idx;  // rehashing not in progress if rehash_idx == -1
+  int iterators;   // number of iterators currently running
 } Dict;
 
+// While an iterator is alive, the dict does not perform rehashing steps,
+// so it's safe to call DictFind, DictAdd, DictDelete against the dict
+// while iterating.
 typedef struct DictIterator {
   Dict *ht;
+  int table;
   int index;
   DictEntry *entry;
   DictEntry *next_entry;
 } DictIterator;
 
+typedef void DictScanFunction(void *priv_data, const DictEntry *de);
+
 void DictFreeEntryVal(Dict *ht, DictEntry *entry);
 void DictSetHashVal(Dict *ht, DictEntry *entry, void *val);
 void DictFreeEntryKey(Dict *ht, DictEntry *entry);
@@ -70,6 +84,7 @@ void *DictGetEntryKey(DictEntry *he);
 void *DictGetEntryVal(DictEntry *he);
 unsigned int DictGetHashTableSize(Dict *ht);
 unsigned int DictGetHashTableUsed(Dict *ht);
+int DictIsRehashing(Dict *ht);
 
 // API
 Dict *DictCreate(DictType *type, void *priv_data);
@@ -80,14 +95,22 @@ int DictDelete(Dict *ht, const void *key);
 int DictDeleteNoFree(Dict *ht, const void *key);
 void DictRelease(Dict *ht);
 DictEntry *DictFind(Dict *ht, const void *key);
+DictEntry *DictFindWithHash(Dict *ht, const void *key, unsigned int hash);
+void DictPrefetchBucket(Dict *ht, unsigned int hash);
+void DictPrefetchEntry(Dict *ht, unsigned int hash);
 int DictResize(Dict *ht);
+int DictRehash(Dict *ht, int n);
+int DictRehashMilliseconds(Dict *ht, int ms);
 
 DictIterator *DictGetIterator(Dict *ht);
 DictEntry *DictNext(DictIterator *iter);
 void DictReleaseIterator(DictIterator *iter);
 DictEntry *DictGetRandomKey(Dict *ht);
+unsigned long DictScan(Dict *ht, unsigned long v, DictScanFunction *fn,
+                       void *priv_data);
 void DictPrintStats(Dict *ht);
 unsigned int DictGenHashFunction(const unsigned char *buf, int len);
+unsigned int DictGenCaseHashFunction(const unsigned char *buf, int len);
 void DictEmpty(Dict *ht);
 
 // Hash table types
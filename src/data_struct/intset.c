@@ -0,0 +1,227 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "data_struct/intset.h"
+
+#include <string.h>
+
+#include "memory/zmalloc.h"
+
+static uint8_t _intsetValueEncoding(int64_t v) {
+  if (v < INT32_MIN || v > INT32_MAX) {
+    return INTSET_ENC_INT64;
+  } else if (v < INT16_MIN || v > INT16_MAX) {
+    return INTSET_ENC_INT32;
+  }
+  return INTSET_ENC_INT16;
+}
+
+static int64_t _intsetGetEncoded(Intset *is, int pos, uint8_t enc) {
+  int64_t v64;
+  int32_t v32;
+  int16_t v16;
+
+  if (enc == INTSET_ENC_INT64) {
+    memcpy(&v64, ((int64_t *)is->contents) + pos, sizeof(v64));
+    return v64;
+  } else if (enc == INTSET_ENC_INT32) {
+    memcpy(&v32, ((int32_t *)is->contents) + pos, sizeof(v32));
+    return v32;
+  }
+  memcpy(&v16, ((int16_t *)is->contents) + pos, sizeof(v16));
+  return v16;
+}
+
+static int64_t _intsetGet(Intset *is, int pos) {
+  return _intsetGetEncoded(is, pos, is->encoding);
+}
+
+static void _intsetSet(Intset *is, int pos, int64_t value) {
+  uint32_t encoding = is->encoding;
+
+  if (encoding == INTSET_ENC_INT64) {
+    ((int64_t *)is->contents)[pos] = value;
+  } else if (encoding == INTSET_ENC_INT32) {
+    ((int32_t *)is->contents)[pos] = value;
+  } else {
+    ((int16_t *)is->contents)[pos] = value;
+  }
+}
+
+static Intset *intsetResize(Intset *is, uint32_t len) {
+  return zrealloc(is, sizeof(Intset) + (size_t)len * is->encoding);
+}
+
+// Search value, returns 1 if found. pos is set to the position of value,
+// or to the position where it should be inserted.
+static int intsetSearch(Intset *is, int64_t value, uint32_t *pos) {
+  int min = 0, max = is->length - 1, mid = -1;
+  int64_t cur = -1;
+
+  if (is->length == 0) {
+    if (pos) {
+      *pos = 0;
+    }
+    return 0;
+  }
+  // Values out of the range of the set are added at one end.
+  if (value > _intsetGet(is, max)) {
+    if (pos) {
+      *pos = is->length;
+    }
+    return 0;
+  } else if (value < _intsetGet(is, 0)) {
+    if (pos) {
+      *pos = 0;
+    }
+    return 0;
+  }
+
+  while (max >= min) {
+    mid = ((unsigned int)min + (unsigned int)max) >> 1;
+    cur = _intsetGet(is, mid);
+    if (value > cur) {
+      min = mid + 1;
+    } else if (value < cur) {
+      max = mid - 1;
+    } else {
+      break;
+    }
+  }
+
+  if (value == cur) {
+    if (pos) {
+      *pos = mid;
+    }
+    return 1;
+  }
+  if (pos) {
+    *pos = min;
+  }
+  return 0;
+}
+
+// Widen the integers to the encoding of value and add it, value is out of
+// the range of the set so it goes at one end.
+static Intset *intsetUpgradeAndAdd(Intset *is, int64_t value) {
+  uint8_t cur_enc = is->encoding;
+  uint8_t new_enc = _intsetValueEncoding(value);
+  int length = is->length;
+  int prepend = value < 0 ? 1 : 0;
+
+  is->encoding = new_enc;
+  is = intsetResize(is, is->length + 1);
+  if (is == NULL) {
+    return NULL;
+  }
+
+  // Go from the back so the integers are not overwritten.
+  while (length--) {
+    _intsetSet(is, length + prepend, _intsetGetEncoded(is, length, cur_enc));
+  }
+  if (prepend) {
+    _intsetSet(is, 0, value);
+  } else {
+    _intsetSet(is, is->length, value);
+  }
+  is->length++;
+  return is;
+}
+
+static void intsetMoveTail(Intset *is, uint32_t from, uint32_t to) {
+  uint32_t bytes = (is->length - from) * is->encoding;
+  memmove(is->contents + (size_t)to * is->encoding,
+          is->contents + (size_t)from * is->encoding, bytes);
+}
+
+Intset *intsetNew(void) {
+  Intset *is = zmalloc(sizeof(Intset));
+  if (is == NULL) {
+    return NULL;
+  }
+  is->encoding = INTSET_ENC_INT16;
+  is->length = 0;
+  return is;
+}
+
+void intsetFree(Intset *is) {
+  zfree(is);
+}
+
+// Add value, success is set to 0 if it was already there. Returns NULL
+// when out of memory.
+Intset *intsetAdd(Intset *is, int64_t value, int *success) {
+  uint32_t pos;
+
+  *success = 1;
+  if (_intsetValueEncoding(value) > is->encoding) {
+    return intsetUpgradeAndAdd(is, value);
+  }
+  if (intsetSearch(is, value, &pos)) {
+    *success = 0;
+    return is;
+  }
+  is = intsetResize(is, is->length + 1);
+  if (is == NULL) {
+    return NULL;
+  }
+  if (pos < is->length) {
+    intsetMoveTail(is, pos, pos + 1);
+  }
+  _intsetSet(is, pos, value);
+  is->length++;
+  return is;
+}
+
+// Remove value, success is set to 0 if it was not there. The encoding is
+// never downgraded.
+Intset *intsetRemove(Intset *is, int64_t value, int *success) {
+  uint32_t pos;
+
+  *success = 0;
+  if (_intsetValueEncoding(value) > is->encoding ||
+      !intsetSearch(is, value, &pos)) {
+    return is;
+  }
+  *success = 1;
+  if (pos < is->length - 1) {
+    intsetMoveTail(is, pos + 1, pos);
+  }
+  is->length--;
+  return intsetResize(is, is->length);
+}
+
+int intsetFind(Intset *is, int64_t value) {
+  return _intsetValueEncoding(value) <= is->encoding &&
+         intsetSearch(is, value, NULL);
+}
+
+// Store the integer at pos in value, returns 0 if pos is out of range.
+int intsetGet(Intset *is, uint32_t pos, int64_t *value) {
+  if (pos >= is->length) {
+    return 0;
+  }
+  *value = _intsetGet(is, pos);
+  return 1;
+}
+
+uint32_t intsetLen(const Intset *is) {
+  return is->length;
+}
@@ -0,0 +1,51 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DATA_STRUCT_INTSET_H_
+#define DATA_STRUCT_INTSET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A set of integers stored as a sorted array, searched with a binary
+// search. All the integers have the width of the largest one: the array
+// starts with 16 bits integers, and is upgraded to 32 or 64 bits when a
+// larger integer is added. Adding or removing an integer moves the ones
+// after it, so intsets are only meant for a few hundred integers.
+
+#define INTSET_ENC_INT16 (sizeof(int16_t))
+#define INTSET_ENC_INT32 (sizeof(int32_t))
+#define INTSET_ENC_INT64 (sizeof(int64_t))
+
+typedef struct Intset {
+  uint32_t encoding;  // bytes per integer, INTSET_ENC_*
+  uint32_t length;
+  int8_t contents[];
+} Intset;
+
+Intset *intsetNew(void);
+void intsetFree(Intset *is);
+Intset *intsetAdd(Intset *is, int64_t value, int *success);
+Intset *intsetRemove(Intset *is, int64_t value, int *success);
+int intsetFind(Intset *is, int64_t value);
+int intsetGet(Intset *is, uint32_t pos, int64_t *value);
+uint32_t intsetLen(const Intset *is);
+
+#endif  // DATA_STRUCT_INTSET_H_
@@ -0,0 +1,301 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "data_struct/quicklist.h"
+
+#include "data_struct/ziplist.h"
+#include "memory/slab.h"
+#include "memory/zmalloc.h"
+
+// Upper bound of the bytes a ziplist entry adds on top of its value.
+#define ZIP_ENTRY_OVERHEAD 10
+
+Quicklist *quicklistCreate(unsigned int fill) {
+  Quicklist *ql = zmalloc(sizeof(*ql));
+  if (ql == NULL) {
+    return NULL;
+  }
+  ql->head = NULL;
+  ql->tail = NULL;
+  ql->count = 0;
+  ql->len = 0;
+  ql->fill = fill > 0 ? fill : 1;
+  return ql;
+}
+
+void quicklistRelease(Quicklist *ql) {
+  QuicklistNode *node = ql->head;
+  while (node) {
+    QuicklistNode *next = node->next;
+    ziplistFree(node->zl);
+    slab_free(node, sizeof(*node));
+    node = next;
+  }
+  zfree(ql);
+}
+
+// Link a new node holding zl after old_node, or before it if after is 0.
+// A NULL old_node makes it the only node.
+static QuicklistNode *_quicklistInsertNode(Quicklist *ql,
+                                           QuicklistNode *old_node,
+                                           unsigned char *zl, int after) {
+  QuicklistNode *node = slab_alloc(sizeof(*node));
+  if (node == NULL) {
+    return NULL;
+  }
+  node->zl = zl;
+  node->count = ziplistLen(zl);
+  if (old_node == NULL) {
+    node->prev = node->next = NULL;
+    ql->head = ql->tail = node;
+  } else if (after) {
+    node->prev = old_node;
+    node->next = old_node->next;
+    if (old_node->next) {
+      old_node->next->prev = node;
+    }
+    old_node->next = node;
+    if (ql->tail == old_node) {
+      ql->tail = node;
+    }
+  } else {
+    node->next = old_node;
+    node->prev = old_node->prev;
+    if (old_node->prev) {
+      old_node->prev->next = node;
+    }
+    old_node->prev = node;
+    if (ql->head == old_node) {
+      ql->head = node;
+    }
+  }
+  ql->len++;
+  ql->count += node->count;
+  return node;
+}
+
+static void _quicklistDelNode(Quicklist *ql, QuicklistNode *node) {
+  if (node->prev) {
+    node->prev->next = node->next;
+  } else {
+    ql->head = node->next;
+  }
+  if (node->next) {
+    node->next->prev = node->prev;
+  } else {
+    ql->tail = node->prev;
+  }
+  ql->len--;
+  ql->count -= node->count;
+  ziplistFree(node->zl);
+  slab_free(node, sizeof(*node));
+}
+
+static int _quicklistNodeAllowInsert(Quicklist *ql, QuicklistNode *node,
+                                     unsigned int len) {
+  if (node == NULL) {
+    return 0;
+  }
+  if (node->count == 0) {
+    return 1;
+  }
+  return node->count < ql->fill &&
+         ziplistBlobLen(node->zl) + len + ZIP_ENTRY_OVERHEAD <=
+             QUICKLIST_MAX_NODE_BYTES;
+}
+
+// Take ownership of zl and append it as a node, used to convert a list
+// stored as a single ziplist.
+int quicklistAppendZiplist(Quicklist *ql, unsigned char *zl) {
+  if (ziplistLen(zl) == 0) {
+    ziplistFree(zl);
+    return 1;
+  }
+  return _quicklistInsertNode(ql, ql->tail, zl, 1) != NULL;
+}
+
+int quicklistPush(Quicklist *ql, const void *s, unsigned int len, int where) {
+  QuicklistNode *node = (where == QUICKLIST_HEAD) ? ql->head : ql->tail;
+
+  if (!_quicklistNodeAllowInsert(ql, node, len)) {
+    unsigned char *zl = ziplistNew();
+    if (zl == NULL) {
+      return 0;
+    }
+    node = _quicklistInsertNode(ql, node, zl, where == QUICKLIST_TAIL);
+    if (node == NULL) {
+      ziplistFree(zl);
+      return 0;
+    }
+  }
+  node->zl = ziplistPush(node->zl, s, len,
+                         where == QUICKLIST_HEAD ? ZIPLIST_HEAD : ZIPLIST_TAIL);
+  if (node->zl == NULL) {
+    return 0;
+  }
+  node->count++;
+  ql->count++;
+  return 1;
+}
+
+// Find the node holding index, skipping whole nodes from the nearest end.
+// Returns the offset of the entry in the node, negative if counted from
+// the tail of the node.
+static QuicklistNode *_quicklistFindNode(Quicklist *ql, long index,
+                                         long *offset) {
+  QuicklistNode *node;
+  unsigned long seen = 0;
+  unsigned long idx;
+  int forward;
+
+  if (index < 0) {
+    index += ql->count;
+  }
+  if (index < 0 || (unsigned long)index >= ql->count) {
+    return NULL;
+  }
+  forward = (unsigned long)index < ql->count / 2;
+  idx = forward ? (unsigned long)index : ql->count - 1 - index;
+
+  node = forward ? ql->head : ql->tail;
+  while (seen + node->count <= idx) {
+    seen += node->count;
+    node = forward ? node->next : node->prev;
+  }
+  *offset = forward ? (long)(idx - seen) : -(long)(idx - seen) - 1;
+  return node;
+}
+
+int quicklistIndex(Quicklist *ql, long index, QuicklistEntry *entry) {
+  long offset;
+  QuicklistNode *node = _quicklistFindNode(ql, index, &offset);
+
+  if (node == NULL) {
+    return 0;
+  }
+  entry->node = node;
+  entry->zi = ziplistIndex(node->zl, offset);
+  ziplistGet(entry->zi, &entry->sval, &entry->slen);
+  return 1;
+}
+
+int quicklistDelEntry(Quicklist *ql, QuicklistEntry *entry) {
+  QuicklistNode *node = entry->node;
+
+  if (node->count == 1) {
+    _quicklistDelNode(ql, node);
+    return 1;
+  }
+  node->zl = ziplistDelete(node->zl, &entry->zi);
+  if (node->zl == NULL) {
+    return 0;
+  }
+  node->count--;
+  ql->count--;
+  return 1;
+}
+
+int quicklistReplaceEntry(Quicklist *ql, QuicklistEntry *entry,
+                          const void *s, unsigned int len) {
+  QuicklistNode *node = entry->node;
+
+  (void)ql;
+  node->zl = ziplistReplace(node->zl, entry->zi, s, len);
+  return node->zl != NULL;
+}
+
+// Delete count entries starting at start. Nodes entirely in the range are
+// dropped without looking at their entries.
+int quicklistDelRange(Quicklist *ql, long start, unsigned long count) {
+  QuicklistNode *node;
+  long offset;
+
+  if (count == 0) {
+    return 1;
+  }
+  node = _quicklistFindNode(ql, start, &offset);
+  if (node == NULL) {
+    return 1;
+  }
+  if (offset < 0) {
+    offset += node->count;
+  }
+
+  while (node && count > 0) {
+    QuicklistNode *next = node->next;
+    unsigned long del = node->count - offset;
+
+    if (del > count) {
+      del = count;
+    }
+    if (del == node->count) {
+      _quicklistDelNode(ql, node);
+    } else {
+      node->zl = ziplistDeleteRange(node->zl, offset, del);
+      if (node->zl == NULL) {
+        return 0;
+      }
+      node->count -= del;
+      ql->count -= del;
+    }
+    count -= del;
+    offset = 0;
+    node = next;
+  }
+  return 1;
+}
+
+// Start iterating at index, towards the tail if direction is
+// QUICKLIST_TAIL, towards the head otherwise.
+void quicklistInitIterator(QuicklistIter *iter, Quicklist *ql, long index,
+                           int direction) {
+  long offset;
+
+  iter->ql = ql;
+  iter->direction = direction;
+  iter->node = _quicklistFindNode(ql, index, &offset);
+  iter->zi = iter->node ? ziplistIndex(iter->node->zl, offset) : NULL;
+}
+
+int quicklistNext(QuicklistIter *iter, QuicklistEntry *entry) {
+  QuicklistNode *node = iter->node;
+
+  if (iter->zi == NULL) {
+    return 0;
+  }
+  entry->node = node;
+  entry->zi = iter->zi;
+  ziplistGet(iter->zi, &entry->sval, &entry->slen);
+
+  if (iter->direction == QUICKLIST_TAIL) {
+    iter->zi = ziplistNext(node->zl, iter->zi);
+    if (iter->zi == NULL && node->next) {
+      iter->node = node->next;
+      iter->zi = ziplistIndex(iter->node->zl, 0);
+    }
+  } else {
+    iter->zi = ziplistPrev(node->zl, iter->zi);
+    if (iter->zi == NULL && node->prev) {
+      iter->node = node->prev;
+      iter->zi = ziplistIndex(iter->node->zl, -1);
+    }
+  }
+  return 1;
+}
@@ -0,0 +1,81 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DATA_STRUCT_QUICKLIST_H_
+#define DATA_STRUCT_QUICKLIST_H_
+
+// A quicklist is a doubly linked list of ziplists, used for lists too
+// large for a single ziplist. Every node knows how many entries it holds,
+// so an index is found by skipping whole nodes from the nearest end, and
+// a range of entries is deleted by dropping whole nodes at once.
+
+#define QUICKLIST_HEAD 0
+#define QUICKLIST_TAIL 1
+
+// Nodes are not filled past this size, unless a single entry is larger.
+#define QUICKLIST_MAX_NODE_BYTES 8192
+
+typedef struct QuicklistNode {
+  struct QuicklistNode *prev;
+  struct QuicklistNode *next;
+  unsigned char *zl;
+  unsigned int count;  // entries in zl
+} QuicklistNode;
+
+typedef struct Quicklist {
+  QuicklistNode *head;
+  QuicklistNode *tail;
+  unsigned long count;  // entries in all the nodes
+  unsigned long len;    // number of nodes
+  unsigned int fill;    // maximum entries per node
+} Quicklist;
+
+// Position of an entry, and its value. The value points inside the node,
+// it is only valid until the quicklist is modified.
+typedef struct QuicklistEntry {
+  QuicklistNode *node;
+  unsigned char *zi;
+  unsigned char *sval;
+  unsigned int slen;
+} QuicklistEntry;
+
+typedef struct QuicklistIter {
+  Quicklist *ql;
+  QuicklistNode *node;
+  unsigned char *zi;  // next entry, NULL when done
+  int direction;      // QUICKLIST_TAIL walks from head to tail
+} QuicklistIter;
+
+#define quicklistCount(ql) ((ql)->count)
+
+Quicklist *quicklistCreate(unsigned int fill);
+void quicklistRelease(Quicklist *ql);
+int quicklistAppendZiplist(Quicklist *ql, unsigned char *zl);
+int quicklistPush(Quicklist *ql, const void *s, unsigned int len, int where);
+int quicklistIndex(Quicklist *ql, long index, QuicklistEntry *entry);
+int quicklistDelEntry(Quicklist *ql, QuicklistEntry *entry);
+int quicklistReplaceEntry(Quicklist *ql, QuicklistEntry *entry,
+                          const void *s, unsigned int len);
+int quicklistDelRange(Quicklist *ql, long start, unsigned long count);
+void quicklistInitIterator(QuicklistIter *iter, Quicklist *ql, long index,
+                           int direction);
+int quicklistNext(QuicklistIter *iter, QuicklistEntry *entry);
+
+#endif  // DATA_STRUCT_QUICKLIST_H_
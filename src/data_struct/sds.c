@@ -20,6 +20,7 @@
 
 #include "data_struct/sds.h"
 
+#include <assert.h>
 #include <ctype.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -33,33 +34,154 @@ static void sdsOOMAbort() {
   abort();
 }
 
-static sds sdsMakeRoomFor(sds s, size_t addlen) {
-  sds_hdr *sh, *newsh;
-  size_t free = sdsavail(s);
-  size_t len, newlen;
+static size_t sdsHdrSize(char type) {
+  switch (type & SDS_TYPE_MASK) {
+  case SDS_TYPE_8:
+    return sizeof(sds_hdr8);
+  case SDS_TYPE_16:
+    return sizeof(sds_hdr16);
+  case SDS_TYPE_32:
+    return sizeof(sds_hdr32);
+  case SDS_TYPE_64:
+    return sizeof(sds_hdr64);
+  }
+  return 0;
+}
+
+// The smallest header able to hold a string of the given size.
+static char sdsReqType(size_t size) {
+  if (size < 1 << 8) {
+    return SDS_TYPE_8;
+  } else if (size < 1 << 16) {
+    return SDS_TYPE_16;
+  } else if (size <= 0xffffffffUL) {
+    return SDS_TYPE_32;
+  }
+  return SDS_TYPE_64;
+}
+
+// Total size of the buffer, not including the header and the final '\0'.
+static size_t sdsalloc(const sds s) {
+  switch (s[-1] & SDS_TYPE_MASK) {
+  case SDS_TYPE_8:
+    return SDS_HDR(8, s)->alloc;
+  case SDS_TYPE_16:
+    return SDS_HDR(16, s)->alloc;
+  case SDS_TYPE_32:
+    return SDS_HDR(32, s)->alloc;
+  case SDS_TYPE_64:
+    return SDS_HDR(64, s)->alloc;
+  }
+  return 0;
+}
+
+static void sdssetlen(sds s, size_t newlen) {
+  switch (s[-1] & SDS_TYPE_MASK) {
+  case SDS_TYPE_8:
+    SDS_HDR(8, s)->len = newlen;
+    break;
+  case SDS_TYPE_16:
+    SDS_HDR(16, s)->len = newlen;
+    break;
+  case SDS_TYPE_32:
+    SDS_HDR(32, s)->len = newlen;
+    break;
+  case SDS_TYPE_64:
+    SDS_HDR(64, s)->len = newlen;
+    break;
+  }
+}
+
+static void sdssetalloc(sds s, size_t newlen) {
+  switch (s[-1] & SDS_TYPE_MASK) {
+  case SDS_TYPE_8:
+    SDS_HDR(8, s)->alloc = newlen;
+    break;
+  case SDS_TYPE_16:
+    SDS_HDR(16, s)->alloc = newlen;
+    break;
+  case SDS_TYPE_32:
+    SDS_HDR(32, s)->alloc = newlen;
+    break;
+  case SDS_TYPE_64:
+    SDS_HDR(64, s)->alloc = newlen;
+    break;
+  }
+}
+
+// Make sure there is room for addlen more bytes after the end of the
+// string. The buffer is doubled while it is small, then it grows by
+// SDS_MAX_PREALLOC at most, to avoid reallocating on every append.
+sds sdsMakeRoomFor(sds s, size_t addlen) {
+  size_t len = sdslen(s);
+  size_t newlen = len + addlen;
+
+  if (sdsavail(s) >= addlen) {
+    return s;
+  }
+  if (newlen < SDS_MAX_PREALLOC) {
+    newlen *= 2;
+  } else {
+    newlen += SDS_MAX_PREALLOC;
+  }
+  return sdsMakeRoomForExact(s, newlen - len);
+}
+
+// Like sdsMakeRoomFor() but without preallocating more than addlen, for
+// buffers whose final size is known. The header grows with the buffer
+// when its length fields become too small.
+sds sdsMakeRoomForExact(sds s, size_t addlen) {
+  char oldtype = s[-1] & SDS_TYPE_MASK;
+  size_t len = sdslen(s);
+  size_t newlen = len + addlen;
+  size_t hdrlen;
+  char type;
+  void *sh;
+  void *newsh;
 
-  if (free >= addlen) {
+  if (sdsavail(s) >= addlen) {
     return s;
   }
 
-  len = sdslen(s);
-  sh = (void*) (s - sizeof(sds_hdr));
-  newlen = (len + addlen) * 2;
-  newsh = zrealloc(sh, sizeof(sds_hdr) + newlen + 1);
-  if (newsh == NULL) {
+  sh = s - sdsHdrSize(oldtype);
+  type = sdsReqType(newlen);
+  hdrlen = sdsHdrSize(type);
+  if (type == oldtype) {
+    newsh = zrealloc(sh, hdrlen + newlen + 1);
+    if (newsh == NULL) {
 #ifdef SDS_ABORT_ON_OOM
-    sdsOOMAbort();
+      sdsOOMAbort();
 #else
-    return NULL;
+      return NULL;
 #endif
+    }
+    s = (char*)newsh + hdrlen;
+  } else {
+    // The header size changes, the string has to move.
+    newsh = zmalloc(hdrlen + newlen + 1);
+    if (newsh == NULL) {
+#ifdef SDS_ABORT_ON_OOM
+      sdsOOMAbort();
+#else
+      return NULL;
+#endif
+    }
+    memcpy((char*)newsh + hdrlen, s, len + 1);
+    zfree(sh);
+    s = (char*)newsh + hdrlen;
+    s[-1] = type;
+    sdssetlen(s, len);
   }
-  newsh->free = newlen - len;
-  return newsh->buf;
+  sdssetalloc(s, newlen);
+  return s;
 }
 
 sds sdsnewlen(const void *init, size_t initlen) {
-  sds_hdr *sh;
-  sh = zmalloc(sizeof(sds_hdr) + initlen + 1);
+  char type = sdsReqType(initlen);
+  size_t hdrlen = sdsHdrSize(type);
+  void *sh = zmalloc(hdrlen + initlen + 1);
+  sds s;
+
   if (sh == NULL) {
 #ifdef SDS_ABORT_ON_OOM
     sdsOOMAbort();
@@ -68,17 +190,19 @@ sds sdsnewlen(const void *init, size_t initlen) {
 #endif
   }
 
-  sh->len = initlen;
-  sh->free = 0;
+  s = (char*)sh + hdrlen;
+  s[-1] = type;
+  sdssetlen(s, initlen);
+  sdssetalloc(s, initlen);
   if (initlen) {
     if (init) {
-      memcpy(sh->buf, init, initlen);
+      memcpy(s, init, initlen);
     } else {
-      memset(sh->buf, 0, initlen);
+      memset(s, 0, initlen);
     }
   }
-  sh->buf[initlen] = '\0';
-  return (char*)sh->buf;
+  s[initlen] = '\0';
+  return s;
 }
 
 sds sdsnew(const char *init) {
@@ -91,8 +215,17 @@ sds sdsempty() {
 }
 
 size_t sdslen(const sds s) {
-  sds_hdr *sh = (void*) (s - sizeof(sds_hdr));
-  return sh->len;
+  switch (s[-1] & SDS_TYPE_MASK) {
+  case SDS_TYPE_8:
+    return SDS_HDR(8, s)->len;
+  case SDS_TYPE_16:
+    return SDS_HDR(16, s)->len;
+  case SDS_TYPE_32:
+    return SDS_HDR(32, s)->len;
+  case SDS_TYPE_64:
+    return SDS_HDR(64, s)->len;
+  }
+  return 0;
 }
 
 sds sdsdup(const sds s) {
@@ -103,50 +236,90 @@ void sdsfree(sds s) {
   if (s == NULL) {
     return;
   }
-  zfree(s - sizeof(sds_hdr));
+  zfree(s - sdsHdrSize(s[-1]));
 }
 
 size_t sdsavail(sds s) {
-  sds_hdr *sh = (void*) (s - sizeof(sds_hdr));
-  return sh->free;
+  return sdsalloc(s) - sdslen(s);
 }
 
 sds sdscatlen(sds s, void *t, size_t len) {
-  sds_hdr *sh;
   size_t curlen = sdslen(s);
 
   s = sdsMakeRoomFor(s, len);
   if (s == NULL) {
     return NULL;
   }
-  sh = (void*) (s - sizeof(sds_hdr));
   memcpy(s + curlen, t, len);
-  sh->len = curlen + len;
-  sh->free -= len;
-  s[sh->len] = '\0';
+  sdssetlen(s, curlen + len);
+  s[curlen + len] = '\0';
   return s;
 }
 
+// Adjust the length after incr bytes were written past the end of the
+// string (incr > 0, see sdsMakeRoomFor()) or to drop bytes from the end
+// (incr < 0).
+void sdsIncrLen(sds s, long incr) {
+  size_t len = sdslen(s);
+
+  assert(incr >= 0 ? sdsavail(s) >= (size_t)incr : len >= (size_t)-incr);
+  len += incr;
+  sdssetlen(s, len);
+  s[len] = '\0';
+}
+
+// Make the string empty without releasing its buffer.
+void sdsclear(sds s) {
+  sdssetlen(s, 0);
+  s[0] = '\0';
+}
+
+// Release the free space at the end of the string, also shrinking the
+// header if the length fits a smaller one.
+sds sdsRemoveFreeSpace(sds s) {
+  char oldtype = s[-1] & SDS_TYPE_MASK;
+  size_t len = sdslen(s);
+  char type = sdsReqType(len);
+  sds news;
+
+  if (sdsavail(s) == 0) {
+    return s;
+  }
+  if (type == oldtype) {
+    void *sh = zrealloc(s - sdsHdrSize(oldtype),
+                        sdsHdrSize(type) + len + 1);
+    if (sh == NULL) {
+#ifdef SDS_ABORT_ON_OOM
+      sdsOOMAbort();
+#else
+      return NULL;
+#endif
+    }
+    s = (char*)sh + sdsHdrSize(type);
+    sdssetalloc(s, len);
+    return s;
+  }
+  news = sdsnewlen(s, len);
+  if (news != NULL) {
+    sdsfree(s);
+  }
+  return news;
+}
+
 sds sdscat(sds s, char *t) {
   return sdscatlen(s, t, strlen(t));
 }
 
 sds sdscpylen(sds s, char *t, size_t len) {
-  sds_hdr *sh = (void*) (s - sizeof(sds_hdr));
-  size_t totlen = sh->free + sh->len;
-
-  if (totlen < len) {
-    s = sdsMakeRoomFor(s, len - totlen);
+  if (sdsalloc(s) < len) {
+    s = sdsMakeRoomFor(s, len - sdslen(s));
     if (s == NULL) {
       return NULL;
     }
-    sh = (void*) (s - sizeof(sds_hdr));
-    totlen = sh->free + sh->len;
   }
   memcpy(s, t, len);
   s[len] = '\0';
-  sh->len = len;
-  sh->free = totlen - len;
+  sdssetlen(s, len);
   return s;
 }
 
@@ -186,7 +359,6 @@ sds sdscatprintf(sds s, const char *fmt, ...) {
 }
 
 sds sdstrim(sds s, const char *cset) {
-  sds_hdr *sh = (void*) (s - sizeof(sds_hdr));
   char *start, *end, *sp, *ep;
   size_t len;
 
@@ -199,17 +371,15 @@ sds sdstrim(sds s, const char *cset) {
     ep--;
   }
   len = (sp > ep) ? 0 : ((ep - sp) + 1);
-  if (sh->buf != sp) {
-    memmove(sh->buf, sp, len);
+  if (s != sp) {
+    memmove(s, sp, len);
   }
-  sh->buf[len] = '\0';
-  sh->free = sh->free + (sh->len - len);
-  sh->len = len;
+  s[len] = '\0';
+  sdssetlen(s, len);
   return s;
 }
 
 sds sdsrange(sds s, long start, long end) {
-  sds_hdr *sh = (void*) (s - sizeof(sds_hdr));
   size_t newlen;
   size_t len = sdslen(s);
 
@@ -242,20 +412,16 @@ sds sdsrange(sds s, long start, long end) {
   }
 
   if (start != 0) {
-    memmove(sh->buf, sh->buf + start, newlen);
+    memmove(s, s + start, newlen);
   }
 
-  sh->buf[newlen] = '\0';
-  sh->free += sh->len - newlen;
-  sh->len = newlen;
+  s[newlen] = '\0';
+  sdssetlen(s, newlen);
   return s;
 }
 
 void sdsupdatelen(sds s) {
-  sds_hdr *sh = (void*) (s - sizeof(sds_hdr));
-  int reallen = strlen(s);
-  sh->free += (sh->len - reallen);
-  sh->len = reallen;
+  sdssetlen(s, strlen(s));
 }
 
 int sdscmp(sds s1, sds s2) {
@@ -22,14 +22,50 @@
 #define SDS_H_
 
 #include <stddef.h>
+#include <stdint.h>
+
+#define SDS_MAX_PREALLOC  (1024 * 1024)
 
 typedef char *sds;
 
-typedef struct sds_hdr {
-  long len;
-  long free;
-  char buf[0];
-} sds_hdr;
+// The header is right before the string, its last byte holds the type, so
+// it can be found from the sds pointer. Small strings use a header with
+// small length fields.
+#define SDS_TYPE_8        1
+#define SDS_TYPE_16       2
+#define SDS_TYPE_32       3
+#define SDS_TYPE_64       4
+#define SDS_TYPE_MASK     7
+
+typedef struct __attribute__((__packed__)) sds_hdr8 {
+  uint8_t len;          // used length
+  uint8_t alloc;        // allocated length, excluding header and '\0'
+  unsigned char flags;  // the type, in the lower 3 bits
+  char buf[];
+} sds_hdr8;
+
+typedef struct __attribute__((__packed__)) sds_hdr16 {
+  uint16_t len;
+  uint16_t alloc;
+  unsigned char flags;
+  char buf[];
+} sds_hdr16;
+
+typedef struct __attribute__((__packed__)) sds_hdr32 {
+  uint32_t len;
+  uint32_t alloc;
+  unsigned char flags;
+  char buf[];
+} sds_hdr32;
+
+typedef struct __attribute__((__packed__)) sds_hdr64 {
+  uint64_t len;
+  uint64_t alloc;
+  unsigned char flags;
+  char buf[];
+} sds_hdr64;
+
+#define SDS_HDR(T, s) ((sds_hdr##T *)((s) - sizeof(sds_hdr##T)))
 
 sds sdsnewlen(const void *init, size_t initlen);
 sds sdsnew(const char *init);
@@ -49,8 +85,12 @@ void sdsupdatelen(sds s);
 int sdscmp(sds s1, sds s2);
 sds *sdssplitlen(char *s, int len, char *sep, int seplen, int *count);
 void sdstolower(sds s);
-void sdstolower(sds s);
 void sdstoupper(sds s);
+sds sdsMakeRoomFor(sds s, size_t addlen);
+sds sdsMakeRoomForExact(sds s, size_t addlen);
+void sdsIncrLen(sds s, long incr);
+void sdsclear(sds s);
+sds sdsRemoveFreeSpace(sds s);
 
 
 #endif  // SDS_H_
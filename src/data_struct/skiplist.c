@@ -0,0 +1,260 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "data_struct/skiplist.h"
+
+#include <stdlib.h>
+
+#include "memory/zmalloc.h"
+
+static SkiplistNode *zslCreateNode(int level, double score, sds ele) {
+  SkiplistNode *node = zmalloc(sizeof(*node) +
+                               level * sizeof(struct SkiplistLevel));
+  if (node == NULL) {
+    return NULL;
+  }
+  node->score = score;
+  node->ele = ele;
+  return node;
+}
+
+static void zslFreeNode(SkiplistNode *node) {
+  sdsfree(node->ele);
+  zfree(node);
+}
+
+Skiplist *zslCreate(void) {
+  Skiplist *zsl = zmalloc(sizeof(*zsl));
+  int j;
+
+  if (zsl == NULL) {
+    return NULL;
+  }
+  zsl->header = zslCreateNode(SKIPLIST_MAXLEVEL, 0, NULL);
+  if (zsl->header == NULL) {
+    zfree(zsl);
+    return NULL;
+  }
+  for (j = 0; j < SKIPLIST_MAXLEVEL; j++) {
+    zsl->header->level[j].forward = NULL;
+    zsl->header->level[j].span = 0;
+  }
+  zsl->header->backward = NULL;
+  zsl->tail = NULL;
+  zsl->length = 0;
+  zsl->level = 1;
+  return zsl;
+}
+
+// Free the skiplist and the elements.
+void zslFree(Skiplist *zsl) {
+  SkiplistNode *node = zsl->header->level[0].forward;
+
+  zfree(zsl->header);
+  while (node) {
+    SkiplistNode *next = node->level[0].forward;
+    zslFreeNode(node);
+    node = next;
+  }
+  zfree(zsl);
+}
+
+// A level between 1 and SKIPLIST_MAXLEVEL, higher levels are less likely.
+static int zslRandomLevel(void) {
+  int level = 1;
+  while ((random() & 0xFFFF) < (SKIPLIST_P * 0xFFFF) &&
+         level < SKIPLIST_MAXLEVEL) {
+    level++;
+  }
+  return level;
+}
+
+// True if the node is before score and ele in the skiplist order.
+static int zslNodeBefore(SkiplistNode *node, double score, sds ele) {
+  return node->score < score ||
+         (node->score == score && sdscmp(node->ele, ele) < 0);
+}
+
+// Insert ele, the skiplist takes ownership of it. The caller makes sure
+// ele is not already in the skiplist.
+SkiplistNode *zslInsert(Skiplist *zsl, double score, sds ele) {
+  SkiplistNode *update[SKIPLIST_MAXLEVEL], *x;
+  unsigned long rank[SKIPLIST_MAXLEVEL];
+  int i, level;
+
+  // Find the last node before the new one at every level, and its rank.
+  x = zsl->header;
+  for (i = zsl->level - 1; i >= 0; i--) {
+    rank[i] = (i == zsl->level - 1) ? 0 : rank[i+1];
+    while (x->level[i].forward &&
+           zslNodeBefore(x->level[i].forward, score, ele)) {
+      rank[i] += x->level[i].span;
+      x = x->level[i].forward;
+    }
+    update[i] = x;
+  }
+
+  level = zslRandomLevel();
+  if (level > zsl->level) {
+    for (i = zsl->level; i < level; i++) {
+      rank[i] = 0;
+      update[i] = zsl->header;
+      update[i]->level[i].span = zsl->length;
+    }
+    zsl->level = level;
+  }
+  x = zslCreateNode(level, score, ele);
+  if (x == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < level; i++) {
+    x->level[i].forward = update[i]->level[i].forward;
+    update[i]->level[i].forward = x;
+
+    // The new node splits the span of the node before it.
+    x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+    update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+  }
+
+  // The higher levels now skip one more node.
+  for (i = level; i < zsl->level; i++) {
+    update[i]->level[i].span++;
+  }
+
+  x->backward = (update[0] == zsl->header) ? NULL : update[0];
+  if (x->level[0].forward) {
+    x->level[0].forward->backward = x;
+  } else {
+    zsl->tail = x;
+  }
+  zsl->length++;
+  return x;
+}
+
+static void zslDeleteNode(Skiplist *zsl, SkiplistNode *x,
+                          SkiplistNode **update) {
+  int i;
+
+  for (i = 0; i < zsl->level; i++) {
+    if (update[i]->level[i].forward == x) {
+      update[i]->level[i].span += x->level[i].span - 1;
+      update[i]->level[i].forward = x->level[i].forward;
+    } else {
+      update[i]->level[i].span -= 1;
+    }
+  }
+  if (x->level[0].forward) {
+    x->level[0].forward->backward = x->backward;
+  } else {
+    zsl->tail = x->backward;
+  }
+  while (zsl->level > 1 && zsl->header->level[zsl->level-1].forward == NULL) {
+    zsl->level--;
+  }
+  zsl->length--;
+}
+
+// Delete the node of score and ele, and free its element. Returns 0 if
+// it was not found.
+int zslDelete(Skiplist *zsl, double score, sds ele) {
+  SkiplistNode *update[SKIPLIST_MAXLEVEL], *x;
+  int i;
+
+  x = zsl->header;
+  for (i = zsl->level - 1; i >= 0; i--) {
+    while (x->level[i].forward &&
+           zslNodeBefore(x->level[i].forward, score, ele)) {
+      x = x->level[i].forward;
+    }
+    update[i] = x;
+  }
+  x = x->level[0].forward;
+  if (x && x->score == score && sdscmp(x->ele, ele) == 0) {
+    zslDeleteNode(zsl, x, update);
+    zslFreeNode(x);
+    return 1;
+  }
+  return 0;
+}
+
+// The 1-based rank of the node of score and ele, 0 if not found.
+unsigned long zslGetRank(Skiplist *zsl, double score, sds ele) {
+  SkiplistNode *x = zsl->header;
+  unsigned long rank = 0;
+  int i;
+
+  for (i = zsl->level - 1; i >= 0; i--) {
+    while (x->level[i].forward &&
+           (zslNodeBefore(x->level[i].forward, score, ele) ||
+            (x->level[i].forward->score == score &&
+             sdscmp(x->level[i].forward->ele, ele) == 0))) {
+      rank += x->level[i].span;
+      x = x->level[i].forward;
+    }
+    if (x->ele && x->score == score && sdscmp(x->ele, ele) == 0) {
+      return rank;
+    }
+  }
+  return 0;
+}
+
+// The node of a 1-based rank, NULL if out of range.
+SkiplistNode *zslGetElementByRank(Skiplist *zsl, unsigned long rank) {
+  SkiplistNode *x = zsl->header;
+  unsigned long traversed = 0;
+  int i;
+
+  for (i = zsl->level - 1; i >= 0; i--) {
+    while (x->level[i].forward && traversed + x->level[i].span <= rank) {
+      traversed += x->level[i].span;
+      x = x->level[i].forward;
+    }
+    if (traversed == rank) {
+      return x == zsl->header ? NULL : x;
+    }
+  }
+  return NULL;
+}
+
+static int zslValueGteMin(double value, SkiplistRange *range) {
+  return range->minex ? (value > range->min) : (value >= range->min);
+}
+
+static int zslValueLteMax(double value, SkiplistRange *range) {
+  return range->maxex ? (value < range->max) : (value <= range->max);
+}
+
+// The first node with a score in range, NULL if there is none.
+SkiplistNode *zslFirstInRange(Skiplist *zsl, SkiplistRange *range) {
+  SkiplistNode *x = zsl->header;
+  int i;
+
+  for (i = zsl->level - 1; i >= 0; i--) {
+    while (x->level[i].forward &&
+           !zslValueGteMin(x->level[i].forward->score, range)) {
+      x = x->level[i].forward;
+    }
+  }
+  x = x->level[0].forward;
+  if (x == NULL || !zslValueLteMax(x->score, range)) {
+    return NULL;
+  }
+  return x;
+}
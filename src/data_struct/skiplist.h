@@ -0,0 +1,68 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DATA_STRUCT_SKIPLIST_H_
+#define DATA_STRUCT_SKIPLIST_H_
+
+#include "data_struct/sds.h"
+
+// A skiplist of sds elements ordered by score, then by element. Every
+// node has a random number of levels, the higher levels skip more nodes,
+// so an element is found, inserted or deleted in O(log(N)) on average.
+// Every level stores how many nodes it skips, so the rank of a node and
+// the node of a rank are found in O(log(N)) too.
+
+#define SKIPLIST_MAXLEVEL 32  // enough for 2^64 elements
+#define SKIPLIST_P 0.25       // probability of a node to get another level
+
+typedef struct SkiplistNode {
+  sds ele;
+  double score;
+  struct SkiplistNode *backward;
+  struct SkiplistLevel {
+    struct SkiplistNode *forward;
+    unsigned long span;  // nodes skipped by forward
+  } level[];
+} SkiplistNode;
+
+typedef struct Skiplist {
+  SkiplistNode *header;
+  SkiplistNode *tail;
+  unsigned long length;
+  int level;
+} Skiplist;
+
+// A range of scores, min and max are excluded if minex or maxex are set.
+typedef struct SkiplistRange {
+  double min;
+  double max;
+  int minex;
+  int maxex;
+} SkiplistRange;
+
+Skiplist *zslCreate(void);
+void zslFree(Skiplist *zsl);
+SkiplistNode *zslInsert(Skiplist *zsl, double score, sds ele);
+int zslDelete(Skiplist *zsl, double score, sds ele);
+unsigned long zslGetRank(Skiplist *zsl, double score, sds ele);
+SkiplistNode *zslGetElementByRank(Skiplist *zsl, unsigned long rank);
+SkiplistNode *zslFirstInRange(Skiplist *zsl, SkiplistRange *range);
+
+#endif  // DATA_STRUCT_SKIPLIST_H_
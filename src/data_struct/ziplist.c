@@ -0,0 +1,292 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "data_struct/ziplist.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "memory/zmalloc.h"
+
+#define ZIP_END         0xff
+#define ZIP_BIG         0x80  // marks a 4 bytes length
+#define ZIP_SMALL_MAX   127   // largest length stored in one byte
+#define ZIPLIST_HEADER_SIZE  8
+
+#define ZIPLIST_BYTES(zl)  ((uint32_t *)(zl))
+#define ZIPLIST_COUNT(zl)  ((uint32_t *)((zl) + 4))
+#define ZIPLIST_HEAD_ENTRY(zl)  ((zl) + ZIPLIST_HEADER_SIZE)
+#define ZIPLIST_END_ENTRY(zl)  ((zl) + *ZIPLIST_BYTES(zl) - 1)
+
+static unsigned int zipLenSize(unsigned int len) {
+  return len <= ZIP_SMALL_MAX ? 1 : 5;
+}
+
+static unsigned int zipEntrySize(unsigned int len) {
+  unsigned int n = zipLenSize(len) + len;
+  return n + zipLenSize(n);
+}
+
+// Read the length of the data of the entry at p, and the size of the
+// field storing it.
+static unsigned int zipDecodeLen(unsigned char *p, unsigned int *size) {
+  uint32_t len;
+
+  if (p[0] != ZIP_BIG) {
+    *size = 1;
+    return p[0];
+  }
+  memcpy(&len, p + 1, 4);
+  *size = 5;
+  return len;
+}
+
+static unsigned int zipRawEntrySize(unsigned char *p) {
+  unsigned int size;
+  unsigned int len = zipDecodeLen(p, &size);
+  return zipEntrySize(len);
+}
+
+// Write an entry at p, returns its size.
+static unsigned int zipWriteEntry(unsigned char *p, const void *s,
+                                  unsigned int len) {
+  unsigned char *start = p;
+  uint32_t n = len;
+
+  if (len <= ZIP_SMALL_MAX) {
+    *p++ = len;
+  } else {
+    *p++ = ZIP_BIG;
+    memcpy(p, &n, 4);
+    p += 4;
+  }
+  memcpy(p, s, len);
+  p += len;
+
+  // The back length is written reversed, its last byte tells its size.
+  n = p - start;
+  if (n <= ZIP_SMALL_MAX) {
+    *p++ = n;
+  } else {
+    memcpy(p, &n, 4);
+    p += 4;
+    *p++ = ZIP_BIG;
+  }
+  return p - start;
+}
+
+static unsigned char *zipResize(unsigned char *zl, size_t len) {
+  zl = zrealloc(zl, len);
+  if (zl == NULL) {
+    return NULL;
+  }
+  *ZIPLIST_BYTES(zl) = len;
+  zl[len - 1] = ZIP_END;
+  return zl;
+}
+
+unsigned char *ziplistNew(void) {
+  unsigned char *zl = zmalloc(ZIPLIST_HEADER_SIZE + 1);
+  if (zl == NULL) {
+    return NULL;
+  }
+  *ZIPLIST_BYTES(zl) = ZIPLIST_HEADER_SIZE + 1;
+  *ZIPLIST_COUNT(zl) = 0;
+  zl[ZIPLIST_HEADER_SIZE] = ZIP_END;
+  return zl;
+}
+
+void ziplistFree(unsigned char *zl) {
+  zfree(zl);
+}
+
+unsigned int ziplistLen(unsigned char *zl) {
+  return *ZIPLIST_COUNT(zl);
+}
+
+size_t ziplistBlobLen(unsigned char *zl) {
+  return *ZIPLIST_BYTES(zl);
+}
+
+// Insert an entry before p, p may point to the end of the ziplist.
+unsigned char *ziplistInsert(unsigned char *zl, unsigned char *p,
+                             const void *s, unsigned int len) {
+  size_t cur_len = *ZIPLIST_BYTES(zl);
+  size_t offset = p - zl;
+  unsigned int req_len = zipEntrySize(len);
+
+  zl = zipResize(zl, cur_len + req_len);
+  if (zl == NULL) {
+    return NULL;
+  }
+  p = zl + offset;
+  memmove(p + req_len, p, cur_len - offset - 1);
+  zipWriteEntry(p, s, len);
+  (*ZIPLIST_COUNT(zl))++;
+  return zl;
+}
+
+unsigned char *ziplistPush(unsigned char *zl, const void *s, unsigned int len,
+                           int where) {
+  unsigned char *p = (where == ZIPLIST_HEAD) ? ZIPLIST_HEAD_ENTRY(zl)
+                                             : ZIPLIST_END_ENTRY(zl);
+  return ziplistInsert(zl, p, s, len);
+}
+
+// Delete the entry at *p, and update *p to the entry that followed it.
+unsigned char *ziplistDelete(unsigned char *zl, unsigned char **p) {
+  size_t offset = *p - zl;
+  size_t cur_len = *ZIPLIST_BYTES(zl);
+  unsigned int size = zipRawEntrySize(*p);
+
+  memmove(*p, *p + size, cur_len - offset - size);
+  zl = zipResize(zl, cur_len - size);
+  if (zl == NULL) {
+    return NULL;
+  }
+  (*ZIPLIST_COUNT(zl))--;
+  *p = (zl[offset] == ZIP_END) ? NULL : zl + offset;
+  return zl;
+}
+
+// Delete num entries starting at index.
+unsigned char *ziplistDeleteRange(unsigned char *zl, int index,
+                                  unsigned int num) {
+  unsigned char *first = ziplistIndex(zl, index);
+  unsigned char *p = first;
+  size_t cur_len = *ZIPLIST_BYTES(zl);
+  size_t offset, size;
+  unsigned int deleted = 0;
+
+  if (first == NULL) {
+    return zl;
+  }
+  while (deleted < num && p[0] != ZIP_END) {
+    p += zipRawEntrySize(p);
+    deleted++;
+  }
+  offset = first - zl;
+  size = p - first;
+  memmove(first, p, cur_len - offset - size);
+  zl = zipResize(zl, cur_len - size);
+  if (zl == NULL) {
+    return NULL;
+  }
+  *ZIPLIST_COUNT(zl) -= deleted;
+  return zl;
+}
+
+// Replace the value of the entry at p.
+unsigned char *ziplistReplace(unsigned char *zl, unsigned char *p,
+                              const void *s, unsigned int len) {
+  unsigned int size = zipRawEntrySize(p);
+
+  if (size == zipEntrySize(len)) {
+    zipWriteEntry(p, s, len);
+    return zl;
+  }
+  zl = ziplistDelete(zl, &p);
+  if (zl == NULL) {
+    return NULL;
+  }
+  return ziplistInsert(zl, p ? p : ZIPLIST_END_ENTRY(zl), s, len);
+}
+
+unsigned char *ziplistIndex(unsigned char *zl, int index) {
+  unsigned char *p;
+
+  if (index < 0) {
+    index = -index - 1;
+    if ((unsigned int)index >= *ZIPLIST_COUNT(zl)) {
+      return NULL;
+    }
+    p = ziplistPrev(zl, ZIPLIST_END_ENTRY(zl));
+    while (p && index--) {
+      p = ziplistPrev(zl, p);
+    }
+  } else {
+    if ((unsigned int)index >= *ZIPLIST_COUNT(zl)) {
+      return NULL;
+    }
+    p = ZIPLIST_HEAD_ENTRY(zl);
+    while (index--) {
+      p += zipRawEntrySize(p);
+    }
+  }
+  return p;
+}
+
+unsigned char *ziplistNext(unsigned char *zl, unsigned char *p) {
+  (void)zl;
+  p += zipRawEntrySize(p);
+  return (p[0] == ZIP_END) ? NULL : p;
+}
+
+// p may point to the end of the ziplist, to get the last entry.
+unsigned char *ziplistPrev(unsigned char *zl, unsigned char *p) {
+  uint32_t n;
+  unsigned int size;
+
+  if (p == ZIPLIST_HEAD_ENTRY(zl)) {
+    return NULL;
+  }
+  if (p[-1] != ZIP_BIG) {
+    n = p[-1];
+    size = 1;
+  } else {
+    memcpy(&n, p - 5, 4);
+    size = 5;
+  }
+  return p - size - n;
+}
+
+void ziplistGet(unsigned char *p, unsigned char **s, unsigned int *len) {
+  unsigned int size;
+  *len = zipDecodeLen(p, &size);
+  *s = p + size;
+}
+
+// Return 1 if the entry at p is equal to s.
+int ziplistCompare(unsigned char *p, const void *s, unsigned int len) {
+  unsigned char *val;
+  unsigned int vlen;
+
+  ziplistGet(p, &val, &vlen);
+  return vlen == len && memcmp(val, s, len) == 0;
+}
+
+// Find the entry equal to s, starting at p and skipping skip entries
+// after every entry compared. Returns NULL if not found.
+unsigned char *ziplistFind(unsigned char *zl, unsigned char *p,
+                           const void *s, unsigned int len,
+                           unsigned int skip) {
+  unsigned int j;
+
+  while (p != NULL) {
+    if (ziplistCompare(p, s, len)) {
+      return p;
+    }
+    p = ziplistNext(zl, p);
+    for (j = 0; j < skip && p != NULL; j++) {
+      p = ziplistNext(zl, p);
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,72 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DATA_STRUCT_ZIPLIST_H_
+#define DATA_STRUCT_ZIPLIST_H_
+
+#include <stddef.h>
+
+// A ziplist is a list of strings stored in a single allocation, used to
+// keep small lists without the overhead of a node and an object for every
+// element. The layout is:
+//
+//   <total bytes:4> <count:4> <entry> <entry> ... <0xff>
+//
+// and every entry is:
+//
+//   <len:1|5> <data:len> <back:1|5>
+//
+// where back is the size of len and data, so the list can be walked in
+// both directions. Lengths below 128 take one byte, longer ones are a
+// 0x80 marker and 4 bytes. Adding or removing an entry moves the ones
+// after it, so ziplists are only meant for a few hundred small entries.
+
+#define ZIPLIST_HEAD 0
+#define ZIPLIST_TAIL 1
+
+unsigned char *ziplistNew(void);
+void ziplistFree(unsigned char *zl);
+unsigned int ziplistLen(unsigned char *zl);
+size_t ziplistBlobLen(unsigned char *zl);
+
+// Functions that change the ziplist may move it, like sds functions they
+// return the new pointer.
+unsigned char *ziplistPush(unsigned char *zl, const void *s, unsigned int len,
+                           int where);
+unsigned char *ziplistInsert(unsigned char *zl, unsigned char *p,
+                             const void *s, unsigned int len);
+unsigned char *ziplistReplace(unsigned char *zl, unsigned char *p,
+                              const void *s, unsigned int len);
+unsigned char *ziplistDelete(unsigned char *zl, unsigned char **p);
+unsigned char *ziplistDeleteRange(unsigned char *zl, int index,
+                                  unsigned int num);
+
+// Entries are addressed by pointers into the ziplist, NULL past the ends.
+// Negative indexes count from the tail, -1 is the last entry.
+unsigned char *ziplistIndex(unsigned char *zl, int index);
+unsigned char *ziplistNext(unsigned char *zl, unsigned char *p);
+unsigned char *ziplistPrev(unsigned char *zl, unsigned char *p);
+void ziplistGet(unsigned char *p, unsigned char **s, unsigned int *len);
+int ziplistCompare(unsigned char *p, const void *s, unsigned int len);
+unsigned char *ziplistFind(unsigned char *zl, unsigned char *p,
+                           const void *s, unsigned int len,
+                           unsigned int skip);
+
+#endif  // DATA_STRUCT_ZIPLIST_H_
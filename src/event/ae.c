@@ -21,48 +21,92 @@
 #include "event/ae.h"
 
 #include <errno.h>
+#include <poll.h>
 #include <stdlib.h>
-#include <sys/select.h>
+#include <string.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "memory/zmalloc.h"
 
+// Include the best polling backend supported by this system. The select
+// backend is kept as a portable fallback, and can be forced on Linux by
+// building with -DAE_USE_SELECT.
+#if defined(__linux__) && !defined(AE_USE_SELECT)
+#include "event/ae_epoll.c"
+#else
+#include "event/ae_select.c"
+#endif
+
+static int AeResizeSetSize(AeEventLoop *event_loop, int set_size);
 static AeTimeEvent *AeSearchNearestTimer(AeEventLoop *event_loop);
-static void AeGetTime(long *seconds, long *milliseconds);
-static void AeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms);
+static void AeTimerHeapUp(AeEventLoop *event_loop, int index);
+static void AeTimerHeapDown(AeEventLoop *event_loop, int index);
+static void AeTimerHeapRemove(AeEventLoop *event_loop, int index);
+static AeTimeEvent *AeSearchTimer(AeEventLoop *event_loop, long long id);
+static void AeUnlinkTimer(AeEventLoop *event_loop, AeTimeEvent *te);
+
+#define AE_TIMERS_INITIAL_SIZE 16
 
-AeEventLoop *AeCreateEventLoop() {
+AeEventLoop *AeCreateEventLoop(int set_size) {
   AeEventLoop *event_loop;
+  int i;
 
   event_loop = zmalloc(sizeof(*event_loop));
   if (!event_loop) {
     return NULL;
   }
 
-  event_loop->file_event_head = NULL;
-  event_loop->time_event_head = NULL;
+  event_loop->events = zmalloc(sizeof(AeFileEvent) * set_size);
+  event_loop->fired = zmalloc(sizeof(AeFiredEvent) * set_size);
+  event_loop->timers = zmalloc(sizeof(AeTimeEvent*) * AE_TIMERS_INITIAL_SIZE);
+  event_loop->timer_ids = zmalloc(sizeof(AeTimeEvent*) *
+                                  AE_TIMERS_INITIAL_SIZE);
+  if (!event_loop->events || !event_loop->fired || !event_loop->timers ||
+      !event_loop->timer_ids) {
+    goto err;
+  }
+  memset(event_loop->timer_ids, 0, sizeof(AeTimeEvent*) *
+                                   AE_TIMERS_INITIAL_SIZE);
+  event_loop->set_size = set_size;
+  event_loop->max_fd = -1;
+  event_loop->timers_len = 0;
+  event_loop->timers_size = AE_TIMERS_INITIAL_SIZE;
   event_loop->time_event_next_id = 0;
   event_loop->stop = 0;
+  event_loop->before_sleep = NULL;
+  if (AeApiCreate(event_loop) == AE_ERR) {
+    goto err;
+  }
+  // Events with mask == AE_NONE are not set.
+  for (i = 0; i < set_size; i++) {
+    event_loop->events[i].mask = AE_NONE;
+  }
 
   return event_loop;
+
+err:
+  zfree(event_loop->timer_ids);
+  zfree(event_loop->timers);
+  zfree(event_loop->events);
+  zfree(event_loop->fired);
+  zfree(event_loop);
+  return NULL;
 }
 
 void AeDeleteEventLoop(AeEventLoop *event_loop) {
-  AeFileEvent *fe = event_loop->file_event_head;
-  AeTimeEvent *te = event_loop->time_event_head;
+  int i;
 
-  while (fe) {
-    AeFileEvent *cur = fe;
-    fe = fe->next;
-    zfree(cur);
-  }
-
-  while (te) {
-    AeTimeEvent *cur = te;
-    te = te->next;
-    zfree(cur);
+  for (i = 0; i < event_loop->timers_len; i++) {
+    zfree(event_loop->timers[i]);
   }
 
+  AeApiFree(event_loop);
+  zfree(event_loop->timer_ids);
+  zfree(event_loop->timers);
+  zfree(event_loop->events);
+  zfree(event_loop->fired);
   zfree(event_loop);
 }
 
@@ -73,93 +117,143 @@ void AeStop(AeEventLoop *event_loop) {
 int AeCreateFileEvent(AeEventLoop *event_loop, int fd, int mask,
                       AeFileProc *proc, void *client_data,
                       AeEventFinalizerProc *finalizer_proc) {
-  AeFileEvent *fe = event_loop->file_event_head;
-
-  while (fe) {
-    if (fe->fd == fd && fe->mask & mask) {
-      fe->file_proc = proc;
-      fe->finalizer_proc = finalizer_proc;
-      fe->client_data = client_data;
-      return AE_OK;
+  AeFileEvent *fe;
+
+  if (fd < 0) {
+    return AE_ERR;
+  }
+  if (fd >= event_loop->set_size) {
+    int set_size = event_loop->set_size * 2;
+    while (fd >= set_size) {
+      set_size *= 2;
+    }
+    if (AeResizeSetSize(event_loop, set_size) == AE_ERR) {
+      return AE_ERR;
     }
-    fe = fe->next;
   }
 
-  fe = zmalloc(sizeof(*fe));
-  if (fe == NULL) {
+  fe = &event_loop->events[fd];
+  if (AeApiAddEvent(event_loop, fd, mask) == AE_ERR) {
     return AE_ERR;
   }
-
-  fe->fd = fd;
-  fe->mask = mask;
-  fe->file_proc = proc;
+  fe->mask |= mask;
+  if (mask & AE_READABLE) {
+    fe->rfile_proc = proc;
+  }
+  if (mask & AE_WRITABLE) {
+    fe->wfile_proc = proc;
+  }
+  if (mask & AE_EXCEPTION) {
+    fe->efile_proc = proc;
+  }
   fe->finalizer_proc = finalizer_proc;
   fe->client_data = client_data;
-  fe->next = event_loop->file_event_head;
-  event_loop->file_event_head = fe;
+  if (fd > event_loop->max_fd) {
+    event_loop->max_fd = fd;
+  }
   return AE_OK;
 }
 
 void AeDeleteFileEvent(AeEventLoop *event_loop, int fd, int mask) {
   AeFileEvent *fe;
-  AeFileEvent *prev = NULL;
-
-  fe = event_loop->file_event_head;
-  while (fe) {
-    if (fe->fd == fd && fe->mask == mask) {
-       if (prev == NULL) {
-         event_loop->file_event_head = fe->next;
-       } else {
-         prev->next = fe->next;
-       }
-       zfree(fe);
-       return;
+
+  if (fd < 0 || fd >= event_loop->set_size) {
+    return;
+  }
+  fe = &event_loop->events[fd];
+  if (fe->mask == AE_NONE) {
+    return;
+  }
+
+  AeApiDelEvent(event_loop, fd, mask);
+  fe->mask = fe->mask & (~mask);
+  if (fd == event_loop->max_fd && fe->mask == AE_NONE) {
+    // Update the max fd
+    int j;
+
+    for (j = event_loop->max_fd - 1; j >= 0; j--) {
+      if (event_loop->events[j].mask != AE_NONE) {
+        break;
+      }
     }
-    prev = fe;
-    fe = fe->next;
+    event_loop->max_fd = j;
+  }
+}
+
+// Return the mask of the events registered for the given fd.
+int AeGetFileEvents(AeEventLoop *event_loop, int fd) {
+  if (fd < 0 || fd >= event_loop->set_size) {
+    return AE_NONE;
   }
+  return event_loop->events[fd].mask;
 }
 
 long long AeCreateTimeEvent(AeEventLoop *event_loop, long long milliseconds,
                             AeTimeProc *proc, void *client_data,
                             AeEventFinalizerProc *finalizer_proc) {
-    long long id = event_loop->time_event_next_id++;
-    AeTimeEvent *te;
+  long long id = event_loop->time_event_next_id++;
+  AeTimeEvent *te;
+
+  if (event_loop->timers_len == event_loop->timers_size) {
+    int size = event_loop->timers_size * 2;
+    AeTimeEvent **timers = zrealloc(event_loop->timers,
+                                    sizeof(AeTimeEvent*) * size);
+    AeTimeEvent **ids;
+    int i;
 
-    te = zmalloc(sizeof(*te));
-    if (te == NULL) {
+    if (timers == NULL) {
+      return AE_ERR;
+    }
+    event_loop->timers = timers;
+    ids = zrealloc(event_loop->timer_ids, sizeof(AeTimeEvent*) * size);
+    if (ids == NULL) {
       return AE_ERR;
     }
+    // Every time event is in the heap, so the id buckets are rebuilt
+    // from it.
+    memset(ids, 0, sizeof(AeTimeEvent*) * size);
+    event_loop->timer_ids = ids;
+    event_loop->timers_size = size;
+    for (i = 0; i < event_loop->timers_len; i++) {
+      te = event_loop->timers[i];
+      te->id_next = ids[te->id & (size - 1)];
+      ids[te->id & (size - 1)] = te;
+    }
+  }
 
-    te->id = id;
-    AeAddMillisecondsToNow(milliseconds, &te->when_sec, &te->when_ms);
-    te->time_proc = proc;
-    te->finalizer_proc = finalizer_proc;
-    te->client_data = client_data;
-    te->next = event_loop->time_event_head;
-    event_loop->time_event_head = te;
-    return id;
+  te = zmalloc(sizeof(*te));
+  if (te == NULL) {
+    return AE_ERR;
+  }
+
+  // A deadline in the past would put the event ahead of older due events
+  // in the heap, it fires as soon as possible instead.
+  if (milliseconds < 0) {
+    milliseconds = 0;
+  }
+  te->id = id;
+  te->when = AeGetMonotonicMs() + milliseconds;
+  te->time_proc = proc;
+  te->finalizer_proc = finalizer_proc;
+  te->client_data = client_data;
+  te->id_next = event_loop->timer_ids[id & (event_loop->timers_size - 1)];
+  event_loop->timer_ids[id & (event_loop->timers_size - 1)] = te;
+  te->heap_index = event_loop->timers_len++;
+  event_loop->timers[te->heap_index] = te;
+  AeTimerHeapUp(event_loop, te->heap_index);
+  return id;
 }
 
 int AeDeleteTimeEvent(AeEventLoop *event_loop, long long id) {
-  AeTimeEvent *te;
-  AeTimeEvent *prev = NULL;
+  AeTimeEvent *te = AeSearchTimer(event_loop, id);
 
-  te = event_loop->time_event_head;
-  while (te) {
-    if (te->id == id) {
-      if (prev == NULL) {
-        event_loop->time_event_head = te->next;
-      } else {
-        prev->next = te->next;
-      }
-      zfree(te);
-      return AE_OK;
-    }
-    prev = te;
-    te = te->next;
+  if (te == NULL) {
+    return AE_ERR;
   }
-  return AE_ERR;
+  AeUnlinkTimer(event_loop, te);
+  AeTimerHeapRemove(event_loop, te->heap_index);
+  zfree(te);
+  return AE_OK;
 }
 
 // Process every pending time event, then every pending file event
@@ -176,43 +270,19 @@ int AeDeleteTimeEvent(AeEventLoop *event_loop, long long id) {
 //
 // The function returns the number of events processed.
 int AeProcessEvents(AeEventLoop *event_loop, int flags) {
-  fd_set rfds, wfds, efds;
-  int max_fd = 0;
   int processed = 0;
 
   if (!(flags & AE_TIME_EVENTS) && !(flags & AE_FILE_EVENTS)) {
     return AE_OK;
   }
 
-  FD_ZERO(&rfds);
-  FD_ZERO(&wfds);
-  FD_ZERO(&efds);
-
-  // Check file events
-  if (flags & AE_FILE_EVENTS) {
-    AeFileEvent *fe = event_loop->file_event_head;
-    while (fe) {
-      if (fe->mask & AE_READABLE) {
-        FD_SET(fe->fd, &rfds);
-      }
-      if (fe->mask & AE_WRITABLE) {
-        FD_SET(fe->fd, &wfds);
-      }
-      if (fe->mask & AE_EXCEPTION) {
-        FD_SET(fe->fd, &efds);
-      }
-      if (max_fd < fe->fd) {
-        max_fd = fe->fd;
-      }
-      fe = fe->next;
-    }
-  }
-
-  // We want to call select() even if there are no file events to
-  // process as long as we want to process time events, in order
-  // to sleep until the next time event is ready to fire.
-  if (max_fd != 0 || ((flags & AE_TIME_EVENTS) && !(flags & AE_DONT_WAIT))) {
-    int ret_val;
+  // We want to call the polling backend even if there are no file events
+  // to process as long as we want to process time events, in order to
+  // sleep until the next time event is ready to fire.
+  if (event_loop->max_fd != -1 ||
+      ((flags & AE_TIME_EVENTS) && !(flags & AE_DONT_WAIT))) {
+    int num_events;
+    int j;
     AeTimeEvent *shortest = NULL;
     struct timeval tv, *tvp;
 
@@ -221,18 +291,14 @@ int AeProcessEvents(AeEventLoop *event_loop, int flags) {
     }
 
     if (shortest) {
-      long now_sec;
-      long now_ms;
+      long long ms = shortest->when - AeGetMonotonicMs();
 
-      AeGetTime(&now_sec, &now_ms);
-      tvp = &tv;
-      tvp->tv_sec = shortest->when_sec - now_sec;
-      if (shortest->when_ms < now_ms) {
-        tvp->tv_usec = ((shortest->when_ms + 1000) - now_ms) * 1000;
-        tvp->tv_sec--;
-      } else {
-        tvp->tv_usec = (shortest->when_ms - now_ms) * 1000;
+      if (ms < 0) {
+        ms = 0;
       }
+      tvp = &tv;
+      tvp->tv_sec = ms / 1000;
+      tvp->tv_usec = (ms % 1000) * 1000;
     } else {
       // If we have to check for events but need to return
       // ASAP because of AE_DONT_WAIT we need to set the timeout
@@ -247,82 +313,68 @@ int AeProcessEvents(AeEventLoop *event_loop, int flags) {
       }
     }
 
-    ret_val = select(max_fd + 1, &rfds, &wfds, &efds, tvp);
-    if (ret_val > 0) {
-      AeFileEvent *fe;
-      fe = event_loop->file_event_head;
-      while (fe) {
-        int fd = fe->fd;
-
-        if ((fe->mask & AE_READABLE && FD_ISSET(fd, &rfds)) ||
-            (fe->mask & AE_WRITABLE && FD_ISSET(fd, &wfds)) ||
-            (fe->mask & AE_EXCEPTION && FD_ISSET(fd, &efds))) {
-          int mask = 0;
-          if (fe->mask & AE_READABLE && FD_ISSET(fd, &rfds)) {
-            mask |= AE_READABLE;
-          }
-          if (fe->mask & AE_WRITABLE && FD_ISSET(fd, &wfds)) {
-            mask |= AE_WRITABLE;
-          }
-          if (fe->mask & AE_EXCEPTION && FD_ISSET(fd, &efds)) {
-            mask |= AE_EXCEPTION;
-          }
-          fe->file_proc(event_loop, fd, fe->client_data, mask);
-          processed++;
-          // After an event is processed our file event list
-          // may no longer be the same, so what we do is to
-          // clear the bit for this file descriptor and
-          // restart again from the head.
-          fe = event_loop->file_event_head;
-          FD_CLR(fd, &rfds);
-          FD_CLR(fd, &wfds);
-          FD_CLR(fd, &efds);
-        } else {
-          fe = fe->next;
+    num_events = AeApiPoll(event_loop, tvp);
+    if (num_events == AE_ERR) {
+      exit(1);
+    }
+    for (j = 0; j < num_events; j++) {
+      int fd = event_loop->fired[j].fd;
+      int mask = event_loop->fired[j].mask;
+      AeFileEvent *fe = &event_loop->events[fd];
+      int rfired = 0;
+
+      // Note the fe->mask & mask & ... code: maybe an already processed
+      // event removed an element that fired and we still didn't
+      // processed, so we check if the event is still valid.
+      if (fe->mask & mask & AE_READABLE) {
+        rfired = 1;
+        fe->rfile_proc(event_loop, fd, fe->client_data, mask);
+      }
+      if (fe->mask & mask & AE_WRITABLE) {
+        if (!rfired || fe->wfile_proc != fe->rfile_proc) {
+          fe->wfile_proc(event_loop, fd, fe->client_data, mask);
         }
       }
-    } else if (ret_val < 0) {
-      if (errno != EINTR) {
-        exit(1);
+      if (fe->mask & mask & AE_EXCEPTION) {
+        fe->efile_proc(event_loop, fd, fe->client_data, mask);
       }
+      processed++;
     }
   }
 
   // Check time events
   if (flags & AE_TIME_EVENTS) {
+    // We make sure to don't process events registered by event handlers
+    // itself, and to run every event at most once per call, in order to
+    // don't loop forever. To do so we saved the max ID we want to handle
+    // and the number of events that may fire. A new event is never due
+    // before the older ones, the heap breaks ties of 'when' by id, so
+    // meeting one on top of the heap means no older event is due.
     long long max_id = event_loop->time_event_next_id - 1;
-    AeTimeEvent *te = event_loop->time_event_head;
+    int budget = event_loop->timers_len;
+    long long now = AeGetMonotonicMs();
 
-    while (te) {
-      long now_sec;
-      long now_ms;
+    while (budget-- > 0 && event_loop->timers_len > 0) {
+      AeTimeEvent *te = event_loop->timers[0];
+      long long id;
+      int ret;
 
-      if (te->id > max_id) {
-        te = te->next;
-        continue;
+      if (te->when > now || te->id > max_id) {
+        break;
       }
 
-      AeGetTime(&now_sec, &now_ms);
-      if (now_sec > te->when_sec ||
-          (now_sec == te->when_sec && now_ms >= te->when_ms)) {
-        int ret;
-        long long id;
-
-        id = te->id;
-        ret = te->time_proc(event_loop, id, te->client_data);
-        // After an event is processed, our time event list may no
-        // longer be the same, so we restart from head.
-        // Still we make sure to don't process events registered
-        // by event handlers itself in order to don't loop forever.
-        // To do so we saved the max ID we want to handle.
-        if (ret != AE_NOMORE) {
-          AeAddMillisecondsToNow(ret, &te->when_sec, &te->when_ms);
-        } else {
-          AeDeleteTimeEvent(event_loop, id);
-        }
-        te = event_loop->time_event_head;
+      id = te->id;
+      ret = te->time_proc(event_loop, id, te->client_data);
+      // The handler may have deleted its own event, so look it up again.
+      if ((te = AeSearchTimer(event_loop, id)) == NULL) {
+        continue;
+      }
+      if (ret != AE_NOMORE) {
+        te->when = AeGetMonotonicMs() + ret;
+        AeTimerHeapDown(event_loop, te->heap_index);
+        AeTimerHeapUp(event_loop, te->heap_index);
       } else {
-        te = te->next;
+        AeDeleteTimeEvent(event_loop, id);
       }
     }
   }
@@ -333,36 +385,34 @@ int AeProcessEvents(AeEventLoop *event_loop, int flags) {
 // Wait for milliseconds until the given file descriptor becomes
 // writable, readable or exception.
 int AeWait(int fd, int mask, long long milliseconds) {
-  struct timeval tv;
-  fd_set rfds, wfds, efds;
+  struct pollfd pfd;
   int ret_mask = 0;
   int ret_val = 0;
 
-  tv.tv_sec = milliseconds / 1000;
-  tv.tv_usec = (milliseconds % 1000) * 1000;
-  FD_ZERO(&rfds);
-  FD_ZERO(&wfds);
-  FD_ZERO(&efds);
-
+  memset(&pfd, 0, sizeof(pfd));
+  pfd.fd = fd;
   if (mask & AE_READABLE) {
-    FD_SET(fd, &rfds);
+    pfd.events |= POLLIN;
   }
   if (mask & AE_WRITABLE) {
-    FD_SET(fd, &wfds);
+    pfd.events |= POLLOUT;
   }
   if (mask & AE_EXCEPTION) {
-    FD_SET(fd, &efds);
+    pfd.events |= POLLPRI;
   }
-  if ((ret_val = select(fd + 1, &rfds, &wfds, &efds, &tv)) > 0) {
-    if (FD_ISSET(fd, &rfds)) {
+  if ((ret_val = poll(&pfd, 1, milliseconds)) == 1) {
+    if (pfd.revents & POLLIN) {
       ret_mask |= AE_READABLE;
     }
-    if (FD_ISSET(fd, &wfds)) {
+    if (pfd.revents & POLLOUT) {
       ret_mask |= AE_WRITABLE;
     }
-    if (FD_ISSET(fd, &efds)) {
+    if (pfd.revents & POLLPRI) {
       ret_mask |= AE_EXCEPTION;
     }
+    if (pfd.revents & (POLLERR | POLLHUP)) {
+      ret_mask |= AE_WRITABLE;
+    }
     return ret_mask;
   } else {
     return ret_val;
@@ -372,44 +422,155 @@ int AeWait(int fd, int mask, long long milliseconds) {
 void AeMain(AeEventLoop *eventLoop) {
     eventLoop->stop = 0;
     while (!eventLoop->stop) {
+      if (eventLoop->before_sleep != NULL) {
+        eventLoop->before_sleep(eventLoop);
+      }
       AeProcessEvents(eventLoop, AE_ALL_EVENTS);
     }
 }
 
+void AeSetBeforeSleepProc(AeEventLoop *event_loop,
+                          AeBeforeSleepProc *before_sleep) {
+  event_loop->before_sleep = before_sleep;
+}
+
+const char *AeGetApiName() {
+  return AeApiName();
+}
+
 // Private functions
+
+// Resize the maximum set size of the event loop. The polling backend may
+// refuse the new size, e.g. select can't handle more than FD_SETSIZE fds.
+static int AeResizeSetSize(AeEventLoop *event_loop, int set_size) {
+  AeFileEvent *events;
+  AeFiredEvent *fired;
+  int i;
+
+  if (set_size <= event_loop->set_size) {
+    return AE_OK;
+  }
+  if (AeApiResize(event_loop, set_size) == AE_ERR) {
+    return AE_ERR;
+  }
+  events = zrealloc(event_loop->events, sizeof(AeFileEvent) * set_size);
+  if (!events) {
+    return AE_ERR;
+  }
+  event_loop->events = events;
+  fired = zrealloc(event_loop->fired, sizeof(AeFiredEvent) * set_size);
+  if (!fired) {
+    return AE_ERR;
+  }
+  event_loop->fired = fired;
+
+  // Make sure that if we created new slots, they are initialized with
+  // an AE_NONE mask.
+  for (i = event_loop->set_size; i < set_size; i++) {
+    event_loop->events[i].mask = AE_NONE;
+  }
+  event_loop->set_size = set_size;
+  return AE_OK;
+}
+
+// Return the milliseconds elapsed on a clock that is not affected by
+// system time changes.
+long long AeGetMonotonicMs() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((long long)ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
 static AeTimeEvent *AeSearchNearestTimer(AeEventLoop *event_loop) {
-  AeTimeEvent *te = event_loop->time_event_head;
-  AeTimeEvent *nearest = NULL;
-
-  while (te) {
-    if (!nearest || te->when_sec < nearest->when_sec ||
-        (te->when_sec == nearest->when_sec &&
-         te->when_ms < nearest->when_ms)) {
-      nearest = te;
+  if (event_loop->timers_len == 0) {
+    return NULL;
+  }
+  return event_loop->timers[0];
+}
+
+static void AeTimerHeapSwap(AeEventLoop *event_loop, int i, int j) {
+  AeTimeEvent *te = event_loop->timers[i];
+
+  event_loop->timers[i] = event_loop->timers[j];
+  event_loop->timers[j] = te;
+  event_loop->timers[i]->heap_index = i;
+  event_loop->timers[j]->heap_index = j;
+}
+
+// Whether time event a fires before b: the nearest deadline first, the
+// older event first if both are due at once.
+static int AeTimerBefore(AeTimeEvent *a, AeTimeEvent *b) {
+  return a->when < b->when || (a->when == b->when && a->id < b->id);
+}
+
+static void AeTimerHeapUp(AeEventLoop *event_loop, int index) {
+  while (index > 0) {
+    int parent = (index - 1) / 2;
+    if (!AeTimerBefore(event_loop->timers[index],
+                       event_loop->timers[parent])) {
+      break;
     }
-    te = te->next;
+    AeTimerHeapSwap(event_loop, parent, index);
+    index = parent;
   }
+}
+
+static void AeTimerHeapDown(AeEventLoop *event_loop, int index) {
+  while (1) {
+    int left = index * 2 + 1;
+    int right = left + 1;
+    int smallest = index;
 
-  return nearest;
+    if (left < event_loop->timers_len &&
+        AeTimerBefore(event_loop->timers[left],
+                      event_loop->timers[smallest])) {
+      smallest = left;
+    }
+    if (right < event_loop->timers_len &&
+        AeTimerBefore(event_loop->timers[right],
+                      event_loop->timers[smallest])) {
+      smallest = right;
+    }
+    if (smallest == index) {
+      break;
+    }
+    AeTimerHeapSwap(event_loop, index, smallest);
+    index = smallest;
+  }
+}
+
+// Remove the time event at the given heap position, moving the last
+// event into the hole and restoring the heap property.
+static void AeTimerHeapRemove(AeEventLoop *event_loop, int index) {
+  int last = --event_loop->timers_len;
+
+  if (index != last) {
+    event_loop->timers[index] = event_loop->timers[last];
+    event_loop->timers[index]->heap_index = index;
+    AeTimerHeapDown(event_loop, index);
+    AeTimerHeapUp(event_loop, index);
+  }
+  event_loop->timers[last] = NULL;
 }
 
-static void AeGetTime(long *seconds, long *milliseconds) {
-  struct timeval tv;
+// Find a time event by id in its timer_ids bucket.
+static AeTimeEvent *AeSearchTimer(AeEventLoop *event_loop, long long id) {
+  AeTimeEvent *te = event_loop->timer_ids[id & (event_loop->timers_size - 1)];
 
-  gettimeofday(&tv, NULL);
-  *seconds = tv.tv_sec;
-  *milliseconds = tv.tv_usec / 1000;
+  while (te != NULL && te->id != id) {
+    te = te->id_next;
+  }
+  return te;
 }
 
-static void AeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms) {
-  long cur_sec;
-  long cur_ms;
+// Remove a time event from its timer_ids bucket.
+static void AeUnlinkTimer(AeEventLoop *event_loop, AeTimeEvent *te) {
+  AeTimeEvent **link =
+      &event_loop->timer_ids[te->id & (event_loop->timers_size - 1)];
 
-  AeGetTime(&cur_sec, &cur_ms);
-  *sec = cur_sec + milliseconds / 1000;
-  *ms = cur_ms + milliseconds % 1000;
-  if (*ms >= 1000) {
-    *sec = *sec + 1;
-    *ms = *ms - 1000;
+  while (*link != te) {
+    link = &(*link)->id_next;
   }
+  *link = te->id_next;
 }
@@ -30,40 +30,58 @@ typedef int AeTimeProc(struct AeEventLoop *event_loop,
                        long long id, void *client_data);
 typedef int AeEventFinalizerProc(struct AeEventLoop *event_loop,
                                  void *client_data);
+typedef void AeBeforeSleepProc(struct AeEventLoop *event_loop);
 
-// File event structure
+// File event structure, indexed by fd in AeEventLoop::events
 typedef struct AeFileEvent {
-  int fd;
   int mask; // one of AE_(READABLE|WRITABLE|EXCEPTION)
-  AeFileProc *file_proc;
+  AeFileProc *rfile_proc;
+  AeFileProc *wfile_proc;
+  AeFileProc *efile_proc;
   AeEventFinalizerProc *finalizer_proc;
   void *client_data;
-  struct AeFileEvent *next;
 } AeFileEvent;
 
-// Time event structure
+// Time event structure, kept in a binary min-heap ordered by 'when', then
+// by 'id', so of two events due at once the older fires first.
 typedef struct AeTimeEvent {
-  long long id;  // time event identifier
-  long when_sec;  // second
-  long when_ms;   // milliseconds
+  long long id;     // time event identifier
+  long long when;   // deadline in milliseconds of the monotonic clock
+  int heap_index;   // position in AeEventLoop::timers
+  struct AeTimeEvent *id_next;  // next event in the same timer_ids bucket
   AeTimeProc *time_proc;
   AeEventFinalizerProc *finalizer_proc;
   void *client_data;
-  struct AeTimeEvent *next;
 } AeTimeEvent;
 
+// A fired event, filled by the polling backend
+typedef struct AeFiredEvent {
+  int fd;
+  int mask;
+} AeFiredEvent;
+
 // State of an event based program
 typedef struct AeEventLoop {
+  int max_fd;             // highest registered fd, -1 if none
+  int set_size;           // number of slots in events and fired
   long long time_event_next_id;
-  AeFileEvent *file_event_head;
-  AeTimeEvent *time_event_head;
+  AeFileEvent *events;    // registered file events
+  AeFiredEvent *fired;    // fired file events
+  AeTimeEvent **timers;   // min-heap of time events, nearest first
+  int timers_len;         // number of time events in the heap
+  int timers_size;        // allocated slots of the heap and of timer_ids
+  AeTimeEvent **timer_ids;  // time events by id, buckets indexed by the
+                            // low bits of the id
   int stop;
+  void *api_data;         // polling backend specific data
+  AeBeforeSleepProc *before_sleep;  // called before waiting for events
 } AeEventLoop;
 
 // Defines
 #define AE_OK 0
 #define AE_ERR -1
 
+#define AE_NONE 0
 #define AE_READABLE 1
 #define AE_WRITABLE 2
 #define AE_EXCEPTION 4
@@ -77,7 +95,7 @@ typedef struct AeEventLoop {
 
 #define AE_NOT_USED(v) ((void)v)
 
-AeEventLoop *AeCreateEventLoop();
+AeEventLoop *AeCreateEventLoop(int set_size);
 void AeDeleteEventLoop(AeEventLoop *event_loop);
 void AeStop(AeEventLoop *event_loop);
 
@@ -85,6 +103,7 @@ int AeCreateFileEvent(AeEventLoop *event_loop, int fd, int mask,
                       AeFileProc *proc, void *client_data,
                       AeEventFinalizerProc *finalizer_proc);
 void AeDeleteFileEvent(AeEventLoop *event_loop, int fd, int mask);
+int AeGetFileEvents(AeEventLoop *event_loop, int fd);
 
 long long AeCreateTimeEvent(AeEventLoop *event_loop, long long milliseconds,
                             AeTimeProc *proc, void *client_data,
@@ -95,5 +114,9 @@ int AeProcessEvents(AeEventLoop *event_loop, int flags);
 int AeWait(int fd, int mask, long long milliseconds);
 
 void AeMain(AeEventLoop *eventLoop);
+void AeSetBeforeSleepProc(AeEventLoop *event_loop,
+                          AeBeforeSleepProc *before_sleep);
+long long AeGetMonotonicMs();
+const char *AeGetApiName();
 
 #endif  // AE_H_
@@ -0,0 +1,160 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Linux epoll(2) based polling backend. This file is included by ae.c.
+
+#include <sys/epoll.h>
+
+typedef struct AeApiState {
+  int epfd;
+  struct epoll_event *events;
+} AeApiState;
+
+static int AeApiCreate(AeEventLoop *event_loop) {
+  AeApiState *state = zmalloc(sizeof(*state));
+
+  if (!state) {
+    return AE_ERR;
+  }
+  state->events = zmalloc(sizeof(struct epoll_event) * event_loop->set_size);
+  if (!state->events) {
+    zfree(state);
+    return AE_ERR;
+  }
+  state->epfd = epoll_create(1024);  // 1024 is just a hint for the kernel
+  if (state->epfd == -1) {
+    zfree(state->events);
+    zfree(state);
+    return AE_ERR;
+  }
+  event_loop->api_data = state;
+  return AE_OK;
+}
+
+static int AeApiResize(AeEventLoop *event_loop, int set_size) {
+  AeApiState *state = event_loop->api_data;
+  struct epoll_event *events;
+
+  events = zrealloc(state->events, sizeof(struct epoll_event) * set_size);
+  if (!events) {
+    return AE_ERR;
+  }
+  state->events = events;
+  return AE_OK;
+}
+
+static void AeApiFree(AeEventLoop *event_loop) {
+  AeApiState *state = event_loop->api_data;
+
+  close(state->epfd);
+  zfree(state->events);
+  zfree(state);
+}
+
+static int AeApiAddEvent(AeEventLoop *event_loop, int fd, int mask) {
+  AeApiState *state = event_loop->api_data;
+  struct epoll_event ee = {0};
+  // If the fd was already monitored for some event, we need a MOD
+  // operation. Otherwise, we need an ADD operation.
+  int op = event_loop->events[fd].mask == AE_NONE ?
+           EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+
+  mask |= event_loop->events[fd].mask;  // merge old events
+  if (mask & AE_READABLE) {
+    ee.events |= EPOLLIN;
+  }
+  if (mask & AE_WRITABLE) {
+    ee.events |= EPOLLOUT;
+  }
+  if (mask & AE_EXCEPTION) {
+    ee.events |= EPOLLPRI;
+  }
+  ee.data.fd = fd;
+  if (epoll_ctl(state->epfd, op, fd, &ee) == -1) {
+    return AE_ERR;
+  }
+  return AE_OK;
+}
+
+static void AeApiDelEvent(AeEventLoop *event_loop, int fd, int del_mask) {
+  AeApiState *state = event_loop->api_data;
+  struct epoll_event ee = {0};
+  int mask = event_loop->events[fd].mask & (~del_mask);
+
+  if (mask & AE_READABLE) {
+    ee.events |= EPOLLIN;
+  }
+  if (mask & AE_WRITABLE) {
+    ee.events |= EPOLLOUT;
+  }
+  if (mask & AE_EXCEPTION) {
+    ee.events |= EPOLLPRI;
+  }
+  ee.data.fd = fd;
+  if (mask != AE_NONE) {
+    epoll_ctl(state->epfd, EPOLL_CTL_MOD, fd, &ee);
+  } else {
+    // Note, Kernel < 2.6.9 requires a non null event pointer even
+    // for EPOLL_CTL_DEL.
+    epoll_ctl(state->epfd, EPOLL_CTL_DEL, fd, &ee);
+  }
+}
+
+static int AeApiPoll(AeEventLoop *event_loop, struct timeval *tvp) {
+  AeApiState *state = event_loop->api_data;
+  int ret_val;
+  int num_events = 0;
+
+  ret_val = epoll_wait(state->epfd, state->events, event_loop->set_size,
+                       tvp ? (tvp->tv_sec * 1000 + tvp->tv_usec / 1000) : -1);
+  if (ret_val > 0) {
+    int j;
+
+    num_events = ret_val;
+    for (j = 0; j < num_events; j++) {
+      int mask = 0;
+      struct epoll_event *e = state->events + j;
+
+      if (e->events & EPOLLIN) {
+        mask |= AE_READABLE;
+      }
+      if (e->events & EPOLLOUT) {
+        mask |= AE_WRITABLE;
+      }
+      if (e->events & EPOLLPRI) {
+        mask |= AE_EXCEPTION;
+      }
+      // Errors and hang ups are reported to every registered handler,
+      // the read or write call will then return the actual error.
+      if (e->events & (EPOLLERR | EPOLLHUP)) {
+        mask |= AE_READABLE | AE_WRITABLE;
+      }
+      event_loop->fired[j].fd = e->data.fd;
+      event_loop->fired[j].mask = mask;
+    }
+  } else if (ret_val < 0 && errno != EINTR) {
+    return AE_ERR;
+  }
+  return num_events;
+}
+
+static const char *AeApiName() {
+  return "epoll";
+}
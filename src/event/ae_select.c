@@ -0,0 +1,134 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+// Portable select(2) based polling backend. This file is included by ae.c.
+// It can't handle file descriptors greater than or equal to FD_SETSIZE.
+
+#include <sys/select.h>
+
+typedef struct AeApiState {
+  fd_set rfds, wfds, efds;
+  // We need to have a copy of the fd sets as it's not safe to reuse
+  // FD sets after select().
+  fd_set _rfds, _wfds, _efds;
+} AeApiState;
+
+static int AeApiCreate(AeEventLoop *event_loop) {
+  AeApiState *state = zmalloc(sizeof(*state));
+
+  if (!state) {
+    return AE_ERR;
+  }
+  FD_ZERO(&state->rfds);
+  FD_ZERO(&state->wfds);
+  FD_ZERO(&state->efds);
+  event_loop->api_data = state;
+  return AE_OK;
+}
+
+static int AeApiResize(AeEventLoop *event_loop, int set_size) {
+  AE_NOT_USED(event_loop);
+  // Just ensure we have enough room in the fd_set type.
+  if (set_size > FD_SETSIZE) {
+    return AE_ERR;
+  }
+  return AE_OK;
+}
+
+static void AeApiFree(AeEventLoop *event_loop) {
+  zfree(event_loop->api_data);
+}
+
+static int AeApiAddEvent(AeEventLoop *event_loop, int fd, int mask) {
+  AeApiState *state = event_loop->api_data;
+
+  if (fd >= FD_SETSIZE) {
+    return AE_ERR;
+  }
+  if (mask & AE_READABLE) {
+    FD_SET(fd, &state->rfds);
+  }
+  if (mask & AE_WRITABLE) {
+    FD_SET(fd, &state->wfds);
+  }
+  if (mask & AE_EXCEPTION) {
+    FD_SET(fd, &state->efds);
+  }
+  return AE_OK;
+}
+
+static void AeApiDelEvent(AeEventLoop *event_loop, int fd, int mask) {
+  AeApiState *state = event_loop->api_data;
+
+  if (mask & AE_READABLE) {
+    FD_CLR(fd, &state->rfds);
+  }
+  if (mask & AE_WRITABLE) {
+    FD_CLR(fd, &state->wfds);
+  }
+  if (mask & AE_EXCEPTION) {
+    FD_CLR(fd, &state->efds);
+  }
+}
+
+static int AeApiPoll(AeEventLoop *event_loop, struct timeval *tvp) {
+  AeApiState *state = event_loop->api_data;
+  int ret_val;
+  int j;
+  int num_events = 0;
+
+  memcpy(&state->_rfds, &state->rfds, sizeof(fd_set));
+  memcpy(&state->_wfds, &state->wfds, sizeof(fd_set));
+  memcpy(&state->_efds, &state->efds, sizeof(fd_set));
+
+  ret_val = select(event_loop->max_fd + 1, &state->_rfds, &state->_wfds,
+                   &state->_efds, tvp);
+  if (ret_val > 0) {
+    for (j = 0; j <= event_loop->max_fd; j++) {
+      int mask = 0;
+      AeFileEvent *fe = &event_loop->events[j];
+
+      if (fe->mask == AE_NONE) {
+        continue;
+      }
+      if (fe->mask & AE_READABLE && FD_ISSET(j, &state->_rfds)) {
+        mask |= AE_READABLE;
+      }
+      if (fe->mask & AE_WRITABLE && FD_ISSET(j, &state->_wfds)) {
+        mask |= AE_WRITABLE;
+      }
+      if (fe->mask & AE_EXCEPTION && FD_ISSET(j, &state->_efds)) {
+        mask |= AE_EXCEPTION;
+      }
+      if (mask) {
+        event_loop->fired[num_events].fd = j;
+        event_loop->fired[num_events].mask = mask;
+        num_events++;
+      }
+    }
+  } else if (ret_val < 0 && errno != EINTR) {
+    return AE_ERR;
+  }
+  return num_events;
+}
+
+static const char *AeApiName() {
+  return "select";
+}
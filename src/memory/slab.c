@@ -0,0 +1,237 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "memory/slab.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "memory/zmalloc.h"
+
+// Slabs are aligned to their size, so the slab of a chunk is found by
+// masking its address. The header is at the start of the slab.
+typedef struct Slab {
+  struct Slab *prev;
+  struct Slab *next;
+  void *free;         // freed chunks, linked through their first word
+  char *unused;       // chunks never allocated start here
+  unsigned int used;  // chunks in use
+  unsigned int cls;   // size class
+} Slab;
+
+// Every slab of a class is in one of three lists depending on its
+// occupancy. Chunks are taken from partially used slabs first, so the
+// empty ones stay empty and can be released.
+typedef struct SlabClass {
+  Slab *partial;   // slabs with both used and free chunks
+  Slab *full;      // slabs without free chunks
+  Slab *empty;     // slabs without used chunks
+  size_t slabs;
+  size_t empty_num;
+  size_t used;
+} SlabClass;
+
+#define SLAB_CHUNK_SIZE(cls)  (((cls) + 1) * SLAB_ALIGN)
+#define SLAB_FIRST_CHUNK(s)   ((char*)(s) + sizeof(Slab))
+#define SLAB_END(s)           ((char*)(s) + SLAB_SIZE)
+
+// Empty slabs kept by slab_reclaim() in every class, to absorb the
+// alloc/free patterns around a slab boundary.
+#define SLAB_SPARE_EMPTY  1
+
+static SlabClass classes[SLAB_CLASSES];
+
+static int SlabHasRoom(Slab *slab) {
+  return slab->free != NULL ||
+         slab->unused + SLAB_CHUNK_SIZE(slab->cls) <= SLAB_END(slab);
+}
+
+static void SlabUnlink(Slab **list, Slab *slab) {
+  if (slab->prev) {
+    slab->prev->next = slab->next;
+  } else {
+    *list = slab->next;
+  }
+  if (slab->next) {
+    slab->next->prev = slab->prev;
+  }
+}
+
+static void SlabLink(Slab **list, Slab *slab) {
+  slab->prev = NULL;
+  slab->next = *list;
+  if (*list) {
+    (*list)->prev = slab;
+  }
+  *list = slab;
+}
+
+static Slab *SlabCreate(unsigned int cls) {
+  Slab *slab = zmalloc_aligned(SLAB_SIZE, SLAB_SIZE);
+
+  if (slab == NULL) {
+    return NULL;
+  }
+  slab->free = NULL;
+  slab->unused = SLAB_FIRST_CHUNK(slab);
+  slab->used = 0;
+  slab->cls = cls;
+  classes[cls].slabs++;
+  return slab;
+}
+
+static void SlabDestroy(Slab *slab) {
+  classes[slab->cls].slabs--;
+  zfree_aligned(slab, SLAB_SIZE);
+}
+
+void *slab_alloc(size_t size) {
+  SlabClass *sc;
+  Slab *slab;
+  void *ptr;
+  unsigned int cls;
+
+  if (size == 0 || size > SLAB_MAX_SIZE) {
+    return zmalloc(size);
+  }
+  cls = (size - 1) / SLAB_ALIGN;
+  sc = &classes[cls];
+  if ((slab = sc->partial) == NULL) {
+    if ((slab = sc->empty) != NULL) {
+      SlabUnlink(&sc->empty, slab);
+      sc->empty_num--;
+    } else if ((slab = SlabCreate(cls)) == NULL) {
+      return NULL;
+    }
+    SlabLink(&sc->partial, slab);
+  }
+
+  if (slab->free) {
+    ptr = slab->free;
+    slab->free = *(void**)ptr;
+  } else {
+    ptr = slab->unused;
+    slab->unused += SLAB_CHUNK_SIZE(cls);
+  }
+  slab->used++;
+  sc->used++;
+  if (!SlabHasRoom(slab)) {
+    SlabUnlink(&sc->partial, slab);
+    SlabLink(&sc->full, slab);
+  }
+  return ptr;
+}
+
+void slab_free(void *ptr, size_t size) {
+  SlabClass *sc;
+  Slab *slab;
+
+  if (ptr == NULL) {
+    return;
+  }
+  if (size == 0 || size > SLAB_MAX_SIZE) {
+    zfree(ptr);
+    return;
+  }
+  slab = (Slab*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+  assert(slab->cls == (size - 1) / SLAB_ALIGN && slab->used > 0);
+  sc = &classes[slab->cls];
+  if (!SlabHasRoom(slab)) {
+    SlabUnlink(&sc->full, slab);
+    SlabLink(&sc->partial, slab);
+  }
+  *(void**)ptr = slab->free;
+  slab->free = ptr;
+  sc->used--;
+  if (--slab->used == 0) {
+    SlabUnlink(&sc->partial, slab);
+    SlabLink(&sc->empty, slab);
+    sc->empty_num++;
+  }
+}
+
+// Give the empty slabs back to the allocator, but a few spare ones per
+// class. Returns the number of bytes released.
+size_t slab_reclaim() {
+  size_t released = 0;
+  int i;
+
+  for (i = 0; i < SLAB_CLASSES; i++) {
+    SlabClass *sc = &classes[i];
+
+    while (sc->empty_num > SLAB_SPARE_EMPTY) {
+      Slab *slab = sc->empty;
+
+      SlabUnlink(&sc->empty, slab);
+      sc->empty_num--;
+      SlabDestroy(slab);
+      released += SLAB_SIZE;
+    }
+  }
+  return released;
+}
+
+// Bytes of the slabs not used by any chunk, they are reused before
+// anything else is allocated.
+size_t slab_unused_memory() {
+  size_t unused = 0;
+  int i;
+
+  for (i = 0; i < SLAB_CLASSES; i++) {
+    SlabStats st;
+
+    slab_get_stats(i, &st);
+    unused += (st.capacity - st.used) * st.size;
+  }
+  return unused;
+}
+
+void slab_get_stats(int cls, SlabStats *stats) {
+  SlabClass *sc = &classes[cls];
+  size_t size = SLAB_CHUNK_SIZE(cls);
+
+  stats->size = size;
+  stats->slabs = sc->slabs;
+  stats->empty = sc->empty_num;
+  stats->used = sc->used;
+  stats->capacity = sc->slabs * ((SLAB_SIZE - sizeof(Slab)) / size);
+}
+
+static void SlabReleaseList(Slab **list) {
+  while (*list) {
+    Slab *slab = *list;
+
+    *list = slab->next;
+    SlabDestroy(slab);
+  }
+}
+
+// Release every slab, at shutdown once all the chunks are freed.
+void slab_release() {
+  int i;
+
+  for (i = 0; i < SLAB_CLASSES; i++) {
+    SlabReleaseList(&classes[i].partial);
+    SlabReleaseList(&classes[i].full);
+    SlabReleaseList(&classes[i].empty);
+    classes[i].empty_num = 0;
+    classes[i].used = 0;
+  }
+}
@@ -0,0 +1,56 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MEMORY_SLAB_H_
+#define MEMORY_SLAB_H_
+
+#include <stddef.h>
+
+// A slab allocator for the small fixed size structures allocated and freed
+// all the time: objects, dict entries and list nodes. Chunks of the same
+// size class are carved from 16KB slabs and recycled through free lists
+// kept inside the free chunks themselves, so there is no per chunk header.
+// The caller passes the size back on free. Sizes above SLAB_MAX_SIZE go to
+// zmalloc().
+//
+// The allocator is not thread safe, it must only be used by the main
+// thread.
+
+#define SLAB_SIZE         (16 * 1024)
+#define SLAB_ALIGN        8
+#define SLAB_MAX_SIZE     64
+#define SLAB_CLASSES      (SLAB_MAX_SIZE / SLAB_ALIGN)
+
+typedef struct SlabStats {
+  size_t size;      // chunk size of the class
+  size_t slabs;     // slabs allocated
+  size_t empty;     // slabs without any chunk in use
+  size_t used;      // chunks in use
+  size_t capacity;  // chunks fitting in all the slabs
+} SlabStats;
+
+void *slab_alloc(size_t size);
+void slab_free(void *ptr, size_t size);
+size_t slab_reclaim();
+size_t slab_unused_memory();
+void slab_get_stats(int cls, SlabStats *stats);
+void slab_release();
+
+#endif  // MEMORY_SLAB_H_
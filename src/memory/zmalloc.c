@@ -20,20 +20,46 @@
 
 #include "memory/zmalloc.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+// Without allocator support the size is stored in a prefix.
+#ifdef HAVE_MALLOC_SIZE
+#define PREFIX_SIZE 0
+#else
+#define PREFIX_SIZE sizeof(size_t)
+#endif
+
+// The counter is updated atomically since I/O threads allocate as well.
+#define update_zmalloc_stat_add(n) \
+  __atomic_add_fetch(&used_memory, (n), __ATOMIC_RELAXED)
+#define update_zmalloc_stat_sub(n) \
+  __atomic_sub_fetch(&used_memory, (n), __ATOMIC_RELAXED)
 
 static size_t used_memory = 0;
 
 void *zmalloc(size_t size) {
-  void *ptr = malloc(size + sizeof(size_t));
+  void *ptr = malloc(size + PREFIX_SIZE);
+
+  if (ptr == NULL) {
+    return NULL;
+  }
+#ifdef HAVE_MALLOC_SIZE
+  update_zmalloc_stat_add(zmalloc_size(ptr));
+  return ptr;
+#else
   *((size_t*)ptr) = size;
-  used_memory += size + sizeof(size_t);
-  return ptr + sizeof(size_t);
+  update_zmalloc_stat_add(size + PREFIX_SIZE);
+  return (char*)ptr + PREFIX_SIZE;
+#endif
 }
 
 void *zrealloc(void *ptr, size_t size) {
+#ifndef HAVE_MALLOC_SIZE
   void *realptr;
+#endif
   size_t oldsize;
   void *newptr;
 
@@ -41,41 +67,116 @@ void *zrealloc(void *ptr, size_t size) {
     return zmalloc(size);
   }
 
-  realptr = ptr - sizeof(size_t);
+#ifdef HAVE_MALLOC_SIZE
+  oldsize = zmalloc_size(ptr);
+  newptr = realloc(ptr, size);
+  if (newptr == NULL) {
+    return NULL;
+  }
+  update_zmalloc_stat_sub(oldsize);
+  update_zmalloc_stat_add(zmalloc_size(newptr));
+  return newptr;
+#else
+  realptr = (char*)ptr - PREFIX_SIZE;
   oldsize = *((size_t*)realptr);
-  newptr = realloc(realptr, size + sizeof(size_t));
-  if (!newptr) {
+  newptr = realloc(realptr, size + PREFIX_SIZE);
+  if (newptr == NULL) {
     return NULL;
   }
-
   *((size_t*)newptr) = size;
-  used_memory -= oldsize;
-  used_memory += size;
-  return newptr + sizeof(size_t);
+  update_zmalloc_stat_sub(oldsize + PREFIX_SIZE);
+  update_zmalloc_stat_add(size + PREFIX_SIZE);
+  return (char*)newptr + PREFIX_SIZE;
+#endif
 }
 
-void zfree(void *ptr) {
-  void *realptr;
-  size_t oldsize;
+#ifndef HAVE_MALLOC_SIZE
+// The size of an allocation, prefix included.
+size_t zmalloc_size(void *ptr) {
+  return *((size_t*)((char*)ptr - PREFIX_SIZE)) + PREFIX_SIZE;
+}
+#endif
 
+void zfree(void *ptr) {
   if (ptr == NULL) {
     return;
   }
 
-  realptr = ptr - sizeof(size_t);
-  oldsize = *((size_t*)realptr);
-  used_memory -= oldsize + sizeof(size_t);
-  free(realptr);
+  update_zmalloc_stat_sub(zmalloc_size(ptr));
+  free((char*)ptr - PREFIX_SIZE);
 }
 
 char *zstrdup(const char *s) {
   size_t l = strlen(s) + 1;
   char *p = zmalloc(l);
 
+  if (p == NULL) {
+    return NULL;
+  }
   memcpy(p, s, l);
   return p;
 }
 
+// Allocate size bytes aligned to align, a power of two multiple of
+// sizeof(void*). There is no size prefix, the memory is released with
+// zfree_aligned() given the same size.
+void *zmalloc_aligned(size_t align, size_t size) {
+  void *ptr;
+
+  if (posix_memalign(&ptr, align, size) != 0) {
+    return NULL;
+  }
+#ifdef HAVE_MALLOC_SIZE
+  update_zmalloc_stat_add(zmalloc_size(ptr));
+#else
+  update_zmalloc_stat_add(size);
+#endif
+  return ptr;
+}
+
+void zfree_aligned(void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return;
+  }
+#ifdef HAVE_MALLOC_SIZE
+  update_zmalloc_stat_sub(zmalloc_size(ptr));
+#else
+  update_zmalloc_stat_sub(size);
+#endif
+  free(ptr);
+}
+
+// Bytes allocated through zmalloc, as seen by the allocator when it
+// reports allocation sizes.
 size_t zmalloc_used_memory() {
-  return used_memory;
+  return __atomic_load_n(&used_memory, __ATOMIC_RELAXED);
+}
+
+// The resident set size of the process, read from /proc on Linux. Where
+// it isn't available the allocated bytes are returned, so the
+// fragmentation ratio is 1.
+size_t zmalloc_get_rss() {
+#if defined(__linux__)
+  long page = sysconf(_SC_PAGESIZE);
+  unsigned long size, resident;
+  FILE *fp = fopen("/proc/self/statm", "r");
+
+  if (fp != NULL) {
+    int n = fscanf(fp, "%lu %lu", &size, &resident);
+
+    fclose(fp);
+    if (n == 2) {
+      return (size_t)resident * page;
+    }
+  }
+#endif
+  return zmalloc_used_memory();
+}
+
+// RSS over allocated memory: above 1 the allocator holds memory that is
+// not in use, below 1 part of the process is swapped out.
+float zmalloc_get_fragmentation_ratio(size_t rss) {
+  size_t used = zmalloc_used_memory();
+
+  return used ? (float)rss / used : 0;
 }
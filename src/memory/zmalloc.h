@@ -23,10 +23,37 @@
 
 #include <stddef.h>
 
+// When the allocator can tell the size of an allocation, allocations are
+// not prefixed with their size and the memory counted is what the
+// allocator really reserved, size class rounding included.
+#if defined(USE_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#define HAVE_MALLOC_SIZE 1
+#define ZMALLOC_LIB "jemalloc"
+#define zmalloc_size(p) malloc_usable_size(p)
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#define HAVE_MALLOC_SIZE 1
+#define ZMALLOC_LIB "libc"
+#define zmalloc_size(p) malloc_usable_size(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define HAVE_MALLOC_SIZE 1
+#define ZMALLOC_LIB "libc"
+#define zmalloc_size(p) malloc_size(p)
+#else
+#define ZMALLOC_LIB "libc"
+size_t zmalloc_size(void *ptr);
+#endif
+
 void *zmalloc(size_t size);
 void *zrealloc(void *ptr, size_t size);
 void zfree(void *ptr);
 char *zstrdup(const char *s);
+void *zmalloc_aligned(size_t align, size_t size);
+void zfree_aligned(void *ptr, size_t size);
 size_t zmalloc_used_memory();
+size_t zmalloc_get_rss();
+float zmalloc_get_fragmentation_ratio(size_t rss);
 
 #endif  // ZMALLOC_H_
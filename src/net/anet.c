@@ -190,7 +190,7 @@ int anetTcpServer(char *err, int port, char *bind_addr) {
     return ANET_ERR;
   }
 
-  if (listen(s, 32) == -1) {
+  if (listen(s, 511) == -1) {
     anetSetError(err, "listen: %s\n", strerror(errno));
     close(s);
     return ANET_ERR;
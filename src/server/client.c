@@ -22,21 +22,38 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "commands/object.h"
 #include "event/ae.h"
 #include "memory/zmalloc.h"
 #include "net/anet.h"
+#include "server/io_threads.h"
 #include "server/server.h"
 #include "utils/log.h"
+#include "utils/string_util.h"
 
 static int ReadQueryFromClient(AeEventLoop *event_loop, int fd,
                                void *client_data, int mask);
 static int SendReplyToClient(AeEventLoop *event_loop, int fd,
                              void *client_data, int mask);
+static int WriteToClient(CutisClient *c);
+static ssize_t WriteClientOutput(CutisClient *c, int *err);
+static void ConsumeClientOutput(CutisClient *c, size_t nwritten);
+static int HandleWriteResult(CutisClient *c, ssize_t nwritten, int err);
+static size_t QueryBufAvail(CutisClient *c);
+static sds ConsumeQueryArg(CutisClient *c, size_t len);
+static int ParseClientArgs(CutisClient *c);
+static int ParseInlineArgs(CutisClient *c);
+static int ParseMultiBulkArgs(CutisClient *c);
 static void FreeClientArgv(CutisClient *c);
+static int PrepareClientToWrite(CutisClient *c);
+static int AddReplyToBuffer(CutisClient *c, const char *s, size_t len);
+static void AddReplyObjectToList(CutisClient *c, CutisObject *o);
+static void AddReplyStringToList(CutisClient *c, const char *s, size_t len);
 
 CutisClient *CreateClient(CutisServer *server, int fd) {
   CutisClient *c = zmalloc(sizeof(*c));
@@ -49,10 +66,20 @@ CutisClient *CreateClient(CutisServer *server, int fd) {
 
   c->fd = fd;
   c->query_buf = sdsempty();
+  c->qb_pos = 0;
   c->last_interaction = time(NULL);
+  c->argv = NULL;
   c->argc = 0;
   c->bulk_len = -1;
+  c->req_type = 0;
+  c->multibulk_len = 0;
+  c->arg_len = -1;
   c->sent_len = 0;
+  c->buf_pos = 0;
+  c->pending_write = NULL;
+  c->pending_read = NULL;
+  c->io_result = 0;
+  c->io_errno = 0;
   c->server = server;
 
   SelectDB(c, 0);
@@ -80,6 +107,12 @@ void FreeClient(CutisClient *c) {
 
   AeDeleteFileEvent(c->server->el, c->fd, AE_READABLE);
   AeDeleteFileEvent(c->server->el, c->fd, AE_WRITABLE);
+  if (c->pending_write) {
+    listDelNode(c->server->clients_pending_write, c->pending_write);
+  }
+  if (c->pending_read) {
+    listDelNode(c->server->clients_pending_read, c->pending_read);
+  }
   sdsfree(c->query_buf);
   listRelease(c->reply);
   FreeClientArgv(c);
@@ -94,29 +127,93 @@ void FreeClient(CutisClient *c) {
 void ResetClient(CutisClient *c) {
   FreeClientArgv(c);
   c->bulk_len = -1;
+  c->req_type = 0;
+  c->multibulk_len = 0;
+  c->arg_len = -1;
 }
 
+// Replies are gathered in the fixed size client buffer as long as they
+// fit and nothing is queued in the reply list yet. Otherwise they are
+// appended to the reply list: small replies are copied into the last
+// object of the list when there is room, big objects are just referenced
+// so large values are sent without copying them.
 int AddReply(CutisClient *c, CutisObject* o) {
-  if (listLength(c->reply) == 0 &&
-      AeCreateFileEvent(c->server->el, c->fd,AE_WRITABLE,
-                        SendReplyToClient, c, NULL) == AE_ERR) {
-    FreeClientArgv(c);
+  if (o->encoding == CUTIS_ENCODING_INT) {
+    char buf[32];
+    int len = StringObjectToBuffer(o, buf, sizeof(buf));
+    return AddReplyString(c, buf, len);
+  }
+  if (PrepareClientToWrite(c) == AE_ERR) {
     return AE_ERR;
   }
-  if (!listAddNodeTail(c->reply, o)) {
-    CutisOom("listAddNodeTail");
+  if (AddReplyToBuffer(c, o->ptr, sdslen(o->ptr)) == CUTIS_ERR) {
+    AddReplyObjectToList(c, o);
   }
-  IncrRefCount(o);
   return AE_OK;
 }
 
 int AddReplySds(CutisClient *c, sds s) {
-  CutisObject *o = CreateCutisObject(CUTIS_STRING, s);
-  int ret = AddReply(c, o);
-  DecrRefCount(o);
+  int ret = AddReplyString(c, s, sdslen(s));
+  sdsfree(s);
   return ret;
 }
 
+int AddReplyString(CutisClient *c, const char *s, size_t len) {
+  if (PrepareClientToWrite(c) == AE_ERR) {
+    return AE_ERR;
+  }
+  if (AddReplyToBuffer(c, s, len) == CUTIS_ERR) {
+    AddReplyStringToList(c, s, len);
+  }
+  return AE_OK;
+}
+
+int AddReplyLongLong(CutisClient *c, long long ll) {
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), "%lld\r\n", ll);
+  return AddReplyString(c, buf, len);
+}
+
+// Add a bulk reply: the length line, the value and the final CRLF.
+// Integer encoded values are formatted right into the output buffer.
+int AddReplyBulk(CutisClient *c, CutisObject *o) {
+  if (o->encoding == CUTIS_ENCODING_INT) {
+    char num[32];
+    char buf[64];
+    int len = StringObjectToBuffer(o, num, sizeof(num));
+    return AddReplyString(c, buf, snprintf(buf, sizeof(buf), "%d\r\n%s\r\n",
+                                           len, num));
+  }
+  if (AddReplyLongLong(c, sdslen(o->ptr)) == AE_ERR) {
+    return AE_ERR;
+  }
+  AddReply(c, o);
+  return AddReply(c, shared.crlf);
+}
+
+// Add an empty object to the reply list, used as a placeholder for a
+// length that is known only after the reply is built. Call
+// SetDeferredReplyLen() to fill it before returning to the event loop.
+CutisObject *AddReplyDeferredLen(CutisClient *c) {
+  CutisObject *lenobj;
+
+  if (PrepareClientToWrite(c) == AE_ERR) {
+    return NULL;
+  }
+  lenobj = CreateCutisObject(CUTIS_STRING, NULL);
+  if (!listAddNodeTail(c->reply, lenobj)) {
+    CutisOom("listAddNodeTail");
+  }
+  return lenobj;
+}
+
+void SetDeferredReplyLen(CutisClient *c, CutisObject *lenobj, long len) {
+  if (lenobj == NULL) {
+    return;
+  }
+  lenobj->ptr = sdscatprintf(sdsempty(), "%ld\r\n", len);
+}
+
 int ParseQuery(CutisClient *c) {
   int res = CUTIS_ERR;
   do {
@@ -134,17 +231,14 @@ int ParseBulkQuery(CutisClient *c) {
   // client already sent a command terminated with a newline.
   // We are reading the bulk data that is actually the last
   // argument of the command.
-  int bulk_len = sdslen(c->query_buf);
-  if (c->bulk_len <= bulk_len) {
-    // Copy everything but the final CRLF as final argument
-    sds d = sdsnewlen(c->query_buf, c->bulk_len - 2);
-    c->argv[c->argc] = d;
+  if ((size_t)c->bulk_len <= QueryBufAvail(c)) {
+    // Take everything but the final CRLF as final argument
+    c->argv[c->argc] = ConsumeQueryArg(c, c->bulk_len - 2);
     c->argc++;
-    c->query_buf = sdsrange(c->query_buf, c->bulk_len, -1);
     // Execute the command. If the client is still valid after
     // ProcessCommand() return and there is something on the
     // query buffer try to process the next command.
-    if (ProcessCommand(c) && sdslen(c->query_buf) > 0) {
+    if (ProcessCommand(c) && QueryBufAvail(c) > 0) {
       return CUTIS_AGAIN;
     }
   }
@@ -152,150 +246,491 @@ int ParseBulkQuery(CutisClient *c) {
 }
 
 int ParseNonBulkQuery(CutisClient *c) {
-  // Read the first line of the query
-  char *p = strchr(c->query_buf, '\n');
-  size_t query_len;
+  // The arguments may already be parsed by an I/O thread.
+  int ret = ParseClientArgs(c);
 
-  if (p) {
-    sds query;
-    sds *argv;
-    int argc;
-    int i;
+  if (ret == -1) {
+    CutisLog(CUTIS_DEBUG, "Client protocol error");
+    FreeClient(c);
+    return CUTIS_OK;
+  } else if (ret == 0) {
+    return CUTIS_OK;
+  } else if (c->argc == 0) {
+    // ignore empty query
+    ResetClient(c);
+    return QueryBufAvail(c) > 0 ? CUTIS_AGAIN : CUTIS_OK;
+  }
+  // Execute the command. If the client is still valid after
+  // ProcessCommand() return and there is something on the
+  // query buffer try to process the next command.
+  if (ProcessCommand(c) && QueryBufAvail(c) > 0) {
+    return CUTIS_AGAIN;
+  }
+  return CUTIS_OK;
+}
+
+// Bytes of the query buffer not parsed yet. Parsing only moves qb_pos
+// forward, the parsed data is dropped in one go before the next read.
+static size_t QueryBufAvail(CutisClient *c) {
+  return sdslen(c->query_buf) - c->qb_pos;
+}
+
+// Drop the parsed part of the query buffer.
+static void TrimQueryBuf(CutisClient *c) {
+  if (c->qb_pos == 0) {
+    return;
+  }
+  if (c->qb_pos == sdslen(c->query_buf)) {
+    sdsclear(c->query_buf);
+  } else {
+    c->query_buf = sdsrange(c->query_buf, c->qb_pos, -1);
+  }
+  c->qb_pos = 0;
+}
 
-    query = c->query_buf;
+// Return the len bytes at the read cursor, followed by CRLF, as a new
+// argument. A big argument filling the whole query buffer is taken over
+// instead of being copied, see PrepareBigArg().
+static sds ConsumeQueryArg(CutisClient *c, size_t len) {
+  sds arg;
+
+  if (c->qb_pos == 0 && len >= CUTIS_BIG_ARG &&
+      sdslen(c->query_buf) == len + 2) {
+    arg = c->query_buf;
+    sdsIncrLen(arg, -2);  // remove CRLF
     c->query_buf = sdsempty();
-    query_len = 1 + (p - query);  // include the '\n'
-    if (sdslen(query) > query_len) {
-      // leave data after the first line of the query in the buffer
-      c->query_buf = sdscatlen(c->query_buf, query + query_len,
-                               sdslen(query) - query_len);
-    }
-    *p = '\0';  // remove '\n'
-    if (*(p-1) == '\r') {
-      *(p-1) = '\0';  // remove '\r'
-    }
-    sdsupdatelen(query);
+    return arg;
+  }
+  arg = sdsnewlen(c->query_buf + c->qb_pos, len);
+  c->qb_pos += len + 2;
+  return arg;
+}
 
-    // now we can split the query in arguments
-    if (sdslen(query) == 0) {
-      // ignore empty query
-      sdsfree(query);
-      return CUTIS_OK;
-    }
+// Length, including CRLF, of the big argument being read, or 0.
+static size_t BigArgLen(CutisClient *c) {
+  long len;
+
+  if (c->bulk_len != -1) {
+    len = c->bulk_len - 2;
+  } else if (c->req_type == CUTIS_REQ_MULTIBULK && c->arg_len != -1) {
+    len = c->arg_len;
+  } else {
+    return 0;
+  }
+  return len >= CUTIS_BIG_ARG ? (size_t)len + 2 : 0;
+}
+
+// Move a big argument being read at the start of the query buffer and
+// make room for exactly all of it, so once complete the buffer becomes the
+// argument without copying it.
+static void PrepareBigArg(CutisClient *c, size_t len) {
+  TrimQueryBuf(c);
+  if (sdslen(c->query_buf) < len) {
+    c->query_buf = sdsMakeRoomForExact(c->query_buf,
+                                       len - sdslen(c->query_buf));
+  }
+}
 
-    argv = sdssplitlen(query, sdslen(query), " ", 1, &argc);
-    sdsfree(query);
-    if (argv == NULL) {
-      CutisOom("sdssplitlen");
+// Parse the arguments of the next command from the query buffer. The
+// request type is detected from the first byte: '*' starts a multi bulk
+// request, anything else is an inline command. Returns 1 when all the
+// arguments are in argv, 0 if more data is needed and -1 on protocol
+// error. Calling it again once the arguments are complete is a no-op.
+// Only the client is touched, so this is safe to call from I/O threads.
+static int ParseClientArgs(CutisClient *c) {
+  if (c->req_type == CUTIS_REQ_INLINE) {
+    return 1;
+  } else if (c->req_type == CUTIS_REQ_MULTIBULK) {
+    return ParseMultiBulkArgs(c);
+  } else if (QueryBufAvail(c) == 0) {
+    return 0;
+  } else if (c->query_buf[c->qb_pos] == '*') {
+    return ParseMultiBulkArgs(c);
+  }
+  return ParseInlineArgs(c);
+}
+
+// Split the first line of the query buffer into the client arguments.
+static int ParseInlineArgs(CutisClient *c) {
+  char *line = c->query_buf + c->qb_pos;
+  char *newline = memchr(line, '\n', QueryBufAvail(c));
+  size_t line_len;
+  sds *argv;
+  int argc;
+  int i;
+
+  if (newline == NULL) {
+    return QueryBufAvail(c) >= CUTIS_INLINE_MAX_SIZE ? -1 : 0;
+  }
+  line_len = newline - line;
+  c->qb_pos += line_len + 1;  // include the '\n'
+  if (line_len > 0 && line[line_len-1] == '\r') {
+    line_len--;
+  }
+  c->req_type = CUTIS_REQ_INLINE;
+
+  // now we can split the query in arguments
+  if (line_len == 0) {
+    return 1;
+  }
+
+  argv = sdssplitlen(line, line_len, " ", 1, &argc);
+  if (argv == NULL) {
+    CutisOom("sdssplitlen");
+  }
+
+  // The split array becomes argv, empty arguments are removed in place.
+  c->argv = argv;
+  for (i = 0; i < argc; i++) {
+    if (sdslen(argv[i]) > 0) {
+      c->argv[c->argc] = argv[i];
+      c->argc++;
+    } else {
+      sdsfree(argv[i]);
     }
+  }
+  return 1;
+}
 
-    for (i = 0; i < argc && c->argc < CUTIS_MAX_ARGS; i++) {
-      if (sdslen(argv[i]) > 0) {
-        c->argv[c->argc] = argv[i];
-        c->argc++;
-      } else {
-        sdsfree(argv[i]);
+// Parse a multi bulk request:
+//
+//   *<number of arguments>\r\n
+//   $<number of bytes of the argument>\r\n<argument data>\r\n
+//   ...
+//
+// Arguments are binary safe and can be parsed across several reads,
+// multibulk_len and arg_len keep track of what is still missing.
+static int ParseMultiBulkArgs(CutisClient *c) {
+  char *p = c->query_buf + c->qb_pos;
+  char *newline;
+  long long ll;
+
+  if (c->req_type == 0) {
+    newline = memchr(p, '\r', QueryBufAvail(c));
+    if (newline == NULL) {
+      return QueryBufAvail(c) > CUTIS_INLINE_MAX_SIZE ? -1 : 0;
+    }
+    if ((size_t)(newline - p) + 2 > QueryBufAvail(c)) {
+      return 0;  // the '\n' is not there yet
+    }
+    if (!StringToLongLong(p + 1, newline - (p + 1), &ll) ||
+        ll > CUTIS_MAX_MULTIBULK_LEN) {
+      return -1;
+    }
+    c->qb_pos += newline - p + 2;
+    c->req_type = CUTIS_REQ_MULTIBULK;
+    c->multibulk_len = ll > 0 ? ll : 0;
+    c->arg_len = -1;
+    if (c->multibulk_len > 0) {
+      c->argv = zmalloc(sizeof(sds) * c->multibulk_len);
+      if (c->argv == NULL) {
+        CutisOom("zmalloc");
       }
     }
-    for (; i < argc; i++) {
-      sdsfree(argv[i]);
+  }
+
+  while (c->multibulk_len > 0) {
+    if (c->arg_len == -1) {
+      p = c->query_buf + c->qb_pos;
+      newline = memchr(p, '\r', QueryBufAvail(c));
+      if (newline == NULL) {
+        return QueryBufAvail(c) > CUTIS_INLINE_MAX_SIZE ? -1 : 0;
+      }
+      if ((size_t)(newline - p) + 2 > QueryBufAvail(c)) {
+        return 0;
+      }
+      if (p[0] != '$' ||
+          !StringToLongLong(p + 1, newline - (p + 1), &ll) ||
+          ll < 0 || ll > CUTIS_MAX_STRING_LENGTH) {
+        return -1;
+      }
+      c->qb_pos += newline - p + 2;
+      c->arg_len = ll;
     }
-    zfree(argv);
-    // Execute the command. If the client is still valid after
-    // ProcessCommand() return and there is something on the
-    // query buffer try to process the next command.
-    if (ProcessCommand(c) && sdslen(c->query_buf) > 0) {
-      return CUTIS_AGAIN;
+    if (QueryBufAvail(c) < (size_t)c->arg_len + 2) {
+      return 0;
     }
-  } else if (sdslen(c->query_buf) >= 1024) {
-    CutisLog(CUTIS_DEBUG, "Client protocol error");
-    FreeClient(c);
-    return CUTIS_OK;
+    c->argv[c->argc] = ConsumeQueryArg(c, c->arg_len);
+    c->argc++;
+    c->arg_len = -1;
+    c->multibulk_len--;
   }
-  return CUTIS_OK;
+  return 1;
 }
 
-static int ReadQueryFromClient(AeEventLoop *event_loop, int fd,
-                               void *client_data, int mask) {
-  CutisClient *c = (CutisClient*)client_data;
+// Read what is available on the socket into the query buffer. Returns
+// what read() returned, errno is left untouched on failure. Safe to call
+// from I/O threads.
+//
+// Data is read straight into the query buffer. While a big argument is
+// being received only the bytes still missing are read, so the argument
+// ends up alone in the buffer and can be taken over.
+static int ReadFromClient(CutisClient *c) {
+  size_t read_len = CUTIS_IOBUF_LEN;
+  size_t big_arg_len = BigArgLen(c);
   int nread;
-  char buf[CUTIS_QUERY_BUF_LEN];
 
-  nread = read(fd, buf, CUTIS_QUERY_BUF_LEN);
+  if (big_arg_len > 0) {
+    PrepareBigArg(c, big_arg_len);
+    if (big_arg_len > sdslen(c->query_buf)) {
+      read_len = big_arg_len - sdslen(c->query_buf);
+    }
+  } else {
+    TrimQueryBuf(c);
+  }
+  c->query_buf = sdsMakeRoomFor(c->query_buf, read_len);
+  nread = read(c->fd, c->query_buf + sdslen(c->query_buf), read_len);
+  if (nread > 0) {
+    sdsIncrLen(c->query_buf, nread);
+  }
+  return nread;
+}
+
+// Release the query buffer of an idle client, it can be large after a
+// burst of commands.
+void ShrinkClientQueryBuf(CutisClient *c) {
+  if (QueryBufAvail(c) == 0 && sdsavail(c->query_buf) > 0) {
+    sdsfree(c->query_buf);
+    c->query_buf = sdsempty();
+    c->qb_pos = 0;
+  }
+}
+
+// Act on the result of ReadFromClient(): close the connection on errors,
+// otherwise execute the commands gathered in the query buffer.
+static int HandleReadResult(CutisClient *c, int nread, int err) {
   if (nread == -1) {
-    if (errno == EAGAIN) {
-      nread = 0;
-    } else {
-      CutisLog(CUTIS_DEBUG, "Reading from client: %s", strerror(errno));
-      FreeClient(c);
+    if (err == EAGAIN) {
       return AE_ERR;
     }
+    CutisLog(CUTIS_DEBUG, "Reading from client: %s", strerror(err));
+    FreeClient(c);
+    return AE_ERR;
   } else if (nread == 0) {
     CutisLog(CUTIS_DEBUG, "Client closed connection. %d", c->fd);
     FreeClient(c);
     return AE_ERR;
   }
 
-  if (nread) {
-    c->query_buf = sdscatlen(c->query_buf, buf, nread);
-    c->last_interaction = time(NULL);
-  } else {
-    return AE_ERR;
+  c->last_interaction = time(NULL);
+  return ParseQuery(c);
+}
+
+// I/O thread job: read the socket and parse the first command, the main
+// thread executes it and parses whatever follows.
+static void ReadQueryJob(CutisClient *c) {
+  c->io_result = ReadFromClient(c);
+  c->io_errno = errno;
+  if (c->io_result > 0 && c->bulk_len == -1) {
+    ParseClientArgs(c);
   }
+}
 
-  return ParseQuery(c);
+static int ReadQueryFromClient(AeEventLoop *event_loop, int fd,
+                               void *client_data, int mask) {
+  CutisClient *c = (CutisClient*)client_data;
+  int nread;
+
+  // With I/O threads the read is postponed to HandleClientsWithPendingReads()
+  // so the reads of all the ready clients are done in parallel.
+  if (IoThreadsNum() > 1) {
+    if (!c->pending_read) {
+      List *pending = c->server->clients_pending_read;
+
+      if (!listAddNodeTail(pending, c)) {
+        CutisOom("listAddNodeTail");
+      }
+      c->pending_read = listLast(pending);
+    }
+    return AE_OK;
+  }
+
+  nread = ReadFromClient(c);
+  return HandleReadResult(c, nread, errno);
+}
+
+// Read and parse the queries of the clients whose socket became readable,
+// spreading them over the I/O threads. Commands are then executed here,
+// on the main thread, one client after the other.
+void HandleClientsWithPendingReads(CutisServer *server) {
+  List *pending = server->clients_pending_read;
+  ListNode *ln;
+
+  if (listLength(pending) == 0) {
+    return;
+  }
+  RunIoJobs(pending, ReadQueryJob);
+  while ((ln = listFirst(pending)) != NULL) {
+    CutisClient *c = listNodeValue(ln);
+
+    listDelNode(pending, ln);
+    c->pending_read = NULL;
+    HandleReadResult(c, c->io_result, c->io_errno);
+  }
+}
+
+// I/O thread job: write as much output as possible.
+static void WriteOutputJob(CutisClient *c) {
+  c->io_result = WriteClientOutput(c, &c->io_errno);
+}
+
+// Write the pending replies of every client that produced output in this
+// event loop iteration, before going to sleep. The writable handler is only
+// installed for clients whose socket buffer is full, so most replies are
+// sent without an additional event loop round trip.
+void HandleClientsWithPendingWrites(CutisServer *server) {
+  List *pending = server->clients_pending_write;
+  ListNode *ln;
+
+  if (listLength(pending) == 0) {
+    return;
+  }
+  RunIoJobs(pending, WriteOutputJob);
+  while ((ln = listFirst(pending)) != NULL) {
+    CutisClient *c = listNodeValue(ln);
+
+    listDelNode(pending, ln);
+    c->pending_write = NULL;
+    if (HandleWriteResult(c, c->io_result, c->io_errno) == CUTIS_ERR) {
+      continue;  // the client was freed
+    }
+    if ((c->buf_pos > 0 || listLength(c->reply)) &&
+        AeCreateFileEvent(server->el, c->fd, AE_WRITABLE,
+                          SendReplyToClient, c, NULL) == AE_ERR) {
+      FreeClient(c);
+    }
+  }
 }
 
 static int SendReplyToClient(AeEventLoop *event_loop, int fd,
                              void *client_data, int mask) {
   CutisClient *c = (CutisClient*)client_data;
-  int nwritten = 0;
-  int total_written = 0;
 
-  while (listLength(c->reply)) {
-    CutisObject *o = listNodeValue(listFirst(c->reply));
-    sds msg = o->ptr;
-    int len = sdslen(msg);
+  if (WriteToClient(c) == CUTIS_ERR) {
+    return AE_ERR;
+  }
+  if (c->buf_pos == 0 && listLength(c->reply) == 0) {
+    AeDeleteFileEvent(event_loop, c->fd, AE_WRITABLE);
+  }
+  return AE_OK;
+}
+
+// Flush the client buffer and the reply list with gathered writes.
+// Returns CUTIS_ERR if the client was freed because of a write error.
+static int WriteToClient(CutisClient *c) {
+  int err;
+  ssize_t nwritten = WriteClientOutput(c, &err);
+
+  return HandleWriteResult(c, nwritten, err);
+}
 
-    if (len == 0) {
-      listDelNode(c->reply, listFirst(c->reply));
-      continue;
+// Write the client buffer and the reply list until everything is sent or
+// the socket would block. Nothing is released here, the written bytes are
+// dropped by ConsumeClientOutput(), so this is safe to call from I/O
+// threads. Returns the number of bytes written, err is set to the errno
+// of a failed write or to 0.
+static ssize_t WriteClientOutput(CutisClient *c, int *err) {
+  struct iovec iov[CUTIS_IOV_MAX];
+  ListNode *ln = listFirst(c->reply);
+  size_t buf_sent = c->sent_len;
+  size_t offset = 0;  // written bytes of ln
+  ssize_t total_written = 0;
+
+  *err = 0;
+  if (c->buf_pos == 0) {
+    buf_sent = 0;
+    offset = c->sent_len;
+  }
+  for (;;) {
+    ListNode *node = ln;
+    size_t node_offset = offset;
+    size_t to_write = 0;
+    ssize_t nwritten;
+    int iovcnt = 0;
+
+    if ((size_t)c->buf_pos > buf_sent) {
+      iov[iovcnt].iov_base = c->buf + buf_sent;
+      iov[iovcnt].iov_len = c->buf_pos - buf_sent;
+      to_write += iov[iovcnt].iov_len;
+      iovcnt++;
+    }
+    while (node && iovcnt < CUTIS_IOV_MAX) {
+      CutisObject *o = listNodeValue(node);
+      size_t len = sdslen(o->ptr);
+
+      if (len > node_offset) {
+        iov[iovcnt].iov_base = (char*)o->ptr + node_offset;
+        iov[iovcnt].iov_len = len - node_offset;
+        to_write += iov[iovcnt].iov_len;
+        iovcnt++;
+      }
+      node_offset = 0;
+      node = listNextNode(node);
+    }
+    if (iovcnt == 0) {
+      break;
     }
 
-    nwritten = write(c->fd, msg + c->sent_len, len - c->sent_len);
+    nwritten = writev(c->fd, iov, iovcnt);
     if (nwritten <= 0) {
+      if (nwritten == -1 && errno != EAGAIN) {
+        *err = errno;
+      }
       break;
     }
-
-    // nwritten > 0
     total_written += nwritten;
-    c->sent_len += nwritten;
-    if (c->sent_len == len) {
-      listDelNode(c->reply, listFirst(c->reply));
-      c->sent_len = 0;
+    if ((size_t)nwritten < to_write) {
+      break;  // short write, the socket buffer is full
     }
-  }
 
-  if (nwritten == -1) {
-    if (errno == EAGAIN) {
-      nwritten = 0;
-    } else {
-      CutisLog(CUTIS_DEBUG, "Error writing to client: %s, %d", strerror(errno), errno);
-      FreeClient(c);
-      return AE_ERR;
-    }
+    // Everything was written, move the cursor to the next iovecs.
+    buf_sent = c->buf_pos;
+    ln = node;
+    offset = 0;
   }
+  return total_written;
+}
 
-  if (total_written > 0) {
-    c->last_interaction = time(NULL);
+// Drop nwritten bytes from the head of the client output.
+static void ConsumeClientOutput(CutisClient *c, size_t nwritten) {
+  if (c->buf_pos > 0) {
+    if (nwritten < (size_t)(c->buf_pos - c->sent_len)) {
+      c->sent_len += nwritten;
+      return;
+    }
+    nwritten -= c->buf_pos - c->sent_len;
+    c->buf_pos = 0;
+    c->sent_len = 0;
   }
+  // Empty objects at the head are released as well.
+  while (listLength(c->reply)) {
+    CutisObject *o = listNodeValue(listFirst(c->reply));
+    size_t len = sdslen(o->ptr) - c->sent_len;
 
-  if (listLength(c->reply) == 0) {
+    if (nwritten < len) {
+      c->sent_len += nwritten;
+      break;
+    }
+    nwritten -= len;
     c->sent_len = 0;
-    AeDeleteFileEvent(event_loop, c->fd, AE_WRITABLE);
+    listDelNode(c->reply, listFirst(c->reply));
   }
+}
 
-  return AE_OK;
+// Act on the result of WriteClientOutput(). Returns CUTIS_ERR if the
+// client was freed because of a write error.
+static int HandleWriteResult(CutisClient *c, ssize_t nwritten, int err) {
+  ConsumeClientOutput(c, nwritten);
+  if (err) {
+    CutisLog(CUTIS_DEBUG, "Error writing to client: %s, %d",
+             strerror(err), err);
+    FreeClient(c);
+    return CUTIS_ERR;
+  }
+  if (nwritten > 0) {
+    c->last_interaction = time(NULL);
+  }
+  return CUTIS_OK;
 }
 
 static void FreeClientArgv(CutisClient *c) {
@@ -303,6 +738,8 @@ static void FreeClientArgv(CutisClient *c) {
   for (i = 0; i < c->argc; i++) {
     sdsfree(c->argv[i]);
   }
+  zfree(c->argv);
+  c->argv = NULL;
   c->argc = 0;
 }
 
@@ -310,6 +747,88 @@ int SelectDB(CutisClient *c, int id) {
   if (id < 0 || id >= c->server->db_num) {
     return CUTIS_ERR;
   }
-  c->dict = c->server->dict[id];
+  c->db = &c->server->db[id];
+  return CUTIS_OK;
+}
+
+// Queue the client in the pending writes list when the first reply of a
+// batch is added. Clients that already have pending output are either
+// queued or waiting for the writable handler.
+static int PrepareClientToWrite(CutisClient *c) {
+  List *pending = c->server->clients_pending_write;
+
+  if (c->buf_pos == 0 && listLength(c->reply) == 0 && !c->pending_write) {
+    if (!listAddNodeTail(pending, c)) {
+      CutisOom("listAddNodeTail");
+    }
+    c->pending_write = listLast(pending);
+  }
+  return AE_OK;
+}
+
+static int AddReplyToBuffer(CutisClient *c, const char *s, size_t len) {
+  size_t available = sizeof(c->buf) - c->buf_pos;
+
+  // If there already are entries in the reply list, we cannot
+  // add anything more to the static buffer.
+  if (listLength(c->reply) > 0) {
+    return CUTIS_ERR;
+  }
+  if (len > available) {
+    return CUTIS_ERR;
+  }
+  memcpy(c->buf + c->buf_pos, s, len);
+  c->buf_pos += len;
   return CUTIS_OK;
 }
+
+// Return the last object of the reply list if more len bytes can be
+// appended to it, making sure it is not shared with anything else.
+static CutisObject *GetReplyListTail(CutisClient *c, size_t len) {
+  ListNode *ln = listLast(c->reply);
+  CutisObject *tail;
+
+  if (ln == NULL) {
+    return NULL;
+  }
+  tail = listNodeValue(ln);
+  // A NULL ptr is a deferred length placeholder, never append to it.
+  if (tail->ptr == NULL ||
+      sdslen(tail->ptr) + len > CUTIS_REPLY_CHUNK_BYTES) {
+    return NULL;
+  }
+  // Shared or embedded objects can't be appended to in place.
+  if (tail->refcount > 1 || tail->encoding != CUTIS_ENCODING_RAW) {
+    CutisObject *copy = CreateCutisObject(CUTIS_STRING, sdsdup(tail->ptr));
+    DecrRefCount(tail);
+    listNodeValue(ln) = copy;
+    tail = copy;
+  }
+  return tail;
+}
+
+static void AddReplyObjectToList(CutisClient *c, CutisObject *o) {
+  CutisObject *tail = GetReplyListTail(c, sdslen(o->ptr));
+
+  if (tail) {
+    tail->ptr = sdscatlen(tail->ptr, o->ptr, sdslen(o->ptr));
+  } else {
+    if (!listAddNodeTail(c->reply, o)) {
+      CutisOom("listAddNodeTail");
+    }
+    IncrRefCount(o);
+  }
+}
+
+static void AddReplyStringToList(CutisClient *c, const char *s, size_t len) {
+  CutisObject *tail = GetReplyListTail(c, len);
+
+  if (tail) {
+    tail->ptr = sdscatlen(tail->ptr, (void*)s, len);
+  } else {
+    CutisObject *o = CreateCutisObject(CUTIS_STRING, sdsnewlen(s, len));
+    if (!listAddNodeTail(c->reply, o)) {
+      CutisOom("listAddNodeTail");
+    }
+  }
+}
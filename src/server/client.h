@@ -30,23 +30,42 @@
 #include <time.h>
 
 typedef struct CutisServer CutisServer;
+typedef struct CutisDb CutisDb;
 
 // Static server configuration
-#define CUTIS_QUERY_BUF_LEN 1024
-#define CUTIS_MAX_ARGS      16
+#define CUTIS_IOBUF_LEN           (16 * 1024)  // socket read size
+#define CUTIS_BIG_ARG             (32 * 1024)  // arguments read in place
+#define CUTIS_INLINE_MAX_SIZE     1024         // max inline query line
+#define CUTIS_MAX_MULTIBULK_LEN   (1024 * 1024)  // max multi bulk arguments
+#define CUTIS_REPLY_CHUNK_BYTES   (16 * 1024)  // output buffer size
+#define CUTIS_IOV_MAX             64           // max iovecs per writev()
+
+// Request types
+#define CUTIS_REQ_INLINE          1
+#define CUTIS_REQ_MULTIBULK       2
 
 // With multiplexing we need to take pre-client state.
 // Clients are taken in a liked list.
 typedef struct CutisClient {
   int fd;                             // TCP connection fd
   sds query_buf;                      // read from fd
-  List *reply;                        // reply message
-  int sent_len;                       // sent length for first element in reply
+  size_t qb_pos;                      // parsed length of query_buf
+  List *reply;                        // reply objects queued after buf
+  int sent_len;                       // sent length of buf, or first in reply
+  int buf_pos;                        // used length of buf
+  char buf[CUTIS_REPLY_CHUNK_BYTES];  // small replies are gathered here
   time_t last_interaction;            // used for timeout
-  sds argv[CUTIS_MAX_ARGS];           // arguments array
+  sds *argv;                          // arguments array
   int argc;                           // arguments count
   int bulk_len;                       // bulk read len. -1 single read mode
-  Dict *dict;                         // database's dict
+  int req_type;                       // request type, 0 if not known yet
+  int multibulk_len;                  // multi bulk arguments left to read
+  long arg_len;                       // multi bulk argument len, -1 unknown
+  CutisDb *db;                        // selected database
+  ListNode *pending_write;            // node in clients_pending_write
+  ListNode *pending_read;             // node in clients_pending_read
+  int io_result;                      // result of the last I/O thread job
+  int io_errno;                       // errno of the last I/O thread job
   CutisServer *server;                // pointed to the server
 } CutisClient;
 
@@ -56,6 +75,14 @@ void FreeClient(CutisClient *c);
 void ResetClient(CutisClient *c);
 int AddReply(CutisClient *c, CutisObject* o);
 int AddReplySds(CutisClient *c, sds s);
+int AddReplyString(CutisClient *c, const char *s, size_t len);
+int AddReplyLongLong(CutisClient *c, long long ll);
+int AddReplyBulk(CutisClient *c, CutisObject *o);
+CutisObject *AddReplyDeferredLen(CutisClient *c);
+void SetDeferredReplyLen(CutisClient *c, CutisObject *lenobj, long len);
+void HandleClientsWithPendingReads(CutisServer *server);
+void HandleClientsWithPendingWrites(CutisServer *server);
+void ShrinkClientQueryBuf(CutisClient *c);
 int ParseQuery(CutisClient *c);
 int ParseBulkQuery(CutisClient *c);
 int ParseNonBulkQuery(CutisClient *c);
@@ -0,0 +1,146 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "server/db.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "commands/object.h"
+#include "server/evict.h"
+
+static long long MsTime() {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Find a key in the DB, deleting it first if it is expired, and record
+// the access for eviction.
+DictEntry *LookupKey(CutisDb *db, sds key) {
+  return LookupKeyWithHash(db, key, DictHashKey(db->dict, key));
+}
+
+// Like LookupKey(), with hash being DictHashKey(db->dict, key).
+DictEntry *LookupKeyWithHash(CutisDb *db, sds key, unsigned int hash) {
+  DictEntry *de;
+
+  ExpireIfNeeded(db, key);
+  de = DictFindWithHash(db->dict, key, hash);
+  if (de) {
+    UpdateObjectAccess(DictGetEntryVal(de));
+  }
+  return de;
+}
+
+// Delete a key and its timeout. Returns 1 if the key existed.
+int DeleteKey(CutisDb *db, sds key) {
+  // The expires entry shares the key, it must go first.
+  if (DictGetHashTableUsed(db->expires) > 0) {
+    DictDelete(db->expires, key);
+  }
+  return DictDelete(db->dict, key) == DICT_OK;
+}
+
+// Set the unix time at which an existing key expires.
+void SetExpire(CutisDb *db, sds key, time_t when) {
+  DictEntry *de = DictFind(db->dict, key);
+
+  assert(de != NULL);
+  DictReplace(db->expires, DictGetEntryKey(de), (void*)(intptr_t)when);
+}
+
+// The unix time at which key expires, -1 if it has no timeout.
+time_t GetExpire(CutisDb *db, sds key) {
+  DictEntry *de;
+
+  if (DictGetHashTableUsed(db->expires) == 0 ||
+      (de = DictFind(db->expires, key)) == NULL) {
+    return -1;
+  }
+  return (time_t)(intptr_t)DictGetEntryVal(de);
+}
+
+// Make key persistent. Returns 1 if it had a timeout.
+int RemoveExpire(CutisDb *db, sds key) {
+  if (DictGetHashTableUsed(db->expires) == 0) {
+    return 0;
+  }
+  return DictDelete(db->expires, key) == DICT_OK;
+}
+
+// Delete key if its time is over, so it is never seen once expired even
+// if the active expiry didn't get to it yet. Returns 1 if it was deleted.
+int ExpireIfNeeded(CutisDb *db, sds key) {
+  time_t when = GetExpire(db, key);
+  CutisServer *server;
+
+  if (when == -1 || time(NULL) < when) {
+    return 0;
+  }
+  server = GetSingletonServer();
+  server->stat_expired_keys++;
+  server->dirty++;
+  return DeleteKey(db, key);
+}
+
+// Delete expired keys nobody asks for, called by the cron. Random keys
+// with a timeout are sampled in each DB, and sampled again while many of
+// them were expired. The DB where a cycle runs out of time is the first
+// one of the next cycle.
+void ActiveExpireCycle(CutisServer *server) {
+  static int current_db = 0;
+  long long start = MsTime();
+  time_t now = time(NULL);
+  int j;
+
+  for (j = 0; j < server->db_num; j++) {
+    CutisDb *db = &server->db[current_db];
+    int expired;
+
+    do {
+      unsigned int num = DictGetHashTableUsed(db->expires);
+
+      if (num == 0) {
+        break;
+      }
+      if (num > CUTIS_EXPIRE_LOOKUPS_PER_LOOP) {
+        num = CUTIS_EXPIRE_LOOKUPS_PER_LOOP;
+      }
+      expired = 0;
+      while (num--) {
+        DictEntry *de = DictGetRandomKey(db->expires);
+
+        if ((time_t)(intptr_t)DictGetEntryVal(de) <= now) {
+          DeleteKey(db, DictGetEntryKey(de));
+          server->stat_expired_keys++;
+          server->dirty++;
+          expired++;
+        }
+      }
+      if (MsTime() - start > CUTIS_EXPIRE_CYCLE_MS) {
+        return;
+      }
+    } while (expired > CUTIS_EXPIRE_LOOKUPS_PER_LOOP / 4);
+    current_db = (current_db + 1) % server->db_num;
+  }
+}
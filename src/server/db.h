@@ -0,0 +1,45 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SERVER_DB_H_
+#define SERVER_DB_H_
+
+#include <time.h>
+
+#include "data_struct/dict.h"
+#include "data_struct/sds.h"
+#include "server/server.h"
+
+// Active expiry: keys with a timeout sampled per DB and round, another
+// round is done while more than a quarter of them were expired, within
+// the time budget of a cycle.
+#define CUTIS_EXPIRE_LOOKUPS_PER_LOOP  20
+#define CUTIS_EXPIRE_CYCLE_MS          25
+
+DictEntry *LookupKey(CutisDb *db, sds key);
+DictEntry *LookupKeyWithHash(CutisDb *db, sds key, unsigned int hash);
+int DeleteKey(CutisDb *db, sds key);
+void SetExpire(CutisDb *db, sds key, time_t when);
+time_t GetExpire(CutisDb *db, sds key);
+int RemoveExpire(CutisDb *db, sds key);
+int ExpireIfNeeded(CutisDb *db, sds key);
+void ActiveExpireCycle(CutisServer *server);
+
+#endif  // SERVER_DB_H_
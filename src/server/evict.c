@@ -0,0 +1,225 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "server/evict.h"
+
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/time.h>
+
+#include "data_struct/dict.h"
+#include "memory/slab.h"
+#include "memory/zmalloc.h"
+#include "server/db.h"
+#include "server/server.h"
+#include "utils/log.h"
+
+static struct {
+  const char *name;
+  int policy;
+} policies[] = {
+    {"noeviction", CUTIS_MAXMEMORY_NO_EVICTION},
+    {"allkeys-lru", CUTIS_MAXMEMORY_ALLKEYS_LRU},
+    {"allkeys-lfu", CUTIS_MAXMEMORY_ALLKEYS_LFU},
+    {"allkeys-random", CUTIS_MAXMEMORY_ALLKEYS_RANDOM},
+    {NULL, 0},
+};
+
+// The current LRU clock, the server caches it in the cron.
+unsigned int GetLruClock() {
+  struct timeval tv;
+  unsigned long long ms;
+
+  gettimeofday(&tv, NULL);
+  ms = (unsigned long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  return (ms / CUTIS_LRU_CLOCK_RESOLUTION) & CUTIS_LRU_CLOCK_MAX;
+}
+
+static unsigned long LfuTimeInMinutes() {
+  return (GetSingletonServer()->unixtime / 60) & 65535;
+}
+
+// Minutes since the last decrement time ldt, the clock wraps around.
+static unsigned long LfuTimeElapsed(unsigned long ldt) {
+  unsigned long now = LfuTimeInMinutes();
+
+  if (now >= ldt) {
+    return now - ldt;
+  }
+  return 65535 - ldt + now;
+}
+
+// Increment the counter with a probability that drops as it grows, so
+// 8 bits are enough for millions of accesses.
+static unsigned int LfuLogIncr(unsigned int counter) {
+  double r;
+  double base;
+
+  if (counter == 255) {
+    return 255;
+  }
+  r = (double)rand() / RAND_MAX;
+  base = counter > CUTIS_LFU_INIT_VAL ? counter - CUTIS_LFU_INIT_VAL : 0;
+  if (r < 1.0 / (base * CUTIS_LFU_LOG_FACTOR + 1)) {
+    counter++;
+  }
+  return counter;
+}
+
+// The access counter of o, decremented for the time it was not accessed.
+unsigned long LfuDecrAndReturn(CutisObject *o) {
+  unsigned long ldt = o->lru >> 8;
+  unsigned long counter = o->lru & 255;
+  unsigned long periods = LfuTimeElapsed(ldt) / CUTIS_LFU_DECAY_TIME;
+
+  return periods > counter ? 0 : counter - periods;
+}
+
+void InitObjectAccess(CutisObject *o) {
+  CutisServer *server = GetSingletonServer();
+
+  if (server->maxmemory_policy == CUTIS_MAXMEMORY_ALLKEYS_LFU) {
+    o->lru = (LfuTimeInMinutes() << 8) | CUTIS_LFU_INIT_VAL;
+  } else {
+    o->lru = server->lru_clock;
+  }
+}
+
+// Record an access to the value o of a key.
+void UpdateObjectAccess(CutisObject *o) {
+  CutisServer *server = GetSingletonServer();
+
+  if (server->maxmemory_policy == CUTIS_MAXMEMORY_ALLKEYS_LFU) {
+    unsigned long counter = LfuLogIncr(LfuDecrAndReturn(o));
+    o->lru = (LfuTimeInMinutes() << 8) | counter;
+  } else {
+    o->lru = server->lru_clock;
+  }
+}
+
+// Milliseconds since the object was last accessed, with the LRU clock
+// resolution.
+unsigned long long EstimateObjectIdleTime(CutisObject *o) {
+  unsigned long long clock = GetSingletonServer()->lru_clock;
+
+  if (clock >= o->lru) {
+    return (clock - o->lru) * CUTIS_LRU_CLOCK_RESOLUTION;
+  }
+  return (clock + (CUTIS_LRU_CLOCK_MAX - o->lru)) *
+         CUTIS_LRU_CLOCK_RESOLUTION;
+}
+
+int GetMaxmemoryPolicyByName(const char *name) {
+  int i;
+
+  for (i = 0; policies[i].name != NULL; i++) {
+    if (!strcasecmp(name, policies[i].name)) {
+      return policies[i].policy;
+    }
+  }
+  return -1;
+}
+
+const char *GetMaxmemoryPolicyName(int policy) {
+  int i;
+
+  for (i = 0; policies[i].name != NULL; i++) {
+    if (policies[i].policy == policy) {
+      return policies[i].name;
+    }
+  }
+  return "unknown";
+}
+
+// Memory counted against maxmemory. Free chunks of the slabs are reused
+// before anything else is allocated, so they don't count.
+static size_t UsedMemoryForEviction() {
+  size_t used = zmalloc_used_memory();
+  size_t unused = slab_unused_memory();
+
+  return used > unused ? used - unused : 0;
+}
+
+// Higher is a better candidate for eviction.
+static unsigned long long EvictionScore(CutisServer *server, DictEntry *de) {
+  CutisObject *o = DictGetEntryVal(de);
+
+  if (server->maxmemory_policy == CUTIS_MAXMEMORY_ALLKEYS_LFU) {
+    return 255 - LfuDecrAndReturn(o);
+  }
+  return EstimateObjectIdleTime(o);
+}
+
+// Pick the key to evict: the best of maxmemory_samples random keys of
+// every DB, or a random key of the next non empty DB. Returns NULL if the
+// DBs are empty.
+static DictEntry *SelectEvictionCandidate(CutisServer *server,
+                                          CutisDb **best_db) {
+  static int next_db = 0;
+  DictEntry *best = NULL;
+  unsigned long long best_score = 0;
+  int i;
+
+  for (i = 0; i < server->db_num; i++) {
+    CutisDb *db = &server->db[(next_db + i) % server->db_num];
+    int k;
+
+    if (DictGetHashTableUsed(db->dict) == 0) {
+      continue;
+    }
+    if (server->maxmemory_policy == CUTIS_MAXMEMORY_ALLKEYS_RANDOM) {
+      next_db = (next_db + i + 1) % server->db_num;
+      *best_db = db;
+      return DictGetRandomKey(db->dict);
+    }
+    for (k = 0; k < server->maxmemory_samples; k++) {
+      DictEntry *de = DictGetRandomKey(db->dict);
+      unsigned long long score = EvictionScore(server, de);
+
+      if (best == NULL || score > best_score) {
+        best = de;
+        best_score = score;
+        *best_db = db;
+      }
+    }
+  }
+  return best;
+}
+
+// Evict keys until the used memory is below maxmemory. Called before
+// every command when maxmemory is set. Returns CUTIS_ERR if the memory
+// can't be freed, the commands that may use more memory are refused then.
+int FreeMemoryIfNeeded(CutisServer *server) {
+  while (UsedMemoryForEviction() > server->maxmemory) {
+    DictEntry *de;
+    CutisDb *db = NULL;
+
+    if (server->maxmemory_policy == CUTIS_MAXMEMORY_NO_EVICTION) {
+      return CUTIS_ERR;
+    }
+    if ((de = SelectEvictionCandidate(server, &db)) == NULL) {
+      return CUTIS_ERR;  // nothing left to evict
+    }
+    DeleteKey(db, DictGetEntryKey(de));
+    server->stat_evicted_keys++;
+    server->dirty++;
+  }
+  return CUTIS_OK;
+}
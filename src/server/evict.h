@@ -0,0 +1,58 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SERVER_EVICT_H_
+#define SERVER_EVICT_H_
+
+#include "commands/object.h"
+
+typedef struct CutisServer CutisServer;
+
+// What to do when maxmemory is reached.
+#define CUTIS_MAXMEMORY_NO_EVICTION     0  // deny the commands using memory
+#define CUTIS_MAXMEMORY_ALLKEYS_LRU     1  // evict the least recently used
+#define CUTIS_MAXMEMORY_ALLKEYS_LFU     2  // evict the least frequently used
+#define CUTIS_MAXMEMORY_ALLKEYS_RANDOM  3  // evict random keys
+
+#define CUTIS_MAXMEMORY_SAMPLES         5
+
+// The LRU clock counts seconds, it wraps after 194 days.
+#define CUTIS_LRU_CLOCK_MAX         ((1 << CUTIS_LRU_BITS) - 1)
+#define CUTIS_LRU_CLOCK_RESOLUTION  1000  // in milliseconds
+
+// With LFU the 24 bits are the last decrement time in minutes (16 bits)
+// and a logarithmic access counter (8 bits). New keys start at
+// CUTIS_LFU_INIT_VAL so they are not evicted before they get a chance to
+// be accessed. The counter is decremented by one every
+// CUTIS_LFU_DECAY_TIME minutes the key is not accessed.
+#define CUTIS_LFU_INIT_VAL    5
+#define CUTIS_LFU_LOG_FACTOR  10
+#define CUTIS_LFU_DECAY_TIME  1
+
+unsigned int GetLruClock();
+void InitObjectAccess(CutisObject *o);
+void UpdateObjectAccess(CutisObject *o);
+unsigned long long EstimateObjectIdleTime(CutisObject *o);
+unsigned long LfuDecrAndReturn(CutisObject *o);
+int GetMaxmemoryPolicyByName(const char *name);
+const char *GetMaxmemoryPolicyName(int policy);
+int FreeMemoryIfNeeded(CutisServer *server);
+
+#endif  // SERVER_EVICT_H_
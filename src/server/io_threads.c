@@ -0,0 +1,172 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "server/io_threads.h"
+
+#include <pthread.h>
+
+#include "memory/zmalloc.h"
+#include "server/server.h"
+
+// The main thread is the I/O thread with index 0, the pool only holds
+// the other ones. A batch is handed to the threads by setting their
+// pending flag, the main thread runs its own share and then spins until
+// every thread cleared its flag again.
+typedef struct IoThread {
+  pthread_t tid;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int index;          // clients at position % io_threads_num == index
+  int pending;        // a batch is assigned and not done yet
+  int stop;           // exit the thread
+  List *clients;      // the batch
+  IoJobProc *proc;    // job run on every client of the batch
+} IoThread;
+
+static IoThread *io_threads = NULL;
+static int io_threads_num = 1;
+
+static void RunIoJobsSlice(List *clients, IoJobProc *proc, int index) {
+  ListNode *ln;
+  int pos = 0;
+
+  for (ln = listFirst(clients); ln != NULL; ln = listNextNode(ln), pos++) {
+    if (pos % io_threads_num == index) {
+      proc(listNodeValue(ln));
+    }
+  }
+}
+
+static void *IoThreadMain(void *arg) {
+  IoThread *t = (IoThread*)arg;
+
+  for (;;) {
+    pthread_mutex_lock(&t->lock);
+    while (!__atomic_load_n(&t->pending, __ATOMIC_ACQUIRE) && !t->stop) {
+      pthread_cond_wait(&t->cond, &t->lock);
+    }
+    if (t->stop) {
+      pthread_mutex_unlock(&t->lock);
+      break;
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    RunIoJobsSlice(t->clients, t->proc, t->index);
+    __atomic_store_n(&t->pending, 0, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+// Start num - 1 I/O threads, the main thread being the first one.
+int InitIoThreads(int num) {
+  int i;
+
+  if (num < 1 || num > CUTIS_IO_THREADS_MAX) {
+    return CUTIS_ERR;
+  }
+  io_threads_num = num;
+  if (num == 1) {
+    return CUTIS_OK;
+  }
+
+  io_threads = zmalloc(sizeof(IoThread) * num);
+  if (io_threads == NULL) {
+    return CUTIS_ERR;
+  }
+  for (i = 1; i < num; i++) {
+    IoThread *t = &io_threads[i];
+
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    t->index = i;
+    t->pending = 0;
+    t->stop = 0;
+    t->clients = NULL;
+    t->proc = NULL;
+    if (pthread_create(&t->tid, NULL, IoThreadMain, t) != 0) {
+      io_threads_num = i;
+      KillIoThreads();
+      return CUTIS_ERR;
+    }
+  }
+  return CUTIS_OK;
+}
+
+void KillIoThreads() {
+  int i;
+
+  if (io_threads == NULL) {
+    return;
+  }
+  for (i = 1; i < io_threads_num; i++) {
+    IoThread *t = &io_threads[i];
+
+    pthread_mutex_lock(&t->lock);
+    t->stop = 1;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->tid, NULL);
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->lock);
+  }
+  zfree(io_threads);
+  io_threads = NULL;
+  io_threads_num = 1;
+}
+
+int IoThreadsNum() {
+  return io_threads_num;
+}
+
+// Run proc on every client of the list, spreading the clients over the
+// I/O threads, and return when all of them are done. Small batches are not
+// worth waking up the threads and run on the main thread alone.
+void RunIoJobs(List *clients, IoJobProc *proc) {
+  int i;
+
+  if (io_threads_num == 1 ||
+      listLength(clients) < (unsigned long)io_threads_num * 2) {
+    ListNode *ln;
+
+    for (ln = listFirst(clients); ln != NULL; ln = listNextNode(ln)) {
+      proc(listNodeValue(ln));
+    }
+    return;
+  }
+
+  for (i = 1; i < io_threads_num; i++) {
+    IoThread *t = &io_threads[i];
+
+    pthread_mutex_lock(&t->lock);
+    t->clients = clients;
+    t->proc = proc;
+    __atomic_store_n(&t->pending, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+  }
+
+  RunIoJobsSlice(clients, proc, 0);
+
+  for (i = 1; i < io_threads_num; i++) {
+    while (__atomic_load_n(&io_threads[i].pending, __ATOMIC_ACQUIRE)) {
+      // spin, the jobs are a few system calls each
+    }
+  }
+}
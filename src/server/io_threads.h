@@ -0,0 +1,39 @@
+/*
+ * Cutis is a key/value database.
+ * Copyright (c) 2023 furzoom.com, All rights reserved.
+ * Author: mn, mn@furzoom.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SERVER_IO_THREADS_H_
+#define SERVER_IO_THREADS_H_
+
+#include "data_struct/adlist.h"
+
+#define CUTIS_IO_THREADS_MAX      64
+
+typedef struct CutisClient CutisClient;
+
+// A job run on a client by an I/O thread. It must only touch the client
+// itself: the command executor and the data set stay single threaded.
+typedef void IoJobProc(CutisClient *c);
+
+int InitIoThreads(int num);
+void KillIoThreads();
+int IoThreadsNum();
+void RunIoJobs(List *clients, IoJobProc *proc);
+
+#endif  // SERVER_IO_THREADS_H_
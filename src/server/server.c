@@ -32,9 +32,14 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "memory/slab.h"
 #include "memory/zmalloc.h"
 #include "server/client.h"
+#include "server/db.h"
+#include "server/evict.h"
+#include "server/io_threads.h"
 #include "utils/log.h"
+#include "utils/string_util.h"
 
 // Anti-warning macro
 #define CUTIS_NOT_USED(v) (void)(v)
@@ -45,11 +50,21 @@
 #define CUTIS_DEFAULT_DBNUM   16        // database number
 #define CUTIS_CONFIG_LINE_MAX 1024      // maximum characters for one line
 #define CUTIS_LOAD_BUF_LEN    1024      // default load DB buffer size
+#define CUTIS_EVENT_SET_SIZE  1024      // initial fd slots, grows on demand
 
 #define CUTIS_HT_MINFILL      10        // Minimal hash table fill 10%
 #define CUTIS_HT_MINSLOTS     16384     // Never resize the HT under this
+#define CUTIS_REHASH_MS       1         // Time spent rehashing a DB per cron
+#define CUTIS_LIST_MAX_ZIPLIST_ENTRIES 128  // larger lists are linked lists
+#define CUTIS_LIST_MAX_ZIPLIST_VALUE   64   // and so are lists of larger values
+#define CUTIS_SET_MAX_INTSET_ENTRIES   512  // larger sets are hash tables
+#define CUTIS_SET_MAX_ZIPLIST_ENTRIES  128
+#define CUTIS_SET_MAX_ZIPLIST_VALUE    64
+#define CUTIS_HASH_MAX_ZIPLIST_ENTRIES 128  // larger hashes are hash tables
+#define CUTIS_HASH_MAX_ZIPLIST_VALUE   64
 #define CUTIS_TMP_FILENAME    "dump-%d.%ld.cdb"
 #define CUTIS_DB_SIGNATURE    "CUTIS0000"
+#define CUTIS_EXPIRE_TIME     253
 #define CUTIS_SELECT_DB       254
 #define CUTIS_EOF             255
 
@@ -57,6 +72,7 @@
 static void interrupt_handler(int sig);
 static int ServerCron(struct AeEventLoop *event_loop,
                       long long id, void *client_data);
+static void BeforeSleep(struct AeEventLoop *event_loop);
 static int AcceptHandler(AeEventLoop *event_loop, int fd,
                          void *client_data, int mask);
 
@@ -69,6 +85,16 @@ DictType sdsDictType = {
     sdsDictValDestructor,
 };
 
+// Keys are sds owned by another dict, values are not pointers.
+DictType keyptrDictType = {
+    sdsDictHashFunction,
+    NULL,
+    NULL,
+    sdsDictKeyCompare,
+    NULL,
+    NULL,
+};
+
 // Implement interface
 
 CutisServer *GetSingletonServer() {
@@ -86,6 +112,21 @@ void InitServerConfig(CutisServer *server) {
   server->log_file = NULL;
   server->verbosity = CUTIS_DEBUG;
   server->max_idle_time = CUTIS_MAX_IDLE_TIME;
+  server->io_threads_num = 1;
+  server->maxmemory = 0;
+  server->maxmemory_policy = CUTIS_MAXMEMORY_NO_EVICTION;
+  server->maxmemory_samples = CUTIS_MAXMEMORY_SAMPLES;
+  server->list_max_ziplist_entries = CUTIS_LIST_MAX_ZIPLIST_ENTRIES;
+  server->list_max_ziplist_value = CUTIS_LIST_MAX_ZIPLIST_VALUE;
+  server->set_max_intset_entries = CUTIS_SET_MAX_INTSET_ENTRIES;
+  server->set_max_ziplist_entries = CUTIS_SET_MAX_ZIPLIST_ENTRIES;
+  server->set_max_ziplist_value = CUTIS_SET_MAX_ZIPLIST_VALUE;
+  server->hash_max_ziplist_entries = CUTIS_HASH_MAX_ZIPLIST_ENTRIES;
+  server->hash_max_ziplist_value = CUTIS_HASH_MAX_ZIPLIST_VALUE;
+  server->unixtime = time(NULL);
+  server->lru_clock = GetLruClock();
+  server->stat_evicted_keys = 0;
+  server->stat_expired_keys = 0;
 
   ResetServerSaveParams(server);
   // Save after 1 hour and 1 change
@@ -103,11 +144,15 @@ void InitServer(CutisServer *server) {
   signal(SIGINT, &interrupt_handler);
 
   server->clients = listCreate();
-  server->free_objs = listCreate();
+  server->clients_pending_read = listCreate();
+  server->clients_pending_write = listCreate();
   InitSharedObjects();
-  server->el = AeCreateEventLoop();
-  server->dict = zmalloc(sizeof(Dict*) * server->db_num);
-  if (!server->clients || !server->free_objs || !server->dict) {
+  server->el = AeCreateEventLoop(CUTIS_EVENT_SET_SIZE);
+  server->db = zmalloc(sizeof(CutisDb) * server->db_num);
+  server->commands = CreateCommandTable();
+  if (!server->clients || !server->clients_pending_read ||
+      !server->clients_pending_write || !server->el || !server->db ||
+      !server->commands) {
     CutisOom("server initialization");
   }
   server->fd = anetTcpServer(server->neterr, server->port, server->bind_addr);
@@ -115,9 +160,16 @@ void InitServer(CutisServer *server) {
     CutisLog(CUTIS_WARNING, "Opening TCP port: %s", server->neterr);
     exit(1);
   }
+  if (InitIoThreads(server->io_threads_num) == CUTIS_ERR) {
+    CutisLog(CUTIS_WARNING, "Can't create %d I/O threads",
+             server->io_threads_num);
+    exit(1);
+  }
   for (i = 0; i < server->db_num; i++) {
-    server->dict[i] = DictCreate(&sdsDictType, NULL);
-    if (!server->dict[i]) {
+    server->db[i].dict = DictCreate(&sdsDictType, NULL);
+    server->db[i].expires = DictCreate(&keyptrDictType, NULL);
+    server->db[i].id = i;
+    if (!server->db[i].dict || !server->db[i].expires) {
       CutisOom("server initialization");
     }
   }
@@ -127,6 +179,7 @@ void InitServer(CutisServer *server) {
   server->bg_saving = 0;
   server->dirty = 0;
   AeCreateTimeEvent(server->el, 1000, ServerCron, server, NULL);
+  AeSetBeforeSleepProc(server->el, BeforeSleep);
 }
 
 int LoadServerConfig(CutisServer *server, const char *filename) {
@@ -223,6 +276,86 @@ int LoadServerConfig(CutisServer *server, const char *filename) {
         err = sdsnew("Invalid number of databases");
         break;
       }
+    } else if (strcmp(argv[0], "maxmemory") == 0 && argc == 2) {
+      int bad;
+
+      server->maxmemory = MemToLongLong(argv[1], &bad);
+      if (bad) {
+        err = sdsnew("Invalid maxmemory value");
+        break;
+      }
+    } else if (strcmp(argv[0], "maxmemory-policy") == 0 && argc == 2) {
+      server->maxmemory_policy = GetMaxmemoryPolicyByName(argv[1]);
+      if (server->maxmemory_policy == -1) {
+        err = sdsnew("Invalid maxmemory policy. Must be one of noeviction, "
+                     "allkeys-lru, allkeys-lfu, allkeys-random");
+        break;
+      }
+    } else if (strcmp(argv[0], "maxmemory-samples") == 0 && argc == 2) {
+      server->maxmemory_samples = atoi(argv[1]);
+      if (server->maxmemory_samples < 1) {
+        err = sdsnew("Invalid number of maxmemory samples");
+        break;
+      }
+    } else if (strcmp(argv[0], "list-max-ziplist-entries") == 0 &&
+               argc == 2) {
+      int n = atoi(argv[1]);
+      if (n < 0) {
+        err = sdsnew("Invalid number of list ziplist entries");
+        break;
+      }
+      server->list_max_ziplist_entries = n;
+    } else if (strcmp(argv[0], "list-max-ziplist-value") == 0 && argc == 2) {
+      int n = atoi(argv[1]);
+      if (n < 0) {
+        err = sdsnew("Invalid list ziplist value size");
+        break;
+      }
+      server->list_max_ziplist_value = n;
+    } else if (strcmp(argv[0], "set-max-intset-entries") == 0 && argc == 2) {
+      int n = atoi(argv[1]);
+      if (n < 0) {
+        err = sdsnew("Invalid number of set intset entries");
+        break;
+      }
+      server->set_max_intset_entries = n;
+    } else if (strcmp(argv[0], "set-max-ziplist-entries") == 0 &&
+               argc == 2) {
+      int n = atoi(argv[1]);
+      if (n < 0) {
+        err = sdsnew("Invalid number of set ziplist entries");
+        break;
+      }
+      server->set_max_ziplist_entries = n;
+    } else if (strcmp(argv[0], "set-max-ziplist-value") == 0 && argc == 2) {
+      int n = atoi(argv[1]);
+      if (n < 0) {
+        err = sdsnew("Invalid set ziplist value size");
+        break;
+      }
+      server->set_max_ziplist_value = n;
+    } else if (strcmp(argv[0], "hash-max-ziplist-entries") == 0 &&
+               argc == 2) {
+      int n = atoi(argv[1]);
+      if (n < 0) {
+        err = sdsnew("Invalid number of hash ziplist entries");
+        break;
+      }
+      server->hash_max_ziplist_entries = n;
+    } else if (strcmp(argv[0], "hash-max-ziplist-value") == 0 && argc == 2) {
+      int n = atoi(argv[1]);
+      if (n < 0) {
+        err = sdsnew("Invalid hash ziplist value size");
+        break;
+      }
+      server->hash_max_ziplist_value = n;
+    } else if (strcmp(argv[0], "io-threads") == 0 && argc == 2) {
+      server->io_threads_num = atoi(argv[1]);
+      if (server->io_threads_num < 1 ||
+          server->io_threads_num > CUTIS_IO_THREADS_MAX) {
+        err = sdsnew("Invalid number of I/O threads");
+        break;
+      }
     } else {
       err = sdsnew("Bad directive or wrong number of arguments");
       break;
@@ -261,7 +394,11 @@ int StartServer(CutisServer *server) {
                         AcceptHandler, server, NULL) == AE_ERR) {
     CutisOom("creating file event");
   }
-  CutisLog(CUTIS_NOTICE, "The server is now ready to accept connections");
+  CutisLog(CUTIS_NOTICE, "The server is now ready to accept connections "
+                         "(%s event loop)", AeGetApiName());
+  if (IoThreadsNum() > 1) {
+    CutisLog(CUTIS_NOTICE, "Network I/O uses %d threads", IoThreadsNum());
+  }
   AeMain(server->el);
   return CUTIS_OK;
 }
@@ -273,6 +410,7 @@ int CleanServer(CutisServer *server) {
   int i;
 
   CutisLog(CUTIS_NOTICE, "Clean up server");
+  KillIoThreads();
 
   // Release clients
   li = listGetIterator(server->clients, AL_START_HEAD);
@@ -284,28 +422,25 @@ int CleanServer(CutisServer *server) {
   listReleaseIterator(li);
 
   for (i = 0; i < server->db_num; i++) {
-    DictRelease(server->dict[i]);
+    // The expires share their keys with the key space, release them first.
+    DictRelease(server->db[i].expires);
+    DictRelease(server->db[i].dict);
   }
-  zfree(server->dict);
+  zfree(server->db);
+  DictRelease(server->commands);
 
   ReleaseSharedObjects();
   listRelease(server->clients);
-
-  li = listGetIterator(server->free_objs, AL_START_HEAD);
-  if (li != NULL) {
-    while ((ln = listNextElement(li)) != NULL) {
-      ReleaseCutisObject(listNodeValue(ln));
-    }
-  }
-  listReleaseIterator(li);
-  listRelease(server->free_objs);
+  listRelease(server->clients_pending_read);
+  listRelease(server->clients_pending_write);
 
   ResetServerSaveParams(server);
 
   AeDeleteEventLoop(server->el);
+  slab_release();
 
   if (server->log_file != NULL) {
-    used_size = sizeof(size_t) + strlen(server->log_file) + 1;
+    used_size = zmalloc_size(server->log_file);
   }
   CutisLog(CUTIS_DEBUG, "After clean up %zu bytes in use. "
                         "(include %zu bytes for log filename)",
@@ -334,6 +469,8 @@ void CloseTimeoutClients(CutisServer *server) {
     if ((now - c->last_interaction) > server->max_idle_time) {
       CutisLog(CUTIS_DEBUG, "Closing idle client");
       FreeClient(c);
+    } else if ((now - c->last_interaction) > 2) {
+      ShrinkClientQueryBuf(c);
     }
   }
   listReleaseIterator(li);
@@ -358,6 +495,7 @@ int SaveDB(CutisServer *server, const char *filename) {
   char tmpfile[256];
   DictIterator *di = NULL;
   DictEntry *de = NULL;
+  time_t now = time(NULL);
 
   snprintf(tmpfile, sizeof(tmpfile), CUTIS_TMP_FILENAME,
            (int)time(NULL), (long int) random());
@@ -372,7 +510,8 @@ int SaveDB(CutisServer *server, const char *filename) {
   }
 
   for (j = 0; j < server->db_num; j++) {
-    Dict *dict = server->dict[j];
+    CutisDb *db = &server->db[j];
+    Dict *dict = db->dict;
     if (DictGetHashTableUsed(dict) == 0) {
       continue;
     }
@@ -396,6 +535,26 @@ int SaveDB(CutisServer *server, const char *filename) {
     while ((de = DictNext(di)) != NULL) {
       sds key = DictGetEntryKey(de);
       CutisObject *o = DictGetEntryVal(de);
+      time_t when = GetExpire(db, key);
+
+      // Keys with a timeout are preceded by their expire time as a 64 bit
+      // big endian unix time, expired keys are not saved.
+      if (when != -1) {
+        uint32_t t[2];
+
+        if (now >= when) {
+          continue;
+        }
+        t[0] = htonl((uint32_t)((uint64_t)when >> 32));
+        t[1] = htonl((uint32_t)when);
+        type = CUTIS_EXPIRE_TIME;
+        if (fwrite(&type, 1, 1, fp) == 0) {
+          CutisSaveDBRelease();
+        }
+        if (fwrite(t, 8, 1, fp) == 0) {
+          CutisSaveDBRelease();
+        }
+      }
 
       type = o->type;
       len = htonl(sdslen(key));
@@ -409,64 +568,120 @@ int SaveDB(CutisServer *server, const char *filename) {
         CutisSaveDBRelease();
       }
       if (type == CUTIS_STRING) {
-        // Save a string value
-        sds val = o->ptr;
-        len = htonl(sdslen(val));
+        // Save a string value, integers are saved as their digits.
+        char buf[32];
+        char *val = o->ptr;
+        size_t vlen;
+
+        if (o->encoding == CUTIS_ENCODING_INT) {
+          vlen = StringObjectToBuffer(o, buf, sizeof(buf));
+          val = buf;
+        } else {
+          vlen = sdslen(val);
+        }
+        len = htonl(vlen);
         if (fwrite(&len, 4, 1, fp) == 0) {
           CutisSaveDBRelease();
         }
-        if (sdslen(val) > 0 &&
-            fwrite(val, 1, sdslen(val), fp) == 0) {
+        if (vlen > 0 && fwrite(val, 1, vlen, fp) == 0) {
           CutisSaveDBRelease();
         }
       } else if (type == CUTIS_LIST) {
-        // Save a list value.
-        List *l = o->ptr;
-        ListNode *ln = l->head;
+        // Save a list value, the format is the same for every encoding.
+        ListTypeIterator li;
+        ListTypeEntry entry;
 
-        len = htonl(listLength(l));
+        len = htonl(ListTypeLength(o));
         if (fwrite(&len, 4, 1, fp) == 0) {
           CutisSaveDBRelease();
         }
-        while (ln) {
-          o = listNodeValue(ln);
-          len = htonl(sdslen(o->ptr));
+        ListTypeInitIterator(&li, o, 0, CUTIS_TAIL);
+        while (ListTypeNext(&li, &entry)) {
+          len = htonl(entry.slen);
           if (fwrite(&len, 4, 1, fp) == 0) {
             CutisSaveDBRelease();
           }
-          if (sdslen(o->ptr) > 0 &&
-              fwrite(o->ptr, 1, sdslen(o->ptr), fp) == 0) {
+          if (entry.slen > 0 &&
+              fwrite(entry.sval, 1, entry.slen, fp) == 0) {
             CutisSaveDBRelease();
           }
-          ln = ln->next;
         }
       } else if (type == CUTIS_SET) {
-        // Save a set value.
-        Dict *set = o->ptr;
-        DictIterator *dis = DictGetIterator(set);
-        DictEntry *des;
+        // Save a set value, the format is the same for every encoding.
+        SetTypeIterator si;
+        SetTypeEntry entry;
 
-        if (!set) {
-          CutisOom("DictGetIterator");
+        len = htonl(SetTypeSize(o));
+        if (fwrite(&len, 4, 1, fp) == 0) {
+          CutisSaveDBRelease();
+        }
+        SetTypeInitIterator(&si, o);
+        while (SetTypeNext(&si, &entry)) {
+          len = htonl(entry.slen);
+          if (fwrite(&len, 4, 1, fp) == 0) {
+            SetTypeReleaseIterator(&si);
+            CutisSaveDBRelease();
+          }
+          if (entry.slen > 0 &&
+              fwrite(entry.sval, 1, entry.slen, fp) == 0) {
+            SetTypeReleaseIterator(&si);
+            CutisSaveDBRelease();
+          }
         }
-        len = htonl(DictGetHashTableUsed(set));
+        SetTypeReleaseIterator(&si);
+      } else if (type == CUTIS_ZSET) {
+        // Save a sorted set value in score order, every member is followed
+        // by its score as a string that reads back to the same double.
+        SkiplistNode *node = ((Zset *)o->ptr)->zsl->header->level[0].forward;
+        char sbuf[128];
+        int slen;
+
+        len = htonl(ZsetTypeLength(o));
         if (fwrite(&len, 4, 1, fp) == 0) {
           CutisSaveDBRelease();
         }
-        while ((des = DictNext(dis)) != NULL) {
-          CutisObject *os = DictGetEntryKey(des);
-          len = htonl(sdslen(os->ptr));
+        for (; node; node = node->level[0].forward) {
+          len = htonl(sdslen(node->ele));
+          if (fwrite(&len, 4, 1, fp) == 0) {
+            CutisSaveDBRelease();
+          }
+          if (sdslen(node->ele) > 0 &&
+              fwrite(node->ele, 1, sdslen(node->ele), fp) == 0) {
+            CutisSaveDBRelease();
+          }
+          slen = snprintf(sbuf, sizeof(sbuf), "%.17g", node->score);
+          len = htonl(slen);
           if (fwrite(&len, 4, 1, fp) == 0) {
-            DictReleaseIterator(dis);
             CutisSaveDBRelease();
           }
-          if (sdslen(os->ptr) > 0 &&
-              fwrite(os->ptr, 1, sdslen(os->ptr), fp) == 0) {
-            DictReleaseIterator(dis);
+          if (fwrite(sbuf, 1, slen, fp) == 0) {
             CutisSaveDBRelease();
           }
         }
-        DictReleaseIterator(dis);
+      } else if (type == CUTIS_HASH) {
+        // Save a hash value as fields each followed by its value, the
+        // format is the same for every encoding.
+        HashTypeIterator hi;
+        HashTypeEntry entry;
+
+        len = htonl(HashTypeLength(o));
+        if (fwrite(&len, 4, 1, fp) == 0) {
+          CutisSaveDBRelease();
+        }
+        HashTypeInitIterator(&hi, o);
+        while (HashTypeNext(&hi, &entry)) {
+          uint32_t flen = htonl(entry.flen);
+          uint32_t vlen = htonl(entry.vlen);
+
+          if (fwrite(&flen, 4, 1, fp) == 0 ||
+              (entry.flen > 0 && fwrite(entry.field, 1, entry.flen, fp) == 0) ||
+              fwrite(&vlen, 4, 1, fp) == 0 ||
+              (entry.vlen > 0 && fwrite(entry.value, 1, entry.vlen, fp) == 0)) {
+            HashTypeReleaseIterator(&hi);
+            CutisSaveDBRelease();
+          }
+        }
+        HashTypeReleaseIterator(&hi);
       } else {
         assert(0);
       }
@@ -543,7 +758,8 @@ int LoadDB(CutisServer *server, const char *filename) {
   int retval = 0;
   uint8_t type = 0;
   uint32_t klen, vlen, dbid;
-  Dict *dict = server->dict[0];
+  CutisDb *db = &server->db[0];
+  time_t now = time(NULL);
 
   fp = fopen(filename, "r");
   if (!fp) {
@@ -560,6 +776,8 @@ int LoadDB(CutisServer *server, const char *filename) {
 
   while (1) {
     CutisObject *o;
+    sds k;
+    time_t expire = -1;
     // Read type
     if (fread(&type, 1, 1, fp) == 0) {
       CutisLoadDBRelease();
@@ -579,9 +797,21 @@ int LoadDB(CutisServer *server, const char *filename) {
                                 " databases. Exiting\n", server->db_num);
         exit(1);
       }
-      dict = server->dict[dbid];
+      db = &server->db[dbid];
       continue;
     }
+    // The expire time of a key is followed by its type.
+    if (type == CUTIS_EXPIRE_TIME) {
+      uint32_t t[2];
+
+      if (fread(t, 8, 1, fp) == 0) {
+        CutisLoadDBRelease();
+      }
+      expire = (time_t)(((uint64_t)ntohl(t[0]) << 32) | ntohl(t[1]));
+      if (fread(&type, 1, 1, fp) == 0) {
+        CutisLoadDBRelease();
+      }
+    }
 
     // Read key
     if (fread(&klen, 4, 1, fp) == 0) {
@@ -617,7 +847,8 @@ int LoadDB(CutisServer *server, const char *filename) {
       if (vlen > 0 && fread(val, 1, vlen, fp) == 0) {
         CutisLoadDBRelease();
       }
-      o = CreateCutisObject(CUTIS_STRING, sdsnewlen(val, vlen));
+      o = TryObjectEncoding(CreateCutisObject(CUTIS_STRING,
+                                              sdsnewlen(val, vlen)));
     } else if (type == CUTIS_LIST || type == CUTIS_SET) {
       // Read list/set value.
       uint32_t llen;
@@ -625,7 +856,15 @@ int LoadDB(CutisServer *server, const char *filename) {
         CutisLoadDBRelease();
       }
       llen = ntohl(llen);
-      o = (type == CUTIS_LIST) ? CreateListObject() : CreateSetObject();
+      if (type == CUTIS_LIST) {
+        o = CreateListObject();
+      } else if (llen > server->set_max_intset_entries &&
+                 llen > server->set_max_ziplist_entries) {
+        o = CreateSetObject();
+      } else {
+        // Converted by SetTypeAdd() if a member is not an integer.
+        o = CreateIntsetObject();
+      }
       // Load every single element of the list/set.
       while (llen--) {
         CutisObject *el;
@@ -646,30 +885,122 @@ int LoadDB(CutisServer *server, const char *filename) {
         }
         el = CreateCutisObject(CUTIS_STRING, sdsnewlen(val, vlen));
         if (type == CUTIS_LIST) {
-          if (!listAddNodeTail(o->ptr, el)) {
-            CutisOom("listAddNodeTail");
-          }
+          ListTypePush(o, el, CUTIS_TAIL);
+          DecrRefCount(el);
+        } else {
+          SetTypeAdd(o, el->ptr);
+          DecrRefCount(el);
+        }
+        // free the temp buffer if needed
+        if (val != vbuf) {
+          zfree(val);
+        }
+        val = NULL;
+      }
+    } else if (type == CUTIS_ZSET) {
+      // Read sorted set value, members come with their score.
+      uint32_t zlen, slen;
+      char sbuf[128];
+      double score;
+
+      if (fread(&zlen, 4, 1, fp) == 0) {
+        CutisLoadDBRelease();
+      }
+      zlen = ntohl(zlen);
+      o = CreateZsetObject();
+      while (zlen--) {
+        sds member;
+
+        if (fread(&vlen, 4, 1, fp) == 0) {
+          CutisLoadDBRelease();
+        }
+        vlen = ntohl(vlen);
+        if (vlen <= CUTIS_LOAD_BUF_LEN) {
+          val = vbuf;
         } else {
-          if (DictAdd(o->ptr, el, NULL) == DICT_ERR) {
-            CutisOom("DictAdd");
+          val = zmalloc(vlen);
+          if (!val) {
+            CutisOom("Loading DB from file");
           }
         }
+        if (vlen > 0 && fread(val, 1, vlen, fp) == 0) {
+          CutisLoadDBRelease();
+        }
+        if (fread(&slen, 4, 1, fp) == 0) {
+          CutisLoadDBRelease();
+        }
+        slen = ntohl(slen);
+        if (slen >= sizeof(sbuf) || fread(sbuf, 1, slen, fp) == 0 ||
+            !StringToDouble(sbuf, slen, &score)) {
+          CutisLoadDBRelease();
+        }
+        member = sdsnewlen(val, vlen);
+        ZsetTypeAdd(o, score, member);
+        sdsfree(member);
         // free the temp buffer if needed
         if (val != vbuf) {
           zfree(val);
         }
         val = NULL;
       }
+    } else if (type == CUTIS_HASH) {
+      // Read hash value, every field is followed by its value.
+      uint32_t hlen;
+
+      if (fread(&hlen, 4, 1, fp) == 0) {
+        CutisLoadDBRelease();
+      }
+      hlen = ntohl(hlen);
+      o = CreateHashObject();
+      if (hlen > server->hash_max_ziplist_entries) {
+        HashTypeConvert(o, CUTIS_ENCODING_HT);
+      }
+      while (hlen--) {
+        sds field, value;
+
+        if (fread(&vlen, 4, 1, fp) == 0) {
+          CutisLoadDBRelease();
+        }
+        vlen = ntohl(vlen);
+        field = sdsnewlen(NULL, vlen);
+        if (vlen > 0 && fread(field, 1, vlen, fp) == 0) {
+          sdsfree(field);
+          CutisLoadDBRelease();
+        }
+        if (fread(&vlen, 4, 1, fp) == 0) {
+          sdsfree(field);
+          CutisLoadDBRelease();
+        }
+        vlen = ntohl(vlen);
+        value = sdsnewlen(NULL, vlen);
+        if (vlen > 0 && fread(value, 1, vlen, fp) == 0) {
+          sdsfree(field);
+          sdsfree(value);
+          CutisLoadDBRelease();
+        }
+        HashTypeSet(o, field, value);
+        sdsfree(field);
+        sdsfree(value);
+      }
     } else {
       assert(0);
     }
 
-    // Add the new object in the hash table.
-    retval = DictAdd(dict, sdsnewlen(key, klen), o);
-    if (retval == DICT_ERR) {
-      CutisLog(CUTIS_WARNING, "Loading DB, duplicated key found! "
-                              "Unrecoverable error, exiting now");
-      exit(1);
+    // Add the new object in the hash table, unless it expired while the
+    // DB was on disk.
+    if (expire != -1 && now >= expire) {
+      DecrRefCount(o);
+    } else {
+      k = sdsnewlen(key, klen);
+      retval = DictAdd(db->dict, k, o);
+      if (retval == DICT_ERR) {
+        CutisLog(CUTIS_WARNING, "Loading DB, duplicated key found! "
+                                "Unrecoverable error, exiting now");
+        exit(1);
+      }
+      if (expire != -1) {
+        SetExpire(db, k, expire);
+      }
     }
 
     // Iteration cleanup
@@ -693,6 +1024,38 @@ static void interrupt_handler(int sig) {
   AeStop(GetSingletonServer()->el);
 }
 
+// If the percentage of used slots in the HT reaches CUTIS_HT_MINFILL
+// resize the hash table to save memory, and help idle DBs to finish the
+// rehashing of their tables, lookups and updates move a bucket at a time.
+static void ResizeDictIfNeeded(Dict *d, int id) {
+  unsigned size = DictGetHashTableSize(d);
+  unsigned used = DictGetHashTableUsed(d);
+
+  if (size >= CUTIS_HT_MINSLOTS && (used * 100 / size < CUTIS_HT_MINFILL) &&
+      !DictIsRehashing(d)) {
+    CutisLog(CUTIS_NOTICE, "The hash table %d is to spares, resize it...", id);
+    DictResize(d);
+  }
+  if (DictIsRehashing(d)) {
+    DictRehashMilliseconds(d, CUTIS_REHASH_MS);
+  }
+}
+
+static void LogSlabStats() {
+  SlabStats st;
+  int i;
+
+  for (i = 0; i < SLAB_CLASSES; i++) {
+    slab_get_stats(i, &st);
+    if (st.slabs == 0) {
+      continue;
+    }
+    CutisLog(CUTIS_DEBUG, "Slab class %zu bytes: %zu slabs (%zu empty), "
+                          "%zu/%zu chunks used", st.size, st.slabs, st.empty,
+             st.used, st.capacity);
+  }
+}
+
 static int ServerCron(struct AeEventLoop *event_loop,
                       long long id, void *client_data) {
   int j;
@@ -701,28 +1064,39 @@ static int ServerCron(struct AeEventLoop *event_loop,
   CUTIS_NOT_USED(event_loop);
   CUTIS_NOT_USED(id);
 
-  // If the percentage of used slots in the HT reaches CUTIS_HT_MINFILL
-  // we resize the hash table to save memory
+  server->unixtime = time(NULL);
+  server->lru_clock = GetLruClock();
+
   for (j = 0; j < server->db_num; j++) {
-    unsigned size = DictGetHashTableSize(server->dict[j]);
-    unsigned used = DictGetHashTableUsed(server->dict[j]);
+    unsigned size = DictGetHashTableSize(server->db[j].dict);
+    unsigned used = DictGetHashTableUsed(server->db[j].dict);
+    unsigned vkeys = DictGetHashTableUsed(server->db[j].expires);
     if (!(loops % 5) && used > 0) {
-      CutisLog(CUTIS_DEBUG, "DB %d: %u keys in %u slots HT", j, used, size);
-    }
-    if (size >= CUTIS_HT_MINSLOTS && (used * 100 / size < CUTIS_HT_MINFILL)) {
-      CutisLog(CUTIS_NOTICE, "The hash table %d is to spares, resize it...", j);
-      DictResize(server->dict[j]);
-      CutisLog(CUTIS_NOTICE, "Hash table %d resized.", j);
+      CutisLog(CUTIS_DEBUG, "DB %d: %u keys (%u volatile) in %u slots HT",
+               j, used, vkeys, size);
     }
+    ResizeDictIfNeeded(server->db[j].dict, j);
+    ResizeDictIfNeeded(server->db[j].expires, j);
   }
 
+  // Delete some of the expired keys nobody asks for.
+  ActiveExpireCycle(server);
+
   // Show information about memory used and connected clients
   if (loops % 5 == 0) {
+    size_t rss = zmalloc_get_rss();
+
     CutisLog(CUTIS_DEBUG, "%d clients connected, %lld dirty, "
-                          "%zu bytes in use", listLength(server->clients),
-             server->dirty, zmalloc_used_memory());
+                          "%zu bytes in use, %zu rss, %.2f fragmentation",
+             listLength(server->clients), server->dirty,
+             zmalloc_used_memory(), rss,
+             zmalloc_get_fragmentation_ratio(rss));
+    LogSlabStats();
   }
 
+  // Give the memory of the slabs emptied by deletions back to malloc.
+  slab_reclaim();
+
   // Close connections of timeout clients
   if (loops % 10 == 0) {
     CloseTimeoutClients(server);
@@ -761,6 +1135,15 @@ static int ServerCron(struct AeEventLoop *event_loop,
   return 1000;
 }
 
+// Called every time before the event loop goes to sleep waiting for events.
+static void BeforeSleep(struct AeEventLoop *event_loop) {
+  CutisServer *server = GetSingletonServer();
+
+  CUTIS_NOT_USED(event_loop);
+  HandleClientsWithPendingReads(server);
+  HandleClientsWithPendingWrites(server);
+}
+
 void AppendServerSaveParams(CutisServer *server, time_t seconds, int changes) {
   size_t size = sizeof(SaveParam) * (server->save_param_len + 1);
   server->save_params = zrealloc(server->save_params,size);
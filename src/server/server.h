@@ -35,6 +35,13 @@
 
 #define CUTIS_DB_NAME       "dump.cdb"
 
+// A database: the key space and the expire times of its volatile keys.
+typedef struct CutisDb {
+  Dict *dict;     // key to value
+  Dict *expires;  // key to unix time, sharing the key of dict
+  int id;
+} CutisDb;
+
 typedef struct SaveParam {
   time_t seconds;
   int changes;
@@ -47,10 +54,12 @@ typedef struct CutisServer {
   int cron_loops;             // number of times the cron function run
   long long dirty;            // changes to DB form the last save
   List *clients;              // connected clients list
+  List *clients_pending_read;   // clients with queries to read
+  List *clients_pending_write;  // clients with replies to write
   AeEventLoop *el;            // event loop
   char neterr[ANET_ERR_LEN];  // network error message
-  List *free_objs;            // a list of freed objects to avoid malloc
-  Dict **dict;                // each dict corresponds to a database
+  CutisDb *db;                // the databases
+  Dict *commands;             // command table, by name
 
   time_t last_save;           // the timestamp of last save DB
   int bg_saving;              // background saving in process?
@@ -63,6 +72,25 @@ typedef struct CutisServer {
   int verbosity;              // log level
   int max_idle_time;          // client's maximum idle time (second)
   int db_num;                 // db number
+  int io_threads_num;         // threads doing network I/O, 1 is main only
+  unsigned long long maxmemory;  // evict keys above this, 0 is no limit
+  int maxmemory_policy;       // CUTIS_MAXMEMORY_*, see evict.h
+  int maxmemory_samples;      // keys sampled per DB to pick one to evict
+  size_t list_max_ziplist_entries;  // lists up to this long are ziplists
+  size_t list_max_ziplist_value;    // if no element is longer than this
+  size_t set_max_intset_entries;    // sets of integers up to this are intsets
+  size_t set_max_ziplist_entries;   // other sets up to this are ziplists
+  size_t set_max_ziplist_value;     // if no member is longer than this
+  size_t hash_max_ziplist_entries;  // hashes up to this many are ziplists
+  size_t hash_max_ziplist_value;    // if no field or value is longer
+
+  // Clocks cached by the cron
+  time_t unixtime;
+  unsigned int lru_clock;     // see GetLruClock()
+
+  // Statistics
+  long long stat_evicted_keys;  // keys evicted because of maxmemory
+  long long stat_expired_keys;  // keys deleted because of their timeout
 } CutisServer;
 
 
@@ -82,6 +110,8 @@ void AppendServerSaveParams(CutisServer *server, time_t seconds, int changes);
 void ResetServerSaveParams(CutisServer *server);
 
 // DictType functions
+extern DictType sdsDictType;
+extern DictType keyptrDictType;
 unsigned int sdsDictHashFunction(const void *key);
 int sdsDictKeyCompare(void *priv_data, const void *key1, const void *key2);
 void sdsDictKeyDestructor(void *priv_data, void *val);
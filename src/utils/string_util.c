@@ -21,7 +21,11 @@
 #include "utils/string_util.h"
 
 #include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 int StringMatch(const char *pattern, int pat_len,
                 const char *string, int str_len, int no_case) {
@@ -154,3 +158,97 @@ int StringMatch(const char *pattern, int pat_len,
   }
   return 0;
 }
+
+int StringToLongLong(const char *s, size_t len, long long *value) {
+  unsigned long long v = 0;
+  int negative = 0;
+  size_t i = 0;
+
+  if (len == 0 || len > 20) {
+    return 0;
+  }
+  if (s[0] == '-') {
+    negative = 1;
+    i++;
+    if (len == 1) {
+      return 0;
+    }
+  }
+  // No leading zeros, "0" is the only number starting with '0'.
+  if (s[i] == '0' && len > i + 1) {
+    return 0;
+  }
+  for (; i < len; i++) {
+    if (s[i] < '0' || s[i] > '9') {
+      return 0;
+    }
+    if (v > (ULLONG_MAX - (s[i] - '0')) / 10) {
+      return 0;
+    }
+    v = v * 10 + (s[i] - '0');
+  }
+  if (negative) {
+    if (v > (unsigned long long)LLONG_MAX + 1) {
+      return 0;
+    }
+    *value = (long long)(0 - v);
+  } else {
+    if (v > LLONG_MAX) {
+      return 0;
+    }
+    *value = (long long)v;
+  }
+  return 1;
+}
+
+int StringToDouble(const char *s, size_t len, double *value) {
+  char buf[128];
+  char *eptr;
+  double v;
+
+  if (len == 0 || len >= sizeof(buf) || isspace((unsigned char)s[0])) {
+    return 0;
+  }
+  memcpy(buf, s, len);
+  buf[len] = '\0';
+  v = strtod(buf, &eptr);
+  if (*eptr != '\0' || isnan(v)) {
+    return 0;
+  }
+  *value = v;
+  return 1;
+}
+
+long long MemToLongLong(const char *p, int *err) {
+  const char *u = p;
+  long long value;
+  long long mul;
+
+  *err = 0;
+  while (isdigit((unsigned char)*u)) {
+    u++;
+  }
+  if (!strcasecmp(u, "")) {
+    mul = 1;
+  } else if (!strcasecmp(u, "k")) {
+    mul = 1000;
+  } else if (!strcasecmp(u, "kb")) {
+    mul = 1024;
+  } else if (!strcasecmp(u, "m")) {
+    mul = 1000 * 1000;
+  } else if (!strcasecmp(u, "mb")) {
+    mul = 1024 * 1024;
+  } else if (!strcasecmp(u, "g")) {
+    mul = 1000LL * 1000 * 1000;
+  } else if (!strcasecmp(u, "gb")) {
+    mul = 1024LL * 1024 * 1024;
+  } else {
+    *err = 1;
+    return 0;
+  }
+  if (!StringToLongLong(p, u - p, &value) || value > LLONG_MAX / mul) {
+    *err = 1;
+    return 0;
+  }
+  return value * mul;
+}
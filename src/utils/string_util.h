@@ -21,8 +21,24 @@
 #ifndef UTILS_STRING_UTIL_H_
 #define UTILS_STRING_UTIL_H_
 
+#include <stddef.h>
+
 // Glob-style pattern matching.
 int StringMatch(const char *pattern, int pat_len,
                 const char *string, int str_len, int no_case);
 
+// Convert exactly len bytes of s to a long long. Returns 1 on success and 0
+// if s is not a canonical base 10 integer or it overflows.
+int StringToLongLong(const char *s, size_t len, long long *value);
+
+// Convert exactly len bytes of s to a double. Returns 1 on success and 0
+// if s is not a number, has spaces around or is NaN. "inf" and "-inf" are
+// accepted.
+int StringToDouble(const char *s, size_t len, double *value);
+
+// Convert a memory amount like "1gb" to bytes. The units k, kb, m, mb, g,
+// gb are case insensitive, k is 1000 and kb 1024 and so on. Sets *err to
+// 1 if p is not a valid amount, to 0 otherwise.
+long long MemToLongLong(const char *p, int *err);
+
 #endif  // UTILS_STRING_UTIL_H_
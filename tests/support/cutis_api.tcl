@@ -22,6 +22,21 @@ proc cutis_get {fd key} {
     cutis_bulk_read $fd
 }
 
+proc cutis_mget {fd args} {
+    cutis_writenl $fd "mget [join $args]"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_mset {fd args} {
+    cutis_write_multibulk $fd mset {*}$args
+    cutis_read_retcode $fd
+}
+
+proc cutis_msetnx {fd args} {
+    cutis_write_multibulk $fd msetnx {*}$args
+    cutis_read_integer $fd
+}
+
 proc cutis_select {fd id} {
     cutis_writenl $fd "select $id"
     cutis_read_retcode $fd
@@ -57,6 +72,16 @@ proc cutis_decr {fd key} {
     cutis_read_integer $fd
 }
 
+proc cutis_incrby {fd key val} {
+    cutis_writenl $fd "incrby $key $val"
+    cutis_read_integer $fd
+}
+
+proc cutis_decrby {fd key val} {
+    cutis_writenl $fd "decrby $key $val"
+    cutis_read_integer $fd
+}
+
 proc cutis_exists {fd key} {
     cutis_writenl $fd "exists $key"
     cutis_read_integer $fd
@@ -142,7 +167,156 @@ proc cutis_sinter {fd args} {
     cutis_multi_bulk_read $fd
 }
 
+proc cutis_sintercard {fd args} {
+    cutis_writenl $fd "sintercard [join $args]"
+    cutis_read_integer $fd
+}
+
+proc cutis_sinterstore {fd args} {
+    cutis_writenl $fd "sinterstore [join $args]"
+    cutis_read_integer $fd
+}
+
+proc cutis_sunion {fd args} {
+    cutis_writenl $fd "sunion [join $args]"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_sunionstore {fd args} {
+    cutis_writenl $fd "sunionstore [join $args]"
+    cutis_read_integer $fd
+}
+
+proc cutis_sdiff {fd args} {
+    cutis_writenl $fd "sdiff [join $args]"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_sdiffstore {fd args} {
+    cutis_writenl $fd "sdiffstore [join $args]"
+    cutis_read_integer $fd
+}
+
 proc cutis_smembers {fd key} {
     cutis_writenl $fd "smembers $key"
     cutis_multi_bulk_read $fd
 }
+
+proc cutis_zadd {fd key score val} {
+    cutis_writenl $fd "zadd $key $score [string length $val]\r\n$val"
+    cutis_read_integer $fd
+}
+
+proc cutis_zincrby {fd key increment val} {
+    cutis_writenl $fd "zincrby $key $increment [string length $val]\r\n$val"
+    cutis_bulk_read $fd
+}
+
+proc cutis_zrem {fd key val} {
+    cutis_writenl $fd "zrem $key [string length $val]\r\n$val"
+    cutis_read_integer $fd
+}
+
+proc cutis_zcard {fd key} {
+    cutis_writenl $fd "zcard $key"
+    cutis_read_integer $fd
+}
+
+proc cutis_zscore {fd key val} {
+    cutis_writenl $fd "zscore $key [string length $val]\r\n$val"
+    cutis_bulk_read $fd
+}
+
+proc cutis_zrank {fd key val} {
+    cutis_writenl $fd "zrank $key [string length $val]\r\n$val"
+    cutis_read_integer $fd
+}
+
+proc cutis_zrevrank {fd key val} {
+    cutis_writenl $fd "zrevrank $key [string length $val]\r\n$val"
+    cutis_read_integer $fd
+}
+
+proc cutis_zrange {fd key first last args} {
+    cutis_writenl $fd "zrange $key $first $last $args"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_zrevrange {fd key first last args} {
+    cutis_writenl $fd "zrevrange $key $first $last $args"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_zrangebyscore {fd key min max args} {
+    cutis_writenl $fd "zrangebyscore $key $min $max $args"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_hset {fd key field val} {
+    cutis_writenl $fd "hset $key $field [string length $val]\r\n$val"
+    cutis_read_integer $fd
+}
+
+proc cutis_hget {fd key field} {
+    cutis_writenl $fd "hget $key [string length $field]\r\n$field"
+    cutis_bulk_read $fd
+}
+
+proc cutis_hmget {fd key args} {
+    cutis_writenl $fd "hmget $key [join $args]"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_hgetall {fd key} {
+    cutis_writenl $fd "hgetall $key"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_hdel {fd key field} {
+    cutis_writenl $fd "hdel $key [string length $field]\r\n$field"
+    cutis_read_integer $fd
+}
+
+proc cutis_hlen {fd key} {
+    cutis_writenl $fd "hlen $key"
+    cutis_read_integer $fd
+}
+
+proc cutis_hincrby {fd key field increment} {
+    cutis_writenl $fd "hincrby $key $field $increment"
+    cutis_read_integer $fd
+}
+
+proc cutis_setex {fd key seconds val} {
+    cutis_writenl $fd "setex $key $seconds [string length $val]\r\n$val"
+    cutis_read_retcode $fd
+}
+
+proc cutis_expire {fd key seconds} {
+    cutis_writenl $fd "expire $key $seconds"
+    cutis_read_integer $fd
+}
+
+proc cutis_ttl {fd key} {
+    cutis_writenl $fd "ttl $key"
+    cutis_read_integer $fd
+}
+
+proc cutis_persist {fd key} {
+    cutis_writenl $fd "persist $key"
+    cutis_read_integer $fd
+}
+
+proc cutis_scan {fd cursor args} {
+    cutis_writenl $fd "scan $cursor $args"
+    cutis_multi_bulk_read $fd
+}
+
+proc cutis_info_field {fd field} {
+    cutis_writenl $fd info
+    set info [cutis_bulk_read $fd]
+    if {![regexp "(^|\n)$field:(\[^\r\n\]*)" $info -> _ value]} {
+        return {}
+    }
+    return $value
+}
@@ -20,6 +20,14 @@ proc cutis_writenl {fd buf} {
     flush $fd
 }
 
+proc cutis_write_multibulk {fd args} {
+    cutis_write $fd "*[llength $args]\r\n"
+    foreach arg $args {
+        cutis_write $fd "\$[string length $arg]\r\n$arg\r\n"
+    }
+    flush $fd
+}
+
 proc cutis_readnl {fd len} {
     set buf [read $fd $len]
     # discard CR LF
@@ -0,0 +1,39 @@
+#
+# Copyright (c) 2023 furzoom.com, All rights reserved.
+# Author: mn, mn@furzoom.com
+
+# Start a second server on port, configured with the given list of config
+# file lines, in its own directory. Returns the pid once the server accepts
+# connections.
+proc start_server {port config} {
+    set dir [file join [pwd] tmp-$port]
+    file delete -force $dir
+    file mkdir $dir
+    set fp [open [file join $dir cutis.conf] w]
+    puts $fp "port $port"
+    puts $fp "dir $dir"
+    foreach line $config {
+        puts $fp $line
+    }
+    close $fp
+
+    set pid [exec ../src/cutis-server [file join $dir cutis.conf] \
+                 > [file join $dir stdout] 2>@1 &]
+    for {set retry 0} {$retry < 50} {incr retry} {
+        if {![catch {close [socket 127.0.0.1 $port]}]} {
+            return $pid
+        }
+        after 100
+    }
+    error "server on port $port didn't start, see $dir/stdout"
+}
+
+# Stop a server started by start_server and remove its directory.
+proc kill_server {pid port} {
+    catch {exec kill -INT $pid}
+    for {set retry 0} {$retry < 50} {incr retry} {
+        if {[catch {exec kill -0 $pid}]} break
+        after 100
+    }
+    file delete -force [file join [pwd] tmp-$port]
+}
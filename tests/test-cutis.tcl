@@ -11,6 +11,7 @@ cd [file dirname [info script]]
 
 source "support/util.tcl"
 source "support/cutis_api.tcl"
+source "support/server.tcl"
 
 proc test {name code expected} {
     set retval [uplevel 1 $code]
@@ -72,6 +73,15 @@ proc main {server port} {
         cutis_get $fd foo
     } [string repeat "abcd" 1000000]
 
+    test {Very big payload in multi bulk SET followed by a pipelined GET} {
+        set buf [string repeat "efgh" 1000000]
+        cutis_write $fd "*3\r\n\$3\r\nset\r\n\$3\r\nfoo\r\n"
+        cutis_write $fd "\$[string length $buf]\r\n$buf\r\nget foo\r\n"
+        flush $fd
+        cutis_read_retcode $fd
+        cutis_bulk_read $fd
+    } [string repeat "efgh" 1000000]
+
     test {SET 10000 numeric keys and access all them in reverse order} {
         for {set x 0} {$x < 10000} {incr x} {
             cutis_set $fd $x $x
@@ -102,6 +112,27 @@ proc main {server port} {
         cutis_incr $fd novar
     } {101}
 
+    test {INCRBY and DECRBY against key originally set with set} {
+        list [cutis_incrby $fd novar 100] [cutis_decrby $fd novar 200]
+    } {201 1}
+
+    test {INCRBY over 32 bit value} {
+        cutis_set $fd novar 17179869184
+        cutis_incrby $fd novar 17179869184
+    } {34359738368}
+
+    test {INCR against a value with leading spaces} {
+        cutis_set $fd novar " 11"
+        cutis_incr $fd novar
+        list [cutis_get $fd novar] [cutis_incr $fd novar]
+    } {12 13}
+
+    test {INCRBY against overflow and invalid increment} {
+        cutis_set $fd novar 9223372036854775807
+        list [cutis_incr $fd novar] [cutis_incrby $fd novar foo] \
+             [cutis_get $fd novar]
+    } {{-ERR increment or decrement would overflow} {-ERR value is not an integer or out of range} 9223372036854775807}
+
     test {SETNX target key missing} {
         cutis_setnx $fd novar2 foobared
         cutis_get $fd novar2
@@ -112,6 +143,29 @@ proc main {server port} {
         cutis_get $fd novar2
     } {foobared}
 
+    test {MSET and MGET} {
+        set res [cutis_mset $fd mkey1 {a b} mkey2 "c\r\nd" mkey3 10]
+        cutis_rpush $fd mlist foo
+        lappend res [cutis_mget $fd mkey1 mkey2 nokey mlist mkey3]
+    } [list +OK [list {a b} "c\r\nd" {} {} 10]]
+
+    test {MSETNX sets all the keys or none} {
+        set res [cutis_msetnx $fd mkey4 x mkey1 y]
+        lappend res [cutis_mget $fd mkey4 mkey1]
+        lappend res [cutis_msetnx $fd mkey4 x mkey5 y]
+        lappend res [cutis_mget $fd mkey4 mkey5]
+    } {0 {{} {a b}} 1 {x y}}
+
+    test {MGET of many keys} {
+        set args {}
+        for {set i 0} {$i < 500} {incr i} {
+            lappend args bkey$i $i
+        }
+        cutis_mset $fd {*}$args
+        set res [cutis_mget $fd bkey0 bkey250 nokey bkey499]
+        lappend res [llength [cutis_mget $fd {*}[lrepeat 300 bkey7]]]
+    } {0 250 {} 499 300}
+
     test {EXISTS} {
         set res {}
         cutis_set $fd newkey test
@@ -386,6 +440,56 @@ proc main {server port} {
         cutis_lset $fd nolist 0 foo
     } {-ERR*value*}
 
+    test {LSET with a value too large for a compact list} {
+        set big [string repeat x 100]
+        cutis_lset $fd mylist 2 $big
+        list [cutis_lrange $fd mylist 0 -1] [cutis_lpop $fd mylist] \
+             [cutis_rpop $fd mylist] [cutis_llen $fd mylist]
+    } [list [list 99 foo [string repeat x 100] 96 bar] 99 bar 3]
+
+    test {List growing past the compact size limit} {
+        cutis_del $fd mylist
+        set l {}
+        for {set i 0} {$i < 300} {incr i} {
+            if {$i % 2} {
+                cutis_rpush $fd mylist $i
+                lappend l $i
+            } else {
+                cutis_lpush $fd mylist $i
+                set l [linsert $l 0 $i]
+            }
+        }
+        set res [expr {[cutis_lrange $fd mylist 0 -1] eq $l}]
+        lappend res [cutis_llen $fd mylist] [cutis_lindex $fd mylist 150]
+        cutis_ltrim $fd mylist 10 -11
+        lappend res [expr {[cutis_lrange $fd mylist 0 -1] eq
+                           [lrange $l 10 end-10]}]
+    } [list 1 300 1 1]
+
+    test {LSET, LINDEX and LTRIM on a large list} {
+        cutis_del $fd mylist
+        set l {}
+        for {set i 0} {$i < 1000} {incr i} {
+            cutis_rpush $fd mylist $i
+            lappend l $i
+        }
+        for {set i 0} {$i < 100} {incr i} {
+            set idx [expr {int(rand()*1000)}]
+            set val [string repeat [expr {$i % 10}] [expr {$i * 5}]]
+            cutis_lset $fd mylist $idx $val
+            lset l $idx $val
+        }
+        set err 0
+        for {set i 0} {$i < 1000} {incr i} {
+            if {[cutis_lindex $fd mylist $i] ne [lindex $l $i]} {incr err}
+            if {[cutis_lindex $fd mylist [expr {$i - 1000}]] ne
+                [lindex $l $i]} {incr err}
+        }
+        cutis_ltrim $fd mylist 300 -301
+        lappend err [expr {[cutis_lrange $fd mylist 0 -1] eq
+                           [lrange $l 300 end-300]}]
+    } {0 1}
+
     test {SADD, SCARD, SINMEMBER, SMEMBERS basic usage} {
         cutis_sadd $fd myset foo
         cutis_sadd $fd myset bar
@@ -429,6 +533,426 @@ proc main {server port} {
         lsort [cutis_sinter $fd set1 set2 set3]
     } {995 999}
 
+    test {SADD, SISMEMBER and SREM with a set of integers} {
+        foreach v {5 -3 100000 -9223372036854775808 9223372036854775807} {
+            cutis_sadd $fd intset $v
+        }
+        set res [lsort -integer [cutis_smembers $fd intset]]
+        cutis_srem $fd intset 100000
+        lappend res [cutis_sismember $fd intset 100000] \
+                    [cutis_sismember $fd intset -3] \
+                    [cutis_sismember $fd intset foo] [cutis_scard $fd intset]
+    } {-9223372036854775808 -3 5 100000 9223372036854775807 0 1 0 4}
+
+    test {Set of integers converted when a member is not an integer} {
+        cutis_sadd $fd intset 05
+        cutis_sadd $fd intset -0
+        cutis_sadd $fd intset 5
+        list [lsort [cutis_smembers $fd intset]] \
+             [cutis_sismember $fd intset 05] [cutis_sismember $fd intset 0]
+    } {{-0 -3 -9223372036854775808 05 5 9223372036854775807} 1 0}
+
+    test {Small sets converted when they grow} {
+        set ok 1
+        foreach {key prefix} {intset2 {} strset foo} {
+            for {set i 0} {$i < 600} {incr i} {
+                cutis_sadd $fd $key $prefix$i
+            }
+            for {set i 0} {$i < 600} {incr i} {
+                if {![cutis_sismember $fd $key $prefix$i]} {set ok 0}
+            }
+            lappend ok [cutis_scard $fd $key]
+        }
+        cutis_sadd $fd strset [string repeat x 100]
+        lappend ok [cutis_scard $fd strset]
+    } {1 600 600 601}
+
+    test {SINTER against sets of different encodings} {
+        cutis_del $fd set4
+        cutis_del $fd set5
+        foreach v {1 2 3 foo} {cutis_sadd $fd set4 $v}
+        foreach v {0 1 3 5} {cutis_sadd $fd set5 $v}
+        list [lsort [cutis_sinter $fd set4 set5 intset2]] \
+             [lsort [cutis_sinter $fd set4 strset]] \
+             [lsort [cutis_sinter $fd set5 set4]]
+    } {{1 3} {} {1 3}}
+
+    test {ZADD, ZSCORE, ZCARD and ZREM basics} {
+        set res [cutis_zadd $fd zset 10 x]
+        lappend res [cutis_zadd $fd zset 20 y] [cutis_zadd $fd zset 5 x]
+        lappend res [cutis_zscore $fd zset x] [cutis_zcard $fd zset]
+        lappend res [cutis_zrem $fd zset y] [cutis_zrem $fd zset y]
+        lappend res [cutis_zscore $fd zset y] [cutis_zincrby $fd zset 2.5 x]
+    } {1 1 0 5 2 1 0 {} 7.5}
+
+    test {ZRANK, ZREVRANK and ZRANGE are ordered by score then member} {
+        cutis_del $fd zset
+        foreach {score member} {3 c 1 a 2 b 2 bb 10 z} {
+            cutis_zadd $fd zset $score $member
+        }
+        list [cutis_zrank $fd zset bb] [cutis_zrevrank $fd zset bb] \
+             [cutis_zrank $fd zset nomember] \
+             [cutis_zrange $fd zset 0 -1] [cutis_zrevrange $fd zset 0 1] \
+             [cutis_zrange $fd zset 1 2 withscores]
+    } {2 2 nil {a b bb c z} {z c} {b 2 bb 2}}
+
+    test {ZRANGEBYSCORE with exclusive bounds, infinities and LIMIT} {
+        list [cutis_zrangebyscore $fd zset 2 3] \
+             [cutis_zrangebyscore $fd zset (2 +inf] \
+             [cutis_zrangebyscore $fd zset -inf (2] \
+             [cutis_zrangebyscore $fd zset -inf +inf limit 1 2] \
+             [cutis_zrangebyscore $fd zset 4 5]
+    } {{b bb c} {c z} a {b bb} {}}
+
+    test {ZRANK and ZRANGE on a large sorted set} {
+        cutis_del $fd bigzset
+        for {set i 0} {$i < 1000} {incr i} {
+            cutis_zadd $fd bigzset [expr {1000 - $i}] m$i
+        }
+        list [cutis_zcard $fd bigzset] [cutis_zrank $fd bigzset m0] \
+             [cutis_zrank $fd bigzset m999] [cutis_zrange $fd bigzset 500 501] \
+             [cutis_zrangebyscore $fd bigzset 100 101] [cutis_zadd $fd set3 1 x]
+    } {1000 999 0 {m499 m498} {m900 m899} {-ERR ZADD against key not holding a sorted set value}}
+
+    test {HSET, HGET, HDEL and HLEN basics} {
+        set res [cutis_hset $fd myhash name foo]
+        lappend res [cutis_hset $fd myhash age 10] [cutis_hset $fd myhash name bar]
+        lappend res [cutis_hget $fd myhash name] [cutis_hget $fd myhash nofield]
+        lappend res [cutis_hlen $fd myhash] [cutis_hdel $fd myhash age]
+        lappend res [cutis_hdel $fd myhash age] [cutis_hlen $fd myhash]
+    } {1 1 0 bar {} 2 1 0 1}
+
+    test {HMGET and HGETALL read a record in one command} {
+        cutis_writenl $fd "hset myhash age 10 city 4\r\nRome"
+        set res [cutis_read_integer $fd]
+        lappend res [cutis_hmget $fd myhash city nofield name]
+        lappend res [lsort [cutis_hgetall $fd myhash]]
+        lappend res [cutis_hmget $fd nokey a b] [cutis_hgetall $fd nokey]
+    } {2 {Rome {} bar} {10 Rome age bar city name} {{} {}} {}}
+
+    test {HINCRBY} {
+        set res [cutis_hincrby $fd myhash counter 5]
+        lappend res [cutis_hincrby $fd myhash counter -7]
+        lappend res [cutis_hincrby $fd myhash name 1]
+    } {5 -2 {-ERR hash value is not an integer}}
+
+    test {Hash converted to a hash table when it outgrows the ziplist} {
+        cutis_del $fd bighash
+        for {set i 0} {$i < 200} {incr i} {
+            cutis_hset $fd bighash field$i value$i
+        }
+        cutis_hset $fd myhash long [string repeat x 100]
+        list [cutis_hlen $fd bighash] [cutis_hget $fd bighash field150] \
+             [cutis_hincrby $fd bighash counter 3] \
+             [string length [cutis_hget $fd myhash long]] \
+             [cutis_hget $fd myhash city]
+    } {200 value150 3 100 Rome}
+
+    test {SINTERCARD} {
+        list [cutis_sintercard $fd 2 set1 set2] \
+             [cutis_sintercard $fd 3 set1 set2 set3] \
+             [cutis_sintercard $fd 1 set1] [cutis_sintercard $fd 2 set1 nokey] \
+             [cutis_sintercard $fd 2 set4 set5]
+    } {5 2 1000 0 2}
+
+    test {SINTERCARD with LIMIT and wrong arguments} {
+        list [cutis_sintercard $fd 2 set1 set2 LIMIT 3] \
+             [cutis_sintercard $fd 2 set1 set2 limit 0] \
+             [cutis_sintercard $fd 2 set1 set2 LIMIT 100] \
+             [cutis_sintercard $fd 3 set1 set2] \
+             [cutis_sintercard $fd 2 set1 set2 LIMIT -1] \
+             [cutis_sintercard $fd 1 set1 set2]
+    } {3 5 5 {-ERR invalid number of keys} {-ERR LIMIT can't be negative} {-ERR syntax error}}
+
+    test {SUNION and SDIFF} {
+        list [lsort [cutis_sunion $fd set4 set5 nokey]] \
+             [lsort [cutis_sdiff $fd set4 set5]] \
+             [lsort [cutis_sdiff $fd set5 nokey set4]] \
+             [cutis_sdiff $fd nokey set4] [cutis_sdiff $fd set4 set4]
+    } {{0 1 2 3 5 foo} {2 foo} {0 5} {} {}}
+
+    test {SDIFF of a small set against a large one and the other way} {
+        set res [lsort -integer [cutis_sdiff $fd set3 set1]]
+        lappend res [llength [cutis_sdiff $fd set1 set3]]
+    } {1000 2000 998}
+
+    test {SINTERSTORE, SUNIONSTORE and SDIFFSTORE} {
+        cutis_setex $fd setdst 100 foo
+        set res [cutis_sunionstore $fd setdst set4 set5]
+        lappend res [lsort [cutis_smembers $fd setdst]] [cutis_ttl $fd setdst]
+        lappend res [cutis_sinterstore $fd setdst setdst set4]
+        lappend res [lsort [cutis_smembers $fd setdst]]
+        lappend res [cutis_sdiffstore $fd setdst set4 set5]
+        lappend res [lsort [cutis_smembers $fd setdst]]
+        lappend res [cutis_sinterstore $fd setdst set4 nokey]
+        lappend res [cutis_exists $fd setdst]
+    } {6 {0 1 2 3 5 foo} -1 4 {1 2 3 foo} 2 {2 foo} 0 0}
+
+    test {Set operations against a key not holding a set} {
+        cutis_set $fd notaset foo
+        list [cutis_sinter $fd set4 notaset] [cutis_sunion $fd notaset set4] \
+             [cutis_sdiffstore $fd setdst set4 notaset] [cutis_scard $fd set4]
+    } {{***ERROR*** SINTER against key not holding a set value} {***ERROR*** SUNION against key not holding a set value} {-ERR SDIFFSTORE against key not holding a set value} 4}
+
+    test {Command names are case insensitive} {
+        cutis_set $fd casekey foo
+        cutis_writenl $fd "GeT casekey"
+        set res [cutis_bulk_read $fd]
+        cutis_write_multibulk $fd DEL casekey
+        lappend res [cutis_read_retcode $fd]
+    } {foo +OK}
+
+    test {Multi bulk SET/GET with spaces and newlines} {
+        cutis_write_multibulk $fd set "my key" "foo bar\r\nbaz"
+        cutis_read_retcode $fd
+        cutis_write_multibulk $fd get "my key"
+        set res [cutis_bulk_read $fd]
+        cutis_write_multibulk $fd del "my key"
+        cutis_read_integer $fd
+        format %s $res
+    } "foo bar\r\nbaz"
+
+    test {Multi bulk request with many arguments} {
+        cutis_write_multibulk $fd sinter {*}[lrepeat 40 set3]
+        lsort [cutis_multi_bulk_read $fd]
+    } {1000 2000 995 999}
+
+    test {Pipelined inline and multi bulk requests} {
+        cutis_write $fd "set pipe1 3\r\none\r\n"
+        cutis_write $fd "*3\r\n\$3\r\nset\r\n\$5\r\npipe2\r\n\$3\r\ntwo\r\n"
+        cutis_writenl $fd "get pipe1"
+        cutis_write_multibulk $fd get pipe2
+        list [cutis_read_retcode $fd] [cutis_read_retcode $fd] \
+             [cutis_bulk_read $fd] [cutis_bulk_read $fd]
+    } {+OK +OK one two}
+
+    test {SCAN returns every key} {
+        for {set i 0} {$i < 1000} {incr i} {
+            cutis_set $fd scan:$i foo
+        }
+        set keys {}
+        set cursor 0
+        while 1 {
+            set res [cutis_scan $fd $cursor MATCH scan:* COUNT 100]
+            set cursor [lindex $res 0]
+            lappend keys {*}[lrange $res 1 end]
+            if {$cursor == 0} break
+        }
+        llength [lsort -unique $keys]
+    } {1000}
+
+    test {SCAN returns every key while the dict grows} {
+        set keys {}
+        set cursor 0
+        set i 1000
+        while 1 {
+            set res [cutis_scan $fd $cursor MATCH scan:* COUNT 20]
+            set cursor [lindex $res 0]
+            lappend keys {*}[lrange $res 1 end]
+            if {$cursor == 0} break
+            if {$i >= 3000} continue
+            for {set j 0} {$j < 100} {incr j} {
+                cutis_set $fd scan:$i foo
+                incr i
+            }
+        }
+        set missing 0
+        for {set j 0} {$j < 1000} {incr j} {
+            if {[lsearch -exact $keys scan:$j] == -1} {incr missing}
+        }
+        for {set j 0} {$j < $i} {incr j} {
+            cutis_del $fd scan:$j
+        }
+        format $missing
+    } {0}
+
+    test {SCAN returns every key while the dict shrinks} {
+        for {set i 0} {$i < 50} {incr i} {
+            cutis_set $fd scan:$i foo
+        }
+        for {set i 0} {$i < 10000} {incr i} {
+            cutis_set $fd scan:tmp:$i foo
+        }
+        set res [cutis_scan $fd 0 MATCH scan:* COUNT 20]
+        set cursor [lindex $res 0]
+        set keys [lrange $res 1 end]
+        # The cron shrinks the emptied table while the scan goes on.
+        for {set i 0} {$i < 10000} {incr i} {
+            cutis_del $fd scan:tmp:$i
+        }
+        while {$cursor != 0} {
+            after 20
+            set res [cutis_scan $fd $cursor MATCH scan:* COUNT 20]
+            set cursor [lindex $res 0]
+            lappend keys {*}[lrange $res 1 end]
+        }
+        set missing 0
+        for {set j 0} {$j < 50} {incr j} {
+            if {[lsearch -exact $keys scan:$j] == -1} {incr missing}
+            cutis_del $fd scan:$j
+        }
+        format $missing
+    } {0}
+
+    test {SCAN with an invalid cursor} {
+        cutis_scan $fd foo
+    } {***ERROR*** *}
+
+    test {EXPIRE and TTL basic usage} {
+        cutis_set $fd volatile foo
+        set res [cutis_ttl $fd volatile]
+        lappend res [cutis_expire $fd volatile 100]
+        set ttl [cutis_ttl $fd volatile]
+        lappend res [expr {$ttl > 98 && $ttl <= 100}]
+        lappend res [cutis_expire $fd nokey 100] [cutis_ttl $fd nokey]
+    } {-1 1 1 0 -2}
+
+    test {PERSIST and SET discard the timeout} {
+        cutis_expire $fd volatile 100
+        set res [cutis_persist $fd volatile]
+        lappend res [cutis_ttl $fd volatile] [cutis_persist $fd volatile]
+        cutis_expire $fd volatile 100
+        cutis_set $fd volatile bar
+        lappend res [cutis_ttl $fd volatile]
+    } {1 -1 0 -1}
+
+    test {Keys are deleted on access once expired} {
+        cutis_setex $fd volatile 1 foo
+        set res [cutis_get $fd volatile]
+        after 2100
+        lappend res [cutis_get $fd volatile] [cutis_ttl $fd volatile]
+    } {foo {} -2}
+
+    test {Expired keys are deleted without being accessed} {
+        for {set i 0} {$i < 100} {incr i} {
+            cutis_setex $fd volatile:$i 1 foo
+        }
+        set before [cutis_dbsize $fd]
+        after 3100
+        expr {$before - [cutis_dbsize $fd]}
+    } {100}
+
+    test {RENAME moves the timeout with the value} {
+        cutis_setex $fd volatile 100 foo
+        cutis_rename $fd volatile volatile2
+        set ttl [cutis_ttl $fd volatile2]
+        cutis_del $fd volatile2
+        expr {$ttl > 98 && $ttl <= 100}
+    } {1}
+
+    test {SET/GET values around the embedded string size limit} {
+        cutis_set $fd emb1 [string repeat x 44]
+        cutis_set $fd emb2 [string repeat y 45]
+        cutis_set $fd emb1 [string repeat z 43]
+        list [string length [cutis_get $fd emb1]] \
+             [string length [cutis_get $fd emb2]] \
+             [string index [cutis_get $fd emb1] 0]
+    } {43 45 z}
+
+    test {INFO reports memory usage} {
+        cutis_writenl $fd info
+        set info [cutis_bulk_read $fd]
+        list [regexp {used_memory:[0-9]+\r\n} $info] \
+             [regexp {used_memory_rss:[0-9]+\r\n} $info] \
+             [regexp {mem_fragmentation_ratio:[0-9.]+\r\n} $info]
+    } {1 1 1}
+
+    test {INFO reports the eviction settings} {
+        cutis_writenl $fd info
+        set info [cutis_bulk_read $fd]
+        list [regexp {maxmemory:[0-9]+\r\n} $info] \
+             [regexp {maxmemory_policy:[a-z-]+\r\n} $info] \
+             [regexp {evicted_keys:[0-9]+\r\n} $info]
+    } {1 1 1}
+
+    test {allkeys-lru evicts keys to stay under maxmemory} {
+        set pid [start_server 6381 \
+                     {"maxmemory 2mb" "maxmemory-policy allkeys-lru"}]
+        set fd2 [cutis_connect 127.0.0.1 6381]
+        set value [string repeat x 100]
+        for {set i 0} {$i < 20000} {incr i} {
+            cutis_set $fd2 key:$i $value
+        }
+        set dbsize [cutis_dbsize $fd2]
+        set evicted [cutis_info_field $fd2 evicted_keys]
+        close $fd2
+        kill_server $pid 6381
+        list [expr {$dbsize > 0 && $dbsize < 20000}] \
+             [expr {$evicted == 20000 - $dbsize}]
+    } {1 1}
+
+    test {allkeys-lru keeps the recently read keys} {
+        set pid [start_server 6381 \
+                     {"maxmemory 2mb" "maxmemory-policy allkeys-lru"}]
+        set fd2 [cutis_connect 127.0.0.1 6381]
+        set value [string repeat x 100]
+        for {set i 0} {$i < 9000} {incr i} {
+            cutis_set $fd2 key:$i $value
+        }
+        # The LRU clock ticks every second, let the keys get idle.
+        after 2500
+        for {set i 0} {$i < 100} {incr i} {
+            cutis_get $fd2 key:$i
+        }
+        for {set i 0} {$i < 2000} {incr i} {
+            cutis_set $fd2 new:$i $value
+        }
+        set evicted [cutis_info_field $fd2 evicted_keys]
+        set hot 0
+        for {set i 0} {$i < 100} {incr i} {
+            incr hot [cutis_exists $fd2 key:$i]
+        }
+        close $fd2
+        kill_server $pid 6381
+        list [expr {$evicted > 0}] $hot
+    } {1 100}
+
+    test {allkeys-lfu keeps the frequently read keys} {
+        set pid [start_server 6381 \
+                     {"maxmemory 2mb" "maxmemory-policy allkeys-lfu"}]
+        set fd2 [cutis_connect 127.0.0.1 6381]
+        set value [string repeat x 100]
+        for {set i 0} {$i < 9000} {incr i} {
+            cutis_set $fd2 key:$i $value
+        }
+        for {set i 0} {$i < 100} {incr i} {
+            cutis_get $fd2 key:$i
+        }
+        for {set i 0} {$i < 2000} {incr i} {
+            cutis_set $fd2 new:$i $value
+        }
+        set evicted [cutis_info_field $fd2 evicted_keys]
+        set hot 0
+        for {set i 0} {$i < 100} {incr i} {
+            incr hot [cutis_exists $fd2 key:$i]
+        }
+        close $fd2
+        kill_server $pid 6381
+        list [expr {$evicted > 0}] $hot
+    } {1 100}
+
+    test {noeviction refuses the commands using memory over maxmemory} {
+        set pid [start_server 6381 \
+                     {"maxmemory 1mb" "maxmemory-policy noeviction"}]
+        set fd2 [cutis_connect 127.0.0.1 6381]
+        set value [string repeat x 100]
+        set err {}
+        for {set i 0} {$i < 20000} {incr i} {
+            set res [cutis_set $fd2 key:$i $value]
+            if {$res ne {+OK}} {
+                set err $res
+                break
+            }
+        }
+        set dbsize [cutis_dbsize $fd2]
+        set res [list $err [cutis_get $fd2 key:0] [cutis_del $fd2 key:0] \
+                     [expr {$dbsize == $i}] \
+                     [cutis_info_field $fd2 evicted_keys]]
+        close $fd2
+        kill_server $pid 6381
+        format $res
+    } {{-ERR command not allowed when used memory > 'maxmemory'} xxxx* +OK 1 0}
+
 
     # Leave the user with a clean DB before to exit
     test {DEL all keys again (DB 0)} {